@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <getopt.h>
+#include "timing.h"
+#include "cells.h"
+#include "grid.h"
+#include "bitgrid.h"
+#include "kernels.h"
+#include "blocking.h"
+#include "seed.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define DEFAULT_GENERATIONS 100
+#define DEFAULT_BLOCK_GENERATIONS 8
+#define BENCH_SEED          0x5EED5EED5EED5EEDull
+
+// Boards past the last level cache are only run when -k asks for blocks,
+// as they take long and are what blocking saves memory traffic on
+struct board_size {
+    size_t width;
+    size_t height;
+    bool past_caches;
+};
+
+static const struct board_size sizes[] = {
+    {256, 256, false},
+    {640, 480, false},
+    {2048, 2048, false},
+    {8192, 8192, true}
+};
+static const double densities[] = {0.1, 0.35, 0.5};
+
+// The bitgrid engine is benchmarked alongside the cell kernels, and the
+// best kernel again stepping blocks of generations
+struct bench_kernel {
+    const char* name;
+    const struct cell_kernel* kernel;
+    bool blocked;
+};
+
+struct blocking {
+    size_t generations;
+    size_t block_size;
+};
+
+struct counters {
+    int cycles_fd;
+    int llc_misses_fd;
+};
+
+struct result {
+    double median_ns;
+    double p99_ns;
+    double cycles;
+    double llc_misses;
+    bool matches;
+};
+
+// The same size and density always give the same board, which is also the
+// board the simulator seeds with --seed BENCH_SEED ^ (W << 32) ^ H
+static void seed_board(struct thread_pool* const pool, const struct grid* const g, uint32_t* const cells, const double density)
+{
+    const struct board_seed seed = {
+        .seed = BENCH_SEED ^ (g->width << 32) ^ g->height,
+        .density = density
+    };
+    seed_cells(pool, &seed, select_cell_kernel(), g, cells);
+}
+
+static int compare_ns(const void* const a, const void* const b)
+{
+    const int64_t lhs = *(const int64_t*)a;
+    const int64_t rhs = *(const int64_t*)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+#ifdef __linux__
+static int open_counter(const uint32_t type, const uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static struct counters open_counters(const bool enabled)
+{
+    struct counters counters = {
+        .cycles_fd = -1,
+        .llc_misses_fd = -1
+    };
+#ifdef __linux__
+    if (enabled) {
+        counters.cycles_fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        counters.llc_misses_fd = open_counter(
+            PERF_TYPE_HW_CACHE,
+            PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+        );
+        if ((counters.cycles_fd == -1) || (counters.llc_misses_fd == -1)) {
+            fprintf(stderr, "Warning: perf_event_open failed (%s), hardware counters are unavailable.\n", strerror(errno));
+        }
+    }
+#else
+    if (enabled) {
+        fprintf(stderr, "Warning: Hardware counters are only supported on Linux.\n");
+    }
+#endif
+    return counters;
+}
+
+static void close_counters(const struct counters* const counters)
+{
+#ifdef __linux__
+    if (counters->cycles_fd != -1) {
+        close(counters->cycles_fd);
+    }
+    if (counters->llc_misses_fd != -1) {
+        close(counters->llc_misses_fd);
+    }
+#else
+    (void)counters;
+#endif
+}
+
+static void start_counter(const int fd)
+{
+#ifdef __linux__
+    if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    (void)fd;
+#endif
+}
+
+// Returns -1 when the counter is unavailable
+static double stop_counter(const int fd)
+{
+#ifdef __linux__
+    uint64_t value;
+    if (fd != -1) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &value, sizeof(value)) == sizeof(value)) {
+            return (double)value;
+        }
+    }
+#else
+    (void)fd;
+#endif
+    return -1.0;
+}
+
+// Sums the row hashes a kernel left behind into the hash of the generation
+static uint64_t sum_row_hashes(const struct grid* const g, const uint64_t* const row_hashes)
+{
+    uint64_t hash = 0;
+    for (size_t y = 0; y < g->height; y++) {
+        hash += row_hashes[y];
+    }
+    return hash;
+}
+
+// Sums the census of each row the same way
+static struct census sum_row_census(const struct grid* const g, const struct census* const row_census)
+{
+    struct census census;
+    census_clear(&census);
+    for (size_t y = 0; y < g->height; y++) {
+        census_merge(&census, &row_census[y]);
+    }
+    return census;
+}
+
+static bool census_matches(const struct census* const a, const struct census* const b)
+{
+    return (a->population == b->population)
+        && (a->births == b->births) && (a->deaths == b->deaths)
+        && ((a->population == 0)
+            || ((a->x_min == b->x_min) && (a->y_min == b->y_min) && (a->x_end == b->x_end) && (a->y_end == b->y_end)));
+}
+
+// Runs generations of one kernel from start and compares the final board,
+// and for cell kernels its hash and census, with expected. Each generation
+// is timed on its own, or for blocks, each block of generations, divided
+// among them.
+static bool run_kernel(
+    const struct bench_kernel* const bk,
+    const struct grid* const g,
+    const uint32_t* const start,
+    const uint32_t* const expected,
+    const uint64_t expected_hash,
+    const struct census* const expected_census,
+    const size_t generations,
+    const struct blocking* const blocking,
+    const struct counters* const counters,
+    int64_t* const samples,
+    struct result* const result)
+{
+    uint32_t* cells[2] = {grid_alloc_cells(g), grid_alloc_cells(g)};
+    struct bitgrid bits[2] = {bitgrid_create(g->width, g->height, g->boundary, &g->rule), bitgrid_create(g->width, g->height, g->boundary, &g->rule)};
+    uint64_t* const row_hashes = calloc(g->height, sizeof(uint64_t));
+    struct census* const row_census = calloc(g->height, sizeof(struct census));
+    struct thread_pool pool = {0};
+    struct cell_blocker blocker = {0};
+    struct grid stepped = *g;
+    bool ok = false;
+    if ((bk->kernel != NULL) && !cell_kernel_prepare(bk->kernel, &stepped)) {
+        goto free_buffers;
+    }
+    if ((cells[0] == NULL) || (cells[1] == NULL) || (bits[0].words == NULL) || (bits[1].words == NULL) || (row_hashes == NULL) || (row_census == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the cell buffers.\n");
+        goto free_buffers;
+    }
+    if (bk->blocked
+        && (!pool_create(&pool, 1) || !cell_blocker_create(&blocker, bk->kernel, &stepped, blocking->block_size, blocking->generations, 1))) {
+        goto free_buffers;
+    }
+    memcpy(cells[0], start, grid_num_bytes(g));
+    bitgrid_from_argb(&bits[0], start, g->stride);
+
+    size_t current = 0;
+    size_t num_samples = 0;
+    start_counter(counters->cycles_fd);
+    start_counter(counters->llc_misses_fd);
+    for (size_t gen = 0; gen < generations; gen++) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (bk->blocked) {
+            const size_t block = (generations - gen < blocking->generations) ? generations - gen : blocking->generations;
+            cell_blocker_step(&blocker, &pool, cells[current], cells[1 - current], row_hashes, row_census, block);
+            current = 1 - current;
+            gen += block - 1;
+            struct timespec t1;
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            samples[num_samples++] = get_time_diff_ns(&t0, &t1) / (int64_t)block;
+            continue;
+        }
+        if (bk->kernel == NULL) {
+            bitgrid_step(&bits[current], &bits[1 - current]);
+            current = 1 - current;
+        } else {
+            bk->kernel->update(&stepped, cells[current], cells[1 - current], row_hashes, row_census);
+            if (!bk->kernel->in_place) {
+                current = 1 - current;
+            }
+        }
+        struct timespec t1;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        samples[num_samples++] = get_time_diff_ns(&t0, &t1);
+    }
+    result->cycles = stop_counter(counters->cycles_fd);
+    result->llc_misses = stop_counter(counters->llc_misses_fd);
+
+    if (bk->kernel == NULL) {
+        bitgrid_to_argb(&bits[current], cells[current], g->width, g->height, g->stride);
+    }
+    if (bk->kernel != NULL) {
+        const struct census census = sum_row_census(g, row_census);
+        result->matches = (sum_row_hashes(g, row_hashes) == expected_hash) && census_matches(&census, expected_census);
+    } else {
+        result->matches = true;
+    }
+    for (size_t y = 0; result->matches && (y < g->height); y++) {
+        const size_t row = y * g->stride;
+        if (memcmp(cells[current] + row, expected + row, g->width * sizeof(uint32_t)) != 0) {
+            result->matches = false;
+            break;
+        }
+    }
+
+    qsort(samples, num_samples, sizeof(int64_t), compare_ns);
+    result->median_ns = (double)samples[num_samples / 2];
+    result->p99_ns = (double)samples[(num_samples * 99) / 100];
+    ok = true;
+
+free_buffers:
+    cell_blocker_destroy(&blocker);
+    if (pool.num_threads > 0) {
+        pool_destroy(&pool);
+    }
+    cell_kernel_release(&stepped);
+    grid_free_cells(g, cells[0]);
+    grid_free_cells(g, cells[1]);
+    bitgrid_destroy(&bits[0]);
+    bitgrid_destroy(&bits[1]);
+    free(row_hashes);
+    free(row_census);
+    return ok;
+}
+
+static void print_usage(const char* const program)
+{
+    printf("Usage: %s [options]\n"
+           "  -n, --generations N  generations per kernel and board (default: %d)\n"
+           "  -c, --counters       read cycles and LLC misses with perf_event_open\n"
+           "  -r, --rule RULE      B/S rule to step the boards with (default: B3/S23)\n"
+           "  -k, --block-generations K\n"
+           "                       generations per block of the blocked kernel (default: %d),\n"
+           "                       also running a board larger than the caches\n"
+           "  -s, --block-size N   tiles of N by N cells for the blocked kernel, a\n"
+           "                       multiple of %d (default: %d)\n"
+           "  -h, --help           show this message\n",
+           program, DEFAULT_GENERATIONS, DEFAULT_BLOCK_GENERATIONS, BLOCK_SIZE_MULTIPLE, DEFAULT_BLOCK_SIZE);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t generations = DEFAULT_GENERATIONS;
+    bool use_counters = false;
+    bool past_caches = false;
+    struct rule rule = conway_rule;
+    struct blocking blocking = {
+        .generations = DEFAULT_BLOCK_GENERATIONS,
+        .block_size = DEFAULT_BLOCK_SIZE
+    };
+
+    static const struct option long_options[] = {
+        {"generations", required_argument, NULL, 'n'},
+        {"counters",    no_argument,       NULL, 'c'},
+        {"rule",        required_argument, NULL, 'r'},
+        {"block-generations", required_argument, NULL, 'k'},
+        {"block-size",  required_argument, NULL, 's'},
+        {"help",        no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:cr:k:s:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'n': {
+            char* end;
+            generations = strtoul(optarg, &end, 10);
+            if ((end == optarg) || (*end != '\0') || (generations == 0)) {
+                fprintf(stderr, "Error: Invalid generation count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'c':
+            use_counters = true;
+            break;
+        case 'r':
+            if (!parse_rule(optarg, &rule)) {
+                fprintf(stderr, "Error: Invalid or unsupported rule: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'k': {
+            char* end;
+            blocking.generations = strtoul(optarg, &end, 10);
+            if ((end == optarg) || (*end != '\0') || (blocking.generations == 0)) {
+                fprintf(stderr, "Error: Invalid generations per block: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            past_caches = true;
+            break;
+        }
+        case 's': {
+            char* end;
+            blocking.block_size = strtoul(optarg, &end, 10);
+            if ((end == optarg) || (*end != '\0') || (blocking.block_size == 0) || (blocking.block_size % BLOCK_SIZE_MULTIPLE != 0)) {
+                fprintf(stderr, "Error: Invalid block size, which must be a multiple of %d: %s\n", BLOCK_SIZE_MULTIPLE, optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+        case 'h':
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (blocking.block_size < blocking.generations) {
+        fprintf(stderr, "Error: Blocks must be at least as many cells wide as the generations they are stepped.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Every kernel this CPU can run, the kernels kept for comparison, the
+    // bitgrid engine, then the best kernel stepping blocks of generations
+    struct bench_kernel kernels[16];
+    size_t num_kernels = 0;
+    for (size_t i = 0; i < num_cell_kernels; i++) {
+        if (cell_kernels[i].is_supported()) {
+            kernels[num_kernels].name = cell_kernels[i].name;
+            kernels[num_kernels].kernel = &cell_kernels[i];
+            kernels[num_kernels].blocked = false;
+            num_kernels++;
+        }
+    }
+    kernels[num_kernels].name = alt_cell_kernel.name;
+    kernels[num_kernels].kernel = &alt_cell_kernel;
+    kernels[num_kernels].blocked = false;
+    num_kernels++;
+    kernels[num_kernels].name = lookup_cell_kernel.name;
+    kernels[num_kernels].kernel = &lookup_cell_kernel;
+    kernels[num_kernels].blocked = false;
+    num_kernels++;
+    kernels[num_kernels].name = "bitgrid";
+    kernels[num_kernels].kernel = NULL;
+    kernels[num_kernels].blocked = false;
+    num_kernels++;
+    char blocked_name[32];
+    snprintf(blocked_name, sizeof(blocked_name), "%s/k%zu", select_cell_kernel()->name, blocking.generations);
+    kernels[num_kernels].name = blocked_name;
+    kernels[num_kernels].kernel = select_cell_kernel();
+    kernels[num_kernels].blocked = true;
+    num_kernels++;
+
+    const struct counters counters = open_counters(use_counters);
+    int64_t* const samples = malloc(generations * sizeof(int64_t));
+    if (samples == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for the samples.\n");
+        return EXIT_FAILURE;
+    }
+    // Only seeding runs on more than one thread
+    struct thread_pool pool;
+    if (!pool_create(&pool, pool_default_threads())) {
+        return EXIT_FAILURE;
+    }
+
+    char rule_name[RULE_STRING_SIZE];
+    format_rule(&rule, rule_name, sizeof(rule_name));
+    printf("%zu generations per run, rule %s, blocks of %zu generations on %zux%zu tiles\n",
+           generations, rule_name, blocking.generations, blocking.block_size, blocking.block_size);
+    // Each LLC miss reads a cache line from memory
+    printf("%-11s %7s %-11s %12s %12s %9s %12s %12s %11s %s\n",
+           "board", "density", "kernel", "median ns", "p99 ns", "cells/ns", "cycles/gen", "LLC miss/gen", "DRAM B/cell", "check");
+    bool all_match = true;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        if (sizes[s].past_caches && !past_caches) {
+            continue;
+        }
+        const struct grid g = grid_init(sizes[s].width, sizes[s].height, BOUNDARY_DEAD, &rule);
+        for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+            // The scalar kernel is the reference every other kernel must match
+            uint32_t* const start = grid_alloc_cells(&g);
+            uint32_t* const expected = grid_alloc_cells(&g);
+            uint32_t* const scratch = grid_alloc_cells(&g);
+            uint64_t* const row_hashes = calloc(g.height, sizeof(uint64_t));
+            struct census* const row_census = calloc(g.height, sizeof(struct census));
+            if ((start == NULL) || (expected == NULL) || (scratch == NULL) || (row_hashes == NULL) || (row_census == NULL)) {
+                fprintf(stderr, "Error: Failed to allocate memory for the cell buffers.\n");
+                return EXIT_FAILURE;
+            }
+            seed_board(&pool, &g, start, densities[d]);
+            memcpy(expected, start, grid_num_bytes(&g));
+            for (size_t gen = 0; gen < generations; gen++) {
+                update_cells(&g, expected, scratch, row_hashes, row_census);
+                memcpy(expected, scratch, grid_num_bytes(&g));
+            }
+            const uint64_t expected_hash = sum_row_hashes(&g, row_hashes);
+            const struct census expected_census = sum_row_census(&g, row_census);
+            free(row_hashes);
+            free(row_census);
+
+            char board[32];
+            snprintf(board, sizeof(board), "%zux%zu", g.width, g.height);
+            for (size_t k = 0; k < num_kernels; k++) {
+                struct result result;
+                if (!run_kernel(&kernels[k], &g, start, expected, expected_hash, &expected_census, generations, &blocking, &counters, samples, &result)) {
+                    return EXIT_FAILURE;
+                }
+                all_match = all_match && result.matches;
+                const double num_cells = (double)(g.width * g.height);
+                printf("%-11s %7.2f %-11s %12.0f %12.0f %9.3f ",
+                       board, densities[d], kernels[k].name,
+                       result.median_ns, result.p99_ns, num_cells / result.median_ns);
+                if (result.cycles >= 0.0) {
+                    printf("%12.0f ", result.cycles / (double)generations);
+                } else {
+                    printf("%12s ", "n/a");
+                }
+                if (result.llc_misses >= 0.0) {
+                    printf("%12.0f %11.3f ",
+                           result.llc_misses / (double)generations,
+                           result.llc_misses * CACHE_LINE_SIZE / (num_cells * (double)generations));
+                } else {
+                    printf("%12s %11s ", "n/a", "n/a");
+                }
+                printf("%s\n", result.matches ? "ok" : "MISMATCH");
+            }
+            grid_free_cells(&g, start);
+            grid_free_cells(&g, expected);
+            grid_free_cells(&g, scratch);
+        }
+    }
+
+    free(samples);
+    pool_destroy(&pool);
+    close_counters(&counters);
+    if (!all_match) {
+        fprintf(stderr, "Error: Some kernels did not match the scalar kernel.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,419 @@
+#include "bitgrid.h"
+#include "cells.h"
+#include "rule.h"
+#include "hash.h"
+#include "planes.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+static inline uint64_t last_word_mask(const size_t width)
+{
+    const size_t remainder = width % 64;
+    return (remainder == 0) ? UINT64_MAX : ((UINT64_C(1) << remainder) - 1);
+}
+
+// The first row starts on a cache line so that row bands handed to worker
+// threads line up with cache lines too.
+static inline size_t words_before_first_row(const size_t words_per_row)
+{
+    const size_t words_per_line = CACHE_LINE_SIZE / sizeof(uint64_t);
+    return ((words_per_row + words_per_line - 1) / words_per_line) * words_per_line;
+}
+
+struct bitgrid bitgrid_create(const size_t width, const size_t height, const enum boundary boundary, const struct rule* const rule)
+{
+    // One blank row above and below the grid serves as the dead border,
+    // so the stepping loop never has to check whether a row exists.
+    const size_t words_per_row = (width + 63) / 64;
+    const size_t lead = words_before_first_row(words_per_row);
+    size_t num_bytes = (lead + (words_per_row * (height + 1))) * sizeof(uint64_t);
+    num_bytes = ((num_bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
+    uint64_t* const alloc = aligned_alloc(CACHE_LINE_SIZE, num_bytes);
+    if (alloc != NULL) {
+        memset(alloc, 0, num_bytes);
+    }
+    struct bitgrid grid = {
+        .words = (alloc == NULL) ? NULL : alloc + lead,
+        .width = width,
+        .height = height,
+        .words_per_row = words_per_row,
+        .boundary = boundary,
+        .rule = *rule
+    };
+    return grid;
+}
+
+void bitgrid_destroy(struct bitgrid* const grid)
+{
+    if (grid->words != NULL) {
+        free(grid->words - words_before_first_row(grid->words_per_row));
+        grid->words = NULL;
+    }
+}
+
+void bitgrid_clear_padding(struct bitgrid* const grid)
+{
+    const uint64_t mask = last_word_mask(grid->width);
+    const size_t last = grid->words_per_row - 1;
+    for (size_t y = 0; y < grid->height; y++) {
+        grid->words[(y * grid->words_per_row) + last] &= mask;
+    }
+}
+
+void bitgrid_refresh_halo(struct bitgrid* const grid)
+{
+    if (grid->boundary != BOUNDARY_TORUS) {
+        return;
+    }
+    const size_t n = grid->words_per_row;
+    memcpy(grid->words - n, grid->words + ((grid->height - 1) * n), n * sizeof(uint64_t));
+    memcpy(grid->words + (grid->height * n), grid->words, n * sizeof(uint64_t));
+}
+
+// Sets length live cells starting at (x, y), which must all be in the grid
+void bitgrid_set_run(struct bitgrid* const grid, const size_t x, const size_t y, const size_t length)
+{
+    uint64_t* const row = grid->words + (y * grid->words_per_row);
+    size_t i = x;
+    const size_t end = x + length;
+    while (i < end) {
+        const size_t bit = i % 64;
+        const size_t num_bits = ((end - i) < (64 - bit)) ? (end - i) : (64 - bit);
+        const uint64_t bits = (num_bits == 64) ? UINT64_MAX : (((UINT64_C(1) << num_bits) - 1) << bit);
+        row[i / 64] |= bits;
+        i += num_bits;
+    }
+}
+
+// Where the cells past the left and right ends of each row come from. All
+// zero for a dead boundary, so the same code handles both boundaries.
+struct row_edges {
+    uint64_t wrap;
+    unsigned int west_shift;
+    unsigned int east_shift;
+    uint64_t east_in_last;
+};
+
+static inline struct row_edges row_edges(const struct bitgrid* const grid)
+{
+    struct row_edges edges = {
+        .wrap = (grid->boundary == BOUNDARY_TORUS) ? UINT64_MAX : 0,
+        .west_shift = (unsigned int)(63 - ((grid->width - 1) % 64)),
+        .east_shift = (unsigned int)(grid->width % 64),
+        .east_in_last = ((grid->width % 64) != 0) ? UINT64_MAX : 0
+    };
+    return edges;
+}
+
+// A word whose top bit is the cell left of the first cell of the row
+static inline uint64_t west_of_row(const struct row_edges* const edges, const uint64_t* const row, const size_t n)
+{
+    return edges->wrap & (row[n - 1] << edges->west_shift);
+}
+
+// The last word of a row, with the cell right of the last cell added past the
+// end of the row when the row does not fill its last word
+static inline uint64_t last_of_row(const struct row_edges* const edges, const uint64_t* const row, const size_t n)
+{
+    return row[n - 1] | (edges->east_in_last & edges->wrap & ((row[0] & 1) << edges->east_shift));
+}
+
+// A word whose bottom bit is the cell right of the last cell of the row, when
+// the row fills its last word
+static inline uint64_t east_of_row(const struct row_edges* const edges, const uint64_t* const row)
+{
+    return ~edges->east_in_last & edges->wrap & row[0] & 1;
+}
+
+static inline __attribute__((always_inline)) void step_rows(
+    const struct bitgrid* const prev,
+    struct bitgrid* const next,
+    const size_t y_start,
+    const size_t y_end,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    const size_t n = prev->words_per_row;
+    const uint64_t mask = last_word_mask(prev->width);
+    const struct row_edges edges = row_edges(prev);
+    for (size_t y = y_start; y < y_end; y++) {
+        const uint64_t* const row = prev->words + (y * n);
+        const uint64_t* const above = row - n;
+        const uint64_t* const below = row + n;
+        uint64_t* const out = next->words + (y * n);
+
+        uint64_t a_l = west_of_row(&edges, above, n), a = above[0];
+        uint64_t b_l = west_of_row(&edges, row, n), b = row[0];
+        uint64_t c_l = west_of_row(&edges, below, n), c = below[0];
+        for (size_t x = 0; x + 1 < n; x++) {
+            const uint64_t a_r = above[x+1];
+            const uint64_t b_r = row[x+1];
+            const uint64_t c_r = below[x+1];
+            out[x] = step_word_rule(a_l, a, a_r, b_l, b, b_r, c_l, c, c_r, birth, survival);
+            a_l = a; a = a_r;
+            b_l = b; b = b_r;
+            c_l = c; c = c_r;
+        }
+        out[n-1] = mask & step_word_rule(
+            a_l, last_of_row(&edges, above, n), east_of_row(&edges, above),
+            b_l, last_of_row(&edges, row, n), east_of_row(&edges, row),
+            c_l, last_of_row(&edges, below, n), east_of_row(&edges, below),
+            birth, survival
+        );
+    }
+}
+
+// Each common rule gets its own copy of the stepping loop
+void bitgrid_step_rows(
+    const struct bitgrid* const prev,
+    struct bitgrid* const next,
+    const size_t y_start,
+    const size_t y_end)
+{
+    RULE_DISPATCH_MASKS(&prev->rule, step_rows, prev, next, y_start, y_end);
+}
+
+void bitgrid_step(const struct bitgrid* const prev, struct bitgrid* const next)
+{
+    bitgrid_step_rows(prev, next, 0, prev->height);
+}
+
+struct step_args {
+    const struct bitgrid* prev;
+    struct bitgrid* next;
+};
+
+static void step_band(void* const ctx, const size_t y_start, const size_t y_end)
+{
+    const struct step_args* const args = ctx;
+    bitgrid_step_rows(args->prev, args->next, y_start, y_end);
+}
+
+void bitgrid_step_parallel(struct thread_pool* const pool, const struct bitgrid* const prev, struct bitgrid* const next)
+{
+    struct step_args args = {
+        .prev = prev,
+        .next = next
+    };
+    pool_run_rows(pool, step_band, &args, prev->height, prev->words_per_row * sizeof(uint64_t));
+}
+
+// The live rows of a tile are a mask of one word
+_Static_assert(TILE_SIZE == 64, "tile rows must fit a word");
+
+// Steps one tile, sets hash to the sum of the hashes of its new words and
+// census to their census, and returns whether any of its cells changed
+static inline __attribute__((always_inline)) bool step_tile(
+    const struct bitgrid* const prev,
+    struct bitgrid* const next,
+    const size_t tx,
+    const size_t ty,
+    uint64_t* const hash,
+    struct census* const census,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    const size_t n = prev->words_per_row;
+    const struct row_edges edges = row_edges(prev);
+    const bool is_first = tx == 0;
+    const bool is_last = (tx + 1) == n;
+    const uint64_t mask = is_last ? last_word_mask(prev->width) : UINT64_MAX;
+    const size_t y_start = ty * TILE_SIZE;
+    const size_t y_end = (y_start + TILE_SIZE < prev->height) ? y_start + TILE_SIZE : prev->height;
+    uint64_t diff = 0;
+    uint64_t sum = 0;
+    // The census is summed in registers and boxed once per tile, from a
+    // mask of the live columns and one of the live rows, without branches
+    uint64_t population = 0;
+    uint64_t births = 0;
+    uint64_t flips = 0;
+    uint64_t columns = 0;
+    uint64_t rows_live = 0;
+    for (size_t y = y_start; y < y_end; y++) {
+        const uint64_t* const middle = prev->words + (y * n);
+        const uint64_t* const rows[3] = {middle - n, middle, middle + n};
+        uint64_t words[3][3];
+        for (size_t r = 0; r < 3; r++) {
+            const uint64_t* const row = rows[r];
+            words[r][0] = is_first ? west_of_row(&edges, row, n) : row[tx - 1];
+            words[r][1] = is_last ? last_of_row(&edges, row, n) : row[tx];
+            words[r][2] = is_last ? east_of_row(&edges, row) : row[tx + 1];
+        }
+        const uint64_t out = mask & step_word_rule(
+            words[0][0], words[0][1], words[0][2],
+            words[1][0], words[1][1], words[1][2],
+            words[2][0], words[2][1], words[2][2],
+            birth, survival
+        );
+        diff |= out ^ middle[tx];
+        sum += hash_word(out, (y * n) + tx);
+        population += (uint64_t)__builtin_popcountll(out);
+        births += (uint64_t)__builtin_popcountll(out & ~middle[tx]);
+        flips += (uint64_t)__builtin_popcountll(out ^ middle[tx]);
+        columns |= out;
+        rows_live |= (uint64_t)(out != 0) << (y - y_start);
+        next->words[(y * n) + tx] = out;
+    }
+    *hash = sum;
+    census_clear(census);
+    census->population = population;
+    census->births = births;
+    census->deaths = flips - births;
+    if (columns != 0) {
+        census->x_min = (tx * 64) + (uint64_t)__builtin_ctzll(columns);
+        census->x_end = (tx * 64) + 64 - (uint64_t)__builtin_clzll(columns);
+        census->y_min = y_start + (uint64_t)__builtin_ctzll(rows_live);
+        census->y_end = y_start + 64 - (uint64_t)__builtin_clzll(rows_live);
+    }
+    return diff != 0;
+}
+
+struct step_tiles_args {
+    const struct bitgrid* prev;
+    struct bitgrid* next;
+    struct tile_map* tiles;
+};
+
+static inline __attribute__((always_inline)) void step_tiles(
+    const struct step_tiles_args* const args,
+    const size_t ty_start,
+    const size_t ty_end,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    struct tile_map* const tiles = args->tiles;
+    for (size_t ty = ty_start; ty < ty_end; ty++) {
+        for (size_t tx = 0; tx < tiles->tiles_x; tx++) {
+            const size_t i = (ty * tiles->tiles_x) + tx;
+            if (!tiles->active[i]) {
+                tiles->changed[i] = 0;
+                continue;
+            }
+            const bool changed = step_tile(args->prev, args->next, tx, ty, &tiles->hashes[i], &tiles->census[i], birth, survival);
+            tiles->changed[i] = changed;
+            tiles->dirty[i] |= changed;
+        }
+    }
+}
+
+static void step_tile_rows(void* const ctx, const size_t ty_start, const size_t ty_end)
+{
+    const struct step_tiles_args* const args = ctx;
+    RULE_DISPATCH_MASKS(&args->prev->rule, step_tiles, args, ty_start, ty_end);
+}
+
+// Only recomputes the tiles that changed in the last generation and their
+// neighbors. The other tiles of next must already hold the same cells as in
+// prev, which holds as long as every step of this grid goes through here:
+// an inactive tile did not change between next and prev, and neither did
+// its hash.
+void bitgrid_step_tiles_parallel(
+    struct thread_pool* const pool,
+    const struct bitgrid* const prev,
+    struct bitgrid* const next,
+    struct tile_map* const tiles)
+{
+    if (tile_map_update_active(tiles) == 0) {
+        return;
+    }
+    struct step_tiles_args args = {
+        .prev = prev,
+        .next = next,
+        .tiles = tiles
+    };
+    pool_run_rows(pool, step_tile_rows, &args, tiles->tiles_y, CACHE_LINE_SIZE);
+}
+
+// pitch is the distance between rows of pixels in cells
+void bitgrid_from_argb(struct bitgrid* const grid, const uint32_t* const pixels, const size_t pitch)
+{
+    for (size_t y = 0; y < grid->height; y++) {
+        const uint32_t* const in = pixels + (y * pitch);
+        uint64_t* const row = grid->words + (y * grid->words_per_row);
+        for (size_t i = 0; i < grid->words_per_row; i++) {
+            row[i] = 0;
+        }
+        for (size_t x = 0; x < grid->width; x++) {
+            row[x / 64] |= (uint64_t)(in[x] == LIVE_CELL) << (x % 64);
+        }
+    }
+}
+
+// pixels points at the pixel for x_start, y_start
+static void expand_rect(
+    const struct bitgrid* const grid,
+    uint32_t* const pixels,
+    const size_t x_start,
+    const size_t x_end,
+    const size_t y_start,
+    const size_t y_end,
+    const size_t pitch)
+{
+    for (size_t y = y_start; y < y_end; y++) {
+        const uint64_t* const row = grid->words + (y * grid->words_per_row);
+        uint32_t* const out = pixels + ((y - y_start) * pitch);
+        for (size_t x = x_start; x < x_end; x++) {
+            const uint32_t live = (uint32_t)(row[x / 64] >> (x % 64)) & 1;
+            out[x - x_start] = DEAD_CELL ^ (-live & (LIVE_CELL ^ DEAD_CELL));
+        }
+    }
+}
+
+// Expands the top left view_width x view_height cells
+void bitgrid_to_argb(
+    const struct bitgrid* const grid,
+    uint32_t* const pixels,
+    const size_t view_width,
+    const size_t view_height,
+    const size_t pitch)
+{
+    expand_rect(grid, pixels, 0, view_width, 0, view_height, pitch);
+}
+
+// Expands width x height cells from x, y to pixels, which points at the
+// first of them, such as a locked region of a texture
+void bitgrid_to_argb_rect(
+    const struct bitgrid* const grid,
+    uint32_t* const pixels,
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const size_t pitch)
+{
+    expand_rect(grid, pixels, x, x + width, y, y + height, pitch);
+}
+
+// Copies the top left of src into dst, which is no larger
+void bitgrid_copy_view(struct bitgrid* const dst, const struct bitgrid* const src)
+{
+    const uint64_t mask = last_word_mask(dst->width);
+    for (size_t y = 0; y < dst->height; y++) {
+        const uint64_t* const in = src->words + (y * src->words_per_row);
+        uint64_t* const out = dst->words + (y * dst->words_per_row);
+        memcpy(out, in, dst->words_per_row * sizeof(uint64_t));
+        out[dst->words_per_row - 1] &= mask;
+    }
+}
+
+// Like bitgrid_to_argb, but only expands the dirty tiles. The rest of the
+// pixels must still hold what was expanded before.
+void bitgrid_to_argb_tiles(
+    const struct bitgrid* const grid,
+    uint32_t* const pixels,
+    const size_t view_width,
+    const size_t view_height,
+    const size_t pitch,
+    const struct tile_map* const tiles)
+{
+    for (size_t y = 0; y < view_height; y += TILE_SIZE) {
+        const size_t y_end = (y + TILE_SIZE < view_height) ? y + TILE_SIZE : view_height;
+        for (size_t x = 0; x < view_width; x += TILE_SIZE) {
+            if (tiles->dirty[((y / TILE_SIZE) * tiles->tiles_x) + (x / TILE_SIZE)]) {
+                const size_t x_end = (x + TILE_SIZE < view_width) ? x + TILE_SIZE : view_width;
+                expand_rect(grid, pixels + (y * pitch) + x, x, x_end, y, y_end, pitch);
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef bitgrid_h
+#define bitgrid_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pool.h"
+#include "tiles.h"
+
+// One bit per cell, 64 cells per word, least significant bit leftmost.
+// Bits past the right edge of each row are always kept clear. The halo rows
+// above and below the grid are dead, or with a torus boundary, copies of the
+// opposite rows that bitgrid_refresh_halo updates once per generation. Rows
+// wrap around horizontally as they are stepped, under rule.
+struct bitgrid {
+    uint64_t* words;
+    size_t width;
+    size_t height;
+    size_t words_per_row;
+    enum boundary boundary;
+    struct rule rule;
+};
+
+struct bitgrid bitgrid_create(const size_t width, const size_t height, const enum boundary boundary, const struct rule* const rule);
+void bitgrid_destroy(struct bitgrid* const grid);
+void bitgrid_clear_padding(struct bitgrid* const grid);
+void bitgrid_refresh_halo(struct bitgrid* const grid);
+void bitgrid_set_run(struct bitgrid* const grid, const size_t x, const size_t y, const size_t length);
+void bitgrid_step(const struct bitgrid* const prev, struct bitgrid* const next);
+void bitgrid_step_rows(const struct bitgrid* const prev, struct bitgrid* const next, const size_t y_start, const size_t y_end);
+void bitgrid_step_parallel(struct thread_pool* const pool, const struct bitgrid* const prev, struct bitgrid* const next);
+void bitgrid_step_tiles_parallel(struct thread_pool* const pool, const struct bitgrid* const prev, struct bitgrid* const next, struct tile_map* const tiles);
+void bitgrid_from_argb(struct bitgrid* const grid, const uint32_t* const pixels, const size_t pitch);
+void bitgrid_to_argb(const struct bitgrid* const grid, uint32_t* const pixels, const size_t view_width, const size_t view_height, const size_t pitch);
+void bitgrid_to_argb_rect(const struct bitgrid* const grid, uint32_t* const pixels, const size_t x, const size_t y, const size_t width, const size_t height, const size_t pitch);
+void bitgrid_copy_view(struct bitgrid* const dst, const struct bitgrid* const src);
+
+void bitgrid_to_argb_tiles(const struct bitgrid* const grid, uint32_t* const pixels, const size_t view_width, const size_t view_height, const size_t pitch, const struct tile_map* const tiles);
+
+#endif
@@ -0,0 +1,266 @@
+#include "blocking.h"
+#include "cells.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct block_args {
+    const struct cell_blocker* cb;
+    const uint32_t* prev;
+    uint32_t* next;
+    uint64_t* row_hashes;
+    struct census* row_census;
+    size_t generations;
+};
+
+// The cells a tile borrows from the tiles around it, and its size
+struct block {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+    size_t left;
+    size_t right;
+    size_t top;
+    size_t bottom;
+};
+
+// The cells a tile borrows on its left, as many as it needs rounded up to a
+// cache line
+static size_t left_margin(const size_t generations)
+{
+    return ((generations + CELLS_PER_LINE - 1) / CELLS_PER_LINE) * CELLS_PER_LINE;
+}
+
+// Allocates scratch buffers for num_threads threads, the most any pool that
+// steps the grid will have
+bool cell_blocker_create(
+    struct cell_blocker* const cb,
+    const struct cell_kernel* const kernel,
+    const struct grid* const g,
+    const size_t block_size,
+    const size_t generations,
+    const size_t num_threads)
+{
+    memset(cb, 0, sizeof(*cb));
+    cb->kernel = kernel;
+    cb->g = *g;
+    cb->block_size = block_size;
+    cb->generations = generations;
+    cb->tile = grid_init(block_size + left_margin(generations) + generations, block_size + (2 * generations), BOUNDARY_DEAD, &g->rule);
+    cb->tile.lookup_table = g->lookup_table;
+    cb->scratch = calloc(2 * num_threads, sizeof(uint32_t*));
+    cb->scratch_hashes = malloc(num_threads * cb->tile.height * sizeof(uint64_t));
+    cb->scratch_census = malloc(num_threads * block_size * sizeof(struct census));
+    if ((cb->scratch == NULL) || (cb->scratch_hashes == NULL) || (cb->scratch_census == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the tiles.\n");
+        cell_blocker_destroy(cb);
+        return false;
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        cb->num_threads = i + 1;
+        cb->scratch[2 * i] = grid_alloc_cells(&cb->tile);
+        cb->scratch[(2 * i) + 1] = grid_alloc_cells(&cb->tile);
+        if ((cb->scratch[2 * i] == NULL) || (cb->scratch[(2 * i) + 1] == NULL)) {
+            fprintf(stderr, "Error: Failed to allocate memory for the tiles.\n");
+            cell_blocker_destroy(cb);
+            return false;
+        }
+    }
+    return true;
+}
+
+void cell_blocker_destroy(struct cell_blocker* const cb)
+{
+    for (size_t i = 0; (cb->scratch != NULL) && (i < 2 * cb->num_threads); i++) {
+        grid_free_cells(&cb->tile, cb->scratch[i]);
+    }
+    free(cb->scratch);
+    free(cb->scratch_hashes);
+    free(cb->scratch_census);
+    cb->scratch = NULL;
+    cb->scratch_hashes = NULL;
+    cb->scratch_census = NULL;
+    cb->num_threads = 0;
+}
+
+// Kills every cell of a scratch buffer, including the halo rows and
+// padding, which a smaller tile than the one before relies on
+static void clear_scratch(const struct grid* const tile, uint32_t* const cells)
+{
+    uint32_t* const alloc = cells - tile->stride - CELLS_PER_LINE;
+    const size_t num_cells = (tile->stride * (tile->height + 2)) + (2 * CELLS_PER_LINE);
+    for (size_t i = 0; i < num_cells; i++) {
+        alloc[i] = DEAD_CELL;
+    }
+}
+
+// Where i lands on a torus of n rows or columns, even more than n before 0
+static inline size_t wrap_index(const ptrdiff_t i, const size_t n)
+{
+    const ptrdiff_t m = i % (ptrdiff_t)n;
+    return (size_t)((m < 0) ? m + (ptrdiff_t)n : m);
+}
+
+// Copies num_cells cells of a row starting at x, which on a torus can lie
+// to the left of the row or run past its end
+static void copy_wrapped(uint32_t* const dst, const uint32_t* const row, const ptrdiff_t x, const size_t num_cells, const size_t width)
+{
+    size_t start = wrap_index(x, width);
+    size_t done = 0;
+    while (done < num_cells) {
+        const size_t run = (num_cells - done < width - start) ? num_cells - done : width - start;
+        memcpy(dst + done, row + start, run * sizeof(uint32_t));
+        done += run;
+        start = 0;
+    }
+}
+
+static struct block find_block(const struct cell_blocker* const cb, const size_t x, const size_t y, const size_t generations)
+{
+    const struct grid* const g = &cb->g;
+    const bool wrap = g->boundary == BOUNDARY_TORUS;
+    struct block b = {
+        .x = x,
+        .y = y,
+        .width = (g->width - x < cb->block_size) ? g->width - x : cb->block_size,
+        .height = (g->height - y < cb->block_size) ? g->height - y : cb->block_size
+    };
+    // Past a dead boundary there is nothing to borrow
+    b.left = (wrap || (x > 0)) ? left_margin(generations) : 0;
+    b.top = (wrap || (y > generations)) ? generations : y;
+    b.right = (wrap || (g->width - x - b.width > generations)) ? generations : g->width - x - b.width;
+    b.bottom = (wrap || (g->height - y - b.height > generations)) ? generations : g->height - y - b.height;
+    return b;
+}
+
+// Steps one tile generations times in cells, using buf as the other buffer,
+// and stores it into next along with the hashes and census of its rows.
+// Generation i only steps the rows that generation generations needs, which
+// shrink by a row on either side every generation, and the last generation
+// only steps the middle, so its rows are hashed and counted as they are
+// stepped and merely copied into next.
+static void step_block(
+    const struct block_args* const args,
+    const struct block* const b,
+    const struct grid* const tile,
+    uint32_t* cells,
+    uint32_t* buf,
+    uint64_t* const tile_hashes,
+    struct census* const tile_census)
+{
+    const struct cell_blocker* const cb = args->cb;
+    const struct grid* const g = &cb->g;
+    const size_t generations = args->generations;
+    for (size_t y = 0; y < tile->height; y++) {
+        const size_t row = wrap_index((ptrdiff_t)(b->y + y) - (ptrdiff_t)b->top, g->height);
+        copy_wrapped(cells + (y * tile->stride), args->prev + (row * g->stride), (ptrdiff_t)b->x - (ptrdiff_t)b->left, tile->width, g->width);
+    }
+    for (size_t i = 1; i < generations; i++) {
+        if (cb->kernel->update_rows == NULL) {
+            cb->kernel->update(tile, cells, buf, tile_hashes, NULL);
+            continue;
+        }
+        const size_t margin = generations - i;
+        const size_t y_start = (b->top > margin) ? b->top - margin : 0;
+        const size_t y_end = (b->top + b->height + margin < tile->height) ? b->top + b->height + margin : tile->height;
+        cb->kernel->update_rows(tile, cells, buf, y_start, y_end, tile_hashes, NULL);
+        uint32_t* const swap = cells;
+        cells = buf;
+        buf = swap;
+    }
+
+    // The cells around the middle are its halo and ghost cells
+    struct grid middle = *tile;
+    middle.width = b->width;
+    middle.height = b->height;
+    middle.first_row = b->y;
+    middle.first_column = b->x;
+    middle.whole_width = g->width;
+    uint32_t* const from = cells + (b->top * tile->stride) + b->left;
+    uint32_t* const to = buf + (b->top * tile->stride) + b->left;
+    const uint32_t* stepped = to;
+    if (cb->kernel->update_rows == NULL) {
+        cb->kernel->update(&middle, from, to, tile_hashes, tile_census);
+        stepped = from;
+    } else {
+        cb->kernel->update_rows(&middle, from, to, 0, b->height, tile_hashes, tile_census);
+    }
+    for (size_t y = 0; y < b->height; y++) {
+        memcpy(args->next + ((b->y + y) * g->stride) + b->x, stepped + (y * tile->stride), b->width * sizeof(uint32_t));
+        args->row_hashes[b->y + y] += tile_hashes[y];
+        if (args->row_census != NULL) {
+            census_merge(&args->row_census[b->y + y], &tile_census[y]);
+        }
+    }
+}
+
+// Each thread steps whole rows of tiles, left to right, so that it is the
+// only one to add to the hashes of their rows. Threads past those the
+// blocker has buffers for sit the pass out.
+static void step_block_rows(void* const ctx, const size_t index, const size_t num_threads)
+{
+    const struct block_args* const args = ctx;
+    const struct cell_blocker* const cb = args->cb;
+    const struct grid* const g = &cb->g;
+    const size_t num_bands = (num_threads < cb->num_threads) ? num_threads : cb->num_threads;
+    if (index >= num_bands) {
+        return;
+    }
+    const size_t tiles_y = (g->height + cb->block_size - 1) / cb->block_size;
+    const size_t first = (index * tiles_y) / num_bands;
+    const size_t last = ((index + 1) * tiles_y) / num_bands;
+    uint32_t* const cells = cb->scratch[2 * index];
+    uint32_t* const buf = cb->scratch[(2 * index) + 1];
+    uint64_t* const tile_hashes = cb->scratch_hashes + (index * cb->tile.height);
+    struct census* const tile_census = cb->scratch_census + (index * cb->block_size);
+    struct grid tile = cb->tile;
+    tile.width = 0;
+    tile.height = 0;
+    for (size_t ty = first; ty < last; ty++) {
+        const size_t y = ty * cb->block_size;
+        const size_t height = (g->height - y < cb->block_size) ? g->height - y : cb->block_size;
+        memset(args->row_hashes + y, 0, height * sizeof(uint64_t));
+        for (size_t i = 0; (args->row_census != NULL) && (i < height); i++) {
+            census_clear(&args->row_census[y + i]);
+        }
+        for (size_t x = 0; x < g->width; x += cb->block_size) {
+            const struct block b = find_block(cb, x, y, args->generations);
+            const size_t width = b.left + b.width + b.right;
+            const size_t tile_height = b.top + b.height + b.bottom;
+            // The buffers of the last tile of the last pass may not fit
+            // the first tile of this one
+            if ((width != tile.width) || (tile_height != tile.height) || ((x == 0) && (ty == first))) {
+                clear_scratch(&cb->tile, cells);
+                clear_scratch(&cb->tile, buf);
+                tile.width = width;
+                tile.height = tile_height;
+            }
+            step_block(args, &b, &tile, cells, buf, tile_hashes, tile_census);
+        }
+    }
+}
+
+// Steps prev generations generations into next, with generations at most
+// the number the blocker was created for, and leaves the hash and census of
+// each row in row_hashes and row_census, which may be NULL. Works for
+// in-place kernels too, which only leave prev alone here.
+void cell_blocker_step(
+    struct cell_blocker* const cb,
+    struct thread_pool* const pool,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    uint64_t* const row_hashes,
+    struct census* const row_census,
+    const size_t generations)
+{
+    struct block_args args = {
+        .cb = cb,
+        .prev = prev,
+        .next = next,
+        .row_hashes = row_hashes,
+        .row_census = row_census,
+        .generations = (generations < cb->generations) ? generations : cb->generations
+    };
+    pool_run(pool, step_block_rows, &args);
+}
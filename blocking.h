@@ -0,0 +1,45 @@
+#ifndef blocking_h
+#define blocking_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "grid.h"
+#include "kernels.h"
+#include "pool.h"
+
+// Tiles are square and a whole number of hashed words wide
+#define DEFAULT_BLOCK_SIZE     256
+#define BLOCK_SIZE_MULTIPLE    64
+
+// Steps a grid of cells up to generations generations per pass instead of
+// one, so that a grid bigger than the caches is streamed from memory once
+// per pass rather than once per generation. Each tile of block_size by
+// block_size cells is copied with generations more cells on every side into
+// a pair of scratch buffers that stay in cache, stepped there, and only its
+// middle copied back. The cells a tile borrowed from its neighbors go wrong
+// by one more cell from the outside in every generation, for want of the
+// cells past them, so the middle is still exact at the end; rows that can
+// only hold wrong cells are not stepped. The left margin is rounded up to a
+// cache line, so the middle keeps the alignment the SIMD kernels need, and
+// the last generation steps only the middle, as a window of the whole grid
+// that the kernel hashes and counts on the way. Edges of a grid with a dead
+// boundary are the edges of the scratch grid instead. Each thread has its
+// own pair of scratch buffers.
+struct cell_blocker {
+    const struct cell_kernel* kernel;
+    struct grid g;
+    struct grid tile;
+    size_t block_size;
+    size_t generations;
+    size_t num_threads;
+    uint32_t** scratch;
+    uint64_t* scratch_hashes;
+    struct census* scratch_census;
+};
+
+bool cell_blocker_create(struct cell_blocker* const cb, const struct cell_kernel* const kernel, const struct grid* const g, const size_t block_size, const size_t generations, const size_t num_threads);
+void cell_blocker_destroy(struct cell_blocker* const cb);
+void cell_blocker_step(struct cell_blocker* const cb, struct thread_pool* const pool, const uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census, const size_t generations);
+
+#endif
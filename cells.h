@@ -0,0 +1,7 @@
+#ifndef cells_h
+#define cells_h
+
+#define LIVE_CELL 0xFF000000
+#define DEAD_CELL 0xFFFFFFFF
+
+#endif
@@ -0,0 +1,81 @@
+#include "census.h"
+#include "timing.h"
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+static bool has_suffix(const char* const str, const char* const suffix)
+{
+    const size_t len = strlen(str);
+    const size_t suffix_len = strlen(suffix);
+    return (len >= suffix_len) && (strcmp(str + len - suffix_len, suffix) == 0);
+}
+
+// Writes the header, as binary if path ends in .bin and as CSV otherwise
+bool census_log_open(struct census_log* const log, const char* const path, const size_t width, const size_t height)
+{
+    log->path = path;
+    log->binary = has_suffix(path, ".bin");
+    log->failed = false;
+    log->file = fopen(path, log->binary ? "wb" : "w");
+    if (log->file == NULL) {
+        fprintf(stderr, "Error when opening %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (log->binary) {
+        struct census_header header = {
+            .width = width,
+            .height = height
+        };
+        memcpy(header.magic, CENSUS_MAGIC, sizeof(header.magic));
+        log->failed = fwrite(&header, sizeof(header), 1, log->file) != 1;
+    } else {
+        log->failed = fprintf(log->file, "generation,population,births,deaths,x_min,y_min,x_end,y_end\n") < 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &log->last_flush);
+    return true;
+}
+
+// The box columns of an empty generation are left blank in CSV, and zeroed
+// in binary records, as engines leave different empty boxes behind
+void census_log_write(struct census_log* const log, const uint64_t generation, const struct census* const c)
+{
+    if (log->binary) {
+        struct census_record record = {
+            .generation = generation,
+            .census = *c
+        };
+        if (c->population == 0) {
+            record.census.x_min = 0;
+            record.census.y_min = 0;
+            record.census.x_end = 0;
+            record.census.y_end = 0;
+        }
+        log->failed |= fwrite(&record, sizeof(record), 1, log->file) != 1;
+    } else if (c->population == 0) {
+        log->failed |= fprintf(log->file, "%" PRIu64 ",0,%" PRIu64 ",%" PRIu64 ",,,,\n", generation, c->births, c->deaths) < 0;
+    } else {
+        log->failed |= fprintf(log->file, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 "\n",
+                               generation, c->population, c->births, c->deaths,
+                               (int64_t)c->x_min, (int64_t)c->y_min, (int64_t)c->x_end, (int64_t)c->y_end) < 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (get_time_diff_ns(&log->last_flush, &now) >= NS_PER_S) {
+        log->failed |= fflush(log->file) != 0;
+        log->last_flush = now;
+    }
+}
+
+bool census_log_close(struct census_log* const log)
+{
+    bool ok = !log->failed && !ferror(log->file);
+    if (fclose(log->file) != 0) {
+        ok = false;
+    }
+    log->file = NULL;
+    if (!ok) {
+        fprintf(stderr, "Error when writing %s: %s\n", log->path, strerror(errno));
+    }
+    return ok;
+}
@@ -0,0 +1,106 @@
+#ifndef census_h
+#define census_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define CENSUS_MAGIC "GOLCENS1"
+
+// The live cells of a generation, the cells born into it and the cells that
+// died out of it, and the smallest box holding the live cells, from x_min
+// and y_min up to but not including x_end and y_end. An empty generation
+// has an empty box, with x_min past x_end. Engines count 64 cells at a
+// time, as the words of a bitgrid, while they step them, and sum the
+// census of each row or tile the way they sum the hash. Cells of the plane
+// engine can lie left of or above (0, 0), so it counts them CENSUS_ORIGIN
+// further right and down, which keeps them in order as unsigned numbers,
+// and takes CENSUS_ORIGIN off the merged box. Files and the headless
+// summary then show the box as int64_t.
+#define CENSUS_ORIGIN (UINT64_C(1) << 63)
+
+struct census {
+    uint64_t population;
+    uint64_t births;
+    uint64_t deaths;
+    uint64_t x_min;
+    uint64_t y_min;
+    uint64_t x_end;
+    uint64_t y_end;
+};
+
+static inline void census_clear(struct census* const c)
+{
+    c->population = 0;
+    c->births = 0;
+    c->deaths = 0;
+    c->x_min = UINT64_MAX;
+    c->y_min = UINT64_MAX;
+    c->x_end = 0;
+    c->y_end = 0;
+}
+
+// Counts 64 cells starting at x of row y, which were before and are now
+// after. Whether after has live cells is as hard to guess as the cells
+// themselves, so the box is grown with selects rather than a branch.
+static inline void census_add_word(struct census* const c, const uint64_t before, const uint64_t after, const size_t x, const size_t y)
+{
+    c->population += (uint64_t)__builtin_popcountll(after);
+    c->births += (uint64_t)__builtin_popcountll(after & ~before);
+    c->deaths += (uint64_t)__builtin_popcountll(before & ~after);
+    const bool live = after != 0;
+    const uint64_t first = live ? x + (uint64_t)__builtin_ctzll(after | (UINT64_C(1) << 63)) : UINT64_MAX;
+    const uint64_t end = live ? x + 64 - (uint64_t)__builtin_clzll(after | 1) : 0;
+    const uint64_t y_min = live ? y : UINT64_MAX;
+    const uint64_t y_end = live ? y + 1 : 0;
+    c->x_min = (first < c->x_min) ? first : c->x_min;
+    c->x_end = (end > c->x_end) ? end : c->x_end;
+    c->y_min = (y_min < c->y_min) ? y_min : c->y_min;
+    c->y_end = (y_end > c->y_end) ? y_end : c->y_end;
+}
+
+static inline void census_merge(struct census* const c, const struct census* const part)
+{
+    c->population += part->population;
+    c->births += part->births;
+    c->deaths += part->deaths;
+    c->x_min = (part->x_min < c->x_min) ? part->x_min : c->x_min;
+    c->y_min = (part->y_min < c->y_min) ? part->y_min : c->y_min;
+    c->x_end = (part->x_end > c->x_end) ? part->x_end : c->x_end;
+    c->y_end = (part->y_end > c->y_end) ? part->y_end : c->y_end;
+}
+
+// A census of every generation, appended to a file as it is stepped. CSV
+// files have a header line and a line per generation. Binary files, named
+// .bin, have a header and then a census_record per generation, all in
+// native byte order, for runs fast enough that formatting lines would show.
+// The box of an empty generation is left blank in CSV and stored as zeros
+// in binary records, whichever engine counted it. Either way the file is
+// flushed about once a second, so that it can be followed while the run
+// goes on.
+struct census_header {
+    char magic[8];
+    uint64_t width;
+    uint64_t height;
+};
+
+struct census_record {
+    uint64_t generation;
+    struct census census;
+};
+
+struct census_log {
+    FILE* file;
+    const char* path;
+    bool binary;
+    struct timespec last_flush;
+    bool failed;
+};
+
+bool census_log_open(struct census_log* const log, const char* const path, const size_t width, const size_t height);
+void census_log_write(struct census_log* const log, const uint64_t generation, const struct census* const c);
+bool census_log_close(struct census_log* const log);
+
+#endif
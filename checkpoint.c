@@ -0,0 +1,374 @@
+#include "checkpoint.h"
+#include "timing.h"
+#include "fileio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+
+struct word_buffer {
+    uint64_t* words;
+    size_t size;
+    size_t capacity;
+};
+
+static bool buffer_append(struct word_buffer* const buf, const uint64_t* const words, const size_t num_words)
+{
+    if (buf->size + num_words > buf->capacity) {
+        size_t capacity = (buf->capacity == 0) ? 4096 : buf->capacity;
+        while (buf->size + num_words > capacity) {
+            capacity *= 2;
+        }
+        uint64_t* const grown = realloc(buf->words, capacity * sizeof(uint64_t));
+        if (grown == NULL) {
+            return false;
+        }
+        buf->words = grown;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->words + buf->size, words, num_words * sizeof(uint64_t));
+    buf->size += num_words;
+    return true;
+}
+
+// Literal runs end at the next pair of zero words, so a single zero word
+// between live words does not cost a control word of its own
+static bool pack_chunk(const uint64_t* const words, const size_t num_words, struct word_buffer* const out)
+{
+    size_t i = 0;
+    while (i < num_words) {
+        size_t num_zeros = 0;
+        while ((i < num_words) && (words[i] == 0) && (num_zeros < UINT32_MAX)) {
+            num_zeros++;
+            i++;
+        }
+        const size_t start = i;
+        while ((i < num_words) && (i - start < UINT32_MAX)) {
+            if ((words[i] == 0) && ((i + 1 == num_words) || (words[i + 1] == 0))) {
+                break;
+            }
+            i++;
+        }
+        const uint64_t control = ((uint64_t)num_zeros << 32) | (uint64_t)(i - start);
+        if (!buffer_append(out, &control, 1) || !buffer_append(out, words + start, i - start)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool unpack_chunk(const uint64_t* in, const uint64_t* const in_end, uint64_t* const words, const size_t num_words)
+{
+    size_t i = 0;
+    while (in < in_end) {
+        const size_t num_zeros = (size_t)(*in >> 32);
+        const size_t num_literals = (size_t)(*in & UINT32_MAX);
+        in++;
+        if ((num_zeros > num_words - i) || (num_literals > num_words - i - num_zeros) || (num_literals > (size_t)(in_end - in))) {
+            return false;
+        }
+        memset(words + i, 0, num_zeros * sizeof(uint64_t));
+        i += num_zeros;
+        memcpy(words + i, in, num_literals * sizeof(uint64_t));
+        i += num_literals;
+        in += num_literals;
+    }
+    return i == num_words;
+}
+
+static bool write_snapshot(struct checkpoint_writer* const writer)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const struct bitgrid* const grid = &writer->pending;
+    struct checkpoint_header header = {
+        .width = grid->width,
+        .height = grid->height,
+        .generation = writer->pending_generation,
+        .boundary = (uint32_t)grid->boundary,
+        .rows_per_chunk = CHECKPOINT_ROWS_PER_CHUNK,
+        .num_chunks = (grid->height + CHECKPOINT_ROWS_PER_CHUNK - 1) / CHECKPOINT_ROWS_PER_CHUNK
+    };
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    format_rule(&grid->rule, header.rule, sizeof(header.rule));
+
+    bool ok = false;
+    struct word_buffer chunks = {0};
+    uint64_t* const offsets = malloc((header.num_chunks + 1) * sizeof(uint64_t));
+    char* const tmp_path = malloc(strlen(writer->path) + sizeof(".tmp"));
+    if ((offsets == NULL) || (tmp_path == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for a checkpoint.\n");
+        goto free_buffers;
+    }
+    for (size_t c = 0; c < header.num_chunks; c++) {
+        const size_t y_start = c * CHECKPOINT_ROWS_PER_CHUNK;
+        const size_t y_end = (y_start + CHECKPOINT_ROWS_PER_CHUNK < grid->height) ? y_start + CHECKPOINT_ROWS_PER_CHUNK : grid->height;
+        offsets[c] = chunks.size * sizeof(uint64_t);
+        if (!pack_chunk(grid->words + (y_start * grid->words_per_row), (y_end - y_start) * grid->words_per_row, &chunks)) {
+            fprintf(stderr, "Error: Failed to allocate memory for a checkpoint.\n");
+            goto free_buffers;
+        }
+    }
+    offsets[header.num_chunks] = chunks.size * sizeof(uint64_t);
+
+    sprintf(tmp_path, "%s.tmp", writer->path);
+    const int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Error when opening %s: %s\n", tmp_path, strerror(errno));
+        goto free_buffers;
+    }
+    ok = write_all(fd, &header, sizeof(header))
+      && write_all(fd, offsets, (header.num_chunks + 1) * sizeof(uint64_t))
+      && write_all(fd, chunks.words, chunks.size * sizeof(uint64_t))
+      && (fsync(fd) == 0);
+    if (!ok) {
+        fprintf(stderr, "Error when writing %s: %s\n", tmp_path, strerror(errno));
+    }
+    close(fd);
+    if (ok && (rename(tmp_path, writer->path) == -1)) {
+        fprintf(stderr, "Error when renaming %s: %s\n", tmp_path, strerror(errno));
+        ok = false;
+    }
+
+    if (ok) {
+        struct timespec stop;
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        writer->last_num_bytes = sizeof(header) + ((header.num_chunks + 1) * sizeof(uint64_t)) + (chunks.size * sizeof(uint64_t));
+        writer->last_elapsed_ns = get_time_diff_ns(&start, &stop);
+    }
+
+free_buffers:
+    free(chunks.words);
+    free(offsets);
+    free(tmp_path);
+    return ok;
+}
+
+static void* writer_main(void* const arg)
+{
+    struct checkpoint_writer* const writer = arg;
+    pthread_mutex_lock(&writer->mutex);
+    for (;;) {
+        while (!writer->has_job && !writer->quit) {
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        }
+        if (!writer->has_job) {
+            break;
+        }
+        // Submitters leave the pending snapshot alone while has_job is set
+        pthread_mutex_unlock(&writer->mutex);
+        const bool ok = write_snapshot(writer);
+        pthread_mutex_lock(&writer->mutex);
+        writer->num_written += ok;
+        writer->has_job = false;
+        pthread_cond_broadcast(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
+}
+
+bool checkpoint_writer_start(
+    struct checkpoint_writer* const writer,
+    const char* const path,
+    const size_t width,
+    const size_t height,
+    const enum boundary boundary,
+    const struct rule* const rule)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->path = path;
+    writer->pending = bitgrid_create(width, height, boundary, rule);
+    if (writer->pending.words == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for checkpoints.\n");
+        return false;
+    }
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    const int err = pthread_create(&writer->thread, NULL, writer_main, writer);
+    if (err != 0) {
+        fprintf(stderr, "Error when creating the checkpoint thread: %s\n", strerror(err));
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->mutex);
+        bitgrid_destroy(&writer->pending);
+        return false;
+    }
+    return true;
+}
+
+// Copies the grid for the writer thread. Returns false without copying if
+// the previous snapshot is still being written, unless wait is set.
+bool checkpoint_writer_submit(
+    struct checkpoint_writer* const writer,
+    const struct bitgrid* const grid,
+    const uint64_t generation,
+    const bool wait)
+{
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->has_job && !wait) {
+        writer->num_skipped++;
+        pthread_mutex_unlock(&writer->mutex);
+        return false;
+    }
+    while (writer->has_job) {
+        pthread_cond_wait(&writer->cond, &writer->mutex);
+    }
+    memcpy(writer->pending.words, grid->words, grid->words_per_row * grid->height * sizeof(uint64_t));
+    writer->pending_generation = generation;
+    writer->has_job = true;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    return true;
+}
+
+// Finishes the snapshot being written, if any
+void checkpoint_writer_stop(struct checkpoint_writer* const writer)
+{
+    pthread_mutex_lock(&writer->mutex);
+    writer->quit = true;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    bitgrid_destroy(&writer->pending);
+}
+
+bool checkpoint_open(struct checkpoint* const cp, const char* const path)
+{
+    memset(cp, 0, sizeof(*cp));
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Error when opening %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "Error when reading %s: %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    const size_t size = (size_t)st.st_size;
+    if (size < sizeof(struct checkpoint_header)) {
+        fprintf(stderr, "Error: %s is not a checkpoint\n", path);
+        close(fd);
+        return false;
+    }
+    void* const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error when mapping %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    cp->map = map;
+    cp->map_size = size;
+    cp->header = map;
+
+    const struct checkpoint_header* const header = cp->header;
+    const size_t expected_chunks = (header->height + CHECKPOINT_ROWS_PER_CHUNK - 1) / CHECKPOINT_ROWS_PER_CHUNK;
+    const size_t table_bytes = (expected_chunks + 1) * sizeof(uint64_t);
+    if ((memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0)
+        || (header->width == 0) || (header->width > MAX_GRID_SIDE)
+        || (header->height == 0) || (header->height > MAX_GRID_SIDE)
+        || (header->boundary > BOUNDARY_TORUS)
+        || (header->rows_per_chunk != CHECKPOINT_ROWS_PER_CHUNK)
+        || (header->num_chunks != expected_chunks)
+        || (size - sizeof(*header) < table_bytes)
+        || (memchr(header->rule, '\0', sizeof(header->rule)) == NULL)) {
+        fprintf(stderr, "Error: %s is not a valid checkpoint\n", path);
+        checkpoint_close(cp);
+        return false;
+    }
+    cp->offsets = (const uint64_t*)(header + 1);
+    cp->chunks = (const uint8_t*)(cp->offsets + header->num_chunks + 1);
+    // Chunks are whole words, and the last offset is the end of the file, so
+    // a file that ends partway through a word cannot be valid
+    const size_t chunk_bytes = size - sizeof(*header) - table_bytes;
+    if (chunk_bytes % sizeof(uint64_t) != 0) {
+        fprintf(stderr, "Error: %s is not a valid checkpoint\n", path);
+        checkpoint_close(cp);
+        return false;
+    }
+    for (size_t c = 0; c < header->num_chunks; c++) {
+        if ((cp->offsets[c] > cp->offsets[c + 1]) || (cp->offsets[c] % sizeof(uint64_t) != 0)) {
+            fprintf(stderr, "Error: %s is not a valid checkpoint\n", path);
+            checkpoint_close(cp);
+            return false;
+        }
+    }
+    if (cp->offsets[header->num_chunks] != chunk_bytes) {
+        fprintf(stderr, "Error: %s is truncated\n", path);
+        checkpoint_close(cp);
+        return false;
+    }
+    if (!parse_rule(header->rule, &cp->rule)) {
+        fprintf(stderr, "Error: %s is for the unsupported rule %s\n", path, header->rule);
+        checkpoint_close(cp);
+        return false;
+    }
+    return true;
+}
+
+void checkpoint_close(struct checkpoint* const cp)
+{
+    if (cp->map != NULL) {
+        munmap(cp->map, cp->map_size);
+    }
+    memset(cp, 0, sizeof(*cp));
+}
+
+struct unpack_job {
+    const struct checkpoint* cp;
+    struct bitgrid* grid;
+    bool* failed;
+};
+
+static void unpack_chunks(void* const ctx, const size_t index, const size_t num_threads)
+{
+    const struct unpack_job* const job = ctx;
+    const struct checkpoint_header* const header = job->cp->header;
+    const struct bitgrid* const grid = job->grid;
+    for (size_t c = index; c < header->num_chunks; c += num_threads) {
+        const size_t y_start = c * CHECKPOINT_ROWS_PER_CHUNK;
+        const size_t y_end = (y_start + CHECKPOINT_ROWS_PER_CHUNK < grid->height) ? y_start + CHECKPOINT_ROWS_PER_CHUNK : grid->height;
+        const uint64_t* const in = (const uint64_t*)(job->cp->chunks + job->cp->offsets[c]);
+        const uint64_t* const in_end = (const uint64_t*)(job->cp->chunks + job->cp->offsets[c + 1]);
+        if (!unpack_chunk(in, in_end, grid->words + (y_start * grid->words_per_row), (y_end - y_start) * grid->words_per_row)) {
+            job->failed[index] = true;
+        }
+    }
+}
+
+// The grid must have the dimensions in the header. Chunks are spread over
+// the threads of the pool.
+bool checkpoint_unpack(struct thread_pool* const pool, const struct checkpoint* const cp, struct bitgrid* const grid)
+{
+    bool* const failed = calloc(pool->num_threads, sizeof(bool));
+    if (failed == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for a checkpoint.\n");
+        return false;
+    }
+    struct unpack_job job = {
+        .cp = cp,
+        .grid = grid,
+        .failed = failed
+    };
+    pool_run(pool, unpack_chunks, &job);
+    bool ok = true;
+    for (size_t i = 0; i < pool->num_threads; i++) {
+        ok = ok && !failed[i];
+    }
+    free(failed);
+    if (!ok) {
+        fprintf(stderr, "Error: The checkpoint is corrupt\n");
+        return false;
+    }
+    bitgrid_clear_padding(grid);
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef checkpoint_h
+#define checkpoint_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "bitgrid.h"
+#include "pool.h"
+
+#define CHECKPOINT_MAGIC          "GOLSNAP1"
+#define CHECKPOINT_RULE_SIZE      32
+#define CHECKPOINT_ROWS_PER_CHUNK 64
+
+// A snapshot file is this header, then num_chunks + 1 byte offsets of the
+// chunks relative to the end of the offset table, then the chunks. Each chunk
+// holds CHECKPOINT_ROWS_PER_CHUNK rows of the bitgrid as a stream of 64-bit
+// words: a control word with a count of zero words in its high half and a
+// count of literal words in its low half, followed by the literal words.
+// Chunks are independent so that they can be unpacked in parallel. All
+// fields are in native byte order.
+struct checkpoint_header {
+    char magic[8];
+    uint64_t width;
+    uint64_t height;
+    uint64_t generation;
+    uint32_t boundary;
+    uint32_t rows_per_chunk;
+    uint64_t num_chunks;
+    char rule[CHECKPOINT_RULE_SIZE];
+};
+
+// Writes snapshots on a background thread. A snapshot is a copy of one
+// generation taken on the stepping thread, which is skipped rather than
+// waited for while the previous snapshot is still being written. Each file
+// is written next to the destination and renamed over it once complete.
+struct checkpoint_writer {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    const char* path;
+    struct bitgrid pending;
+    uint64_t pending_generation;
+    bool has_job;
+    bool quit;
+    size_t num_written;
+    size_t num_skipped;
+    size_t last_num_bytes;
+    int64_t last_elapsed_ns;
+};
+
+// A snapshot file mapped into memory, and the rule named in its header
+struct checkpoint {
+    const struct checkpoint_header* header;
+    struct rule rule;
+    const uint64_t* offsets;
+    const uint8_t* chunks;
+    void* map;
+    size_t map_size;
+};
+
+bool checkpoint_writer_start(struct checkpoint_writer* const writer, const char* const path, const size_t width, const size_t height, const enum boundary boundary, const struct rule* const rule);
+bool checkpoint_writer_submit(struct checkpoint_writer* const writer, const struct bitgrid* const grid, const uint64_t generation, const bool wait);
+void checkpoint_writer_stop(struct checkpoint_writer* const writer);
+
+bool checkpoint_open(struct checkpoint* const cp, const char* const path);
+void checkpoint_close(struct checkpoint* const cp);
+bool checkpoint_unpack(struct thread_pool* const pool, const struct checkpoint* const cp, struct bitgrid* const grid);
+
+#endif
@@ -0,0 +1,49 @@
+#include "cycle.h"
+#include <string.h>
+
+void cycle_detector_reset(struct cycle_detector* const d)
+{
+    d->count = 0;
+    d->period = 0;
+    d->matched = 0;
+}
+
+// Adds the hash of the next generation. Returns the period of the cycle the
+// grid is in, 1 for a still life, or 0 if it is not known to be in one yet.
+size_t cycle_detector_push(struct cycle_detector* const d, const uint64_t hash)
+{
+    if ((d->period > 0) && (d->hashes[(d->count - d->period) % CYCLE_HISTORY] == hash)) {
+        d->matched++;
+    } else {
+        // The closest match is the shortest period
+        d->period = 0;
+        d->matched = 0;
+        const uint64_t max_period = (d->count < CYCLE_HISTORY) ? d->count : CYCLE_HISTORY - 1;
+        for (size_t p = 1; p <= max_period; p++) {
+            if (d->hashes[(d->count - p) % CYCLE_HISTORY] == hash) {
+                d->period = p;
+                d->matched = 1;
+                break;
+            }
+        }
+    }
+    d->hashes[d->count % CYCLE_HISTORY] = hash;
+    d->count++;
+    return ((d->period > 0) && (d->matched >= d->period)) ? d->period : 0;
+}
+
+bool parse_cycle_action(const char* const str, enum cycle_action* const action)
+{
+    if (strcmp(str, "none") == 0) {
+        *action = CYCLE_NONE;
+    } else if (strcmp(str, "report") == 0) {
+        *action = CYCLE_REPORT;
+    } else if (strcmp(str, "stop") == 0) {
+        *action = CYCLE_STOP;
+    } else if (strcmp(str, "jump") == 0) {
+        *action = CYCLE_JUMP;
+    } else {
+        return false;
+    }
+    return true;
+}
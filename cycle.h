@@ -0,0 +1,35 @@
+#ifndef cycle_h
+#define cycle_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Periods up to CYCLE_HISTORY - 1 generations are detected
+#define CYCLE_HISTORY 256
+
+enum cycle_action {
+    CYCLE_NONE,
+    CYCLE_REPORT,
+    CYCLE_STOP,
+    CYCLE_JUMP
+};
+
+// The hashes of the last CYCLE_HISTORY generations, one per generation.
+// period is the distance back to the last generation with the same hash
+// as the newest one, and matched the number of generations in a row that
+// have had the same hash as the one period before them. Once a whole
+// period has repeated, the grid is in a cycle, barring a hash collision
+// that would have to repeat period times over.
+struct cycle_detector {
+    uint64_t hashes[CYCLE_HISTORY];
+    uint64_t count;
+    size_t period;
+    size_t matched;
+};
+
+void cycle_detector_reset(struct cycle_detector* const d);
+size_t cycle_detector_push(struct cycle_detector* const d, const uint64_t hash);
+bool parse_cycle_action(const char* const str, enum cycle_action* const action);
+
+#endif
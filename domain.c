@@ -0,0 +1,619 @@
+#include "domain.h"
+#include "timing.h"
+#include "fileio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+
+// A worker that is waiting for a ring spins this many times before it
+// starts yielding the CPU, as workers may outnumber CPUs
+#define SPINS_BEFORE_YIELD 64
+
+enum domain_command_type {
+    DOMAIN_STEP,
+    DOMAIN_FRAME,
+    DOMAIN_QUIT
+};
+
+struct domain_command {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t count;
+};
+
+struct domain_reply {
+    uint64_t generation;
+    uint64_t hash;
+    int64_t step_ns;
+    int64_t wait_ns;
+};
+
+// head and tail count the rows written and read, and each is only written
+// by one process, from a cache line of its own. DOMAIN_RING_SLOTS rows of
+// stride cells follow.
+struct halo_ring {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t head;
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t tail;
+};
+
+// The rows a worker sends to and receives from the worker above or below
+// it, if there is one
+struct halo_link {
+    bool present;
+    struct halo_ring* out;
+    struct halo_ring* in;
+    int fd;
+};
+
+struct worker {
+    struct grid g;
+    const struct cell_kernel* kernel;
+    enum transport transport;
+    struct thread_pool pool;
+    uint32_t* cells[2];
+    size_t current;
+    uint64_t* row_hashes;
+    struct halo_link up;
+    struct halo_link down;
+    int control_fd;
+    struct bitgrid frame;
+    bool frame_shared;
+    uint64_t generation;
+};
+
+struct transfer {
+    int fd;
+    uint8_t* data;
+    size_t size;
+    size_t done;
+    bool sending;
+};
+
+static inline void spin(unsigned int* const spins)
+{
+    if (++*spins > SPINS_BEFORE_YIELD) {
+        sched_yield();
+    }
+}
+
+static inline size_t ring_bytes(const struct grid* const g)
+{
+    return sizeof(struct halo_ring) + (DOMAIN_RING_SLOTS * g->stride * sizeof(uint32_t));
+}
+
+static inline uint32_t* ring_row(struct halo_ring* const ring, const uint64_t count, const size_t stride)
+{
+    return (uint32_t*)(ring + 1) + ((count % DOMAIN_RING_SLOTS) * stride);
+}
+
+static void ring_send(struct halo_ring* const ring, const uint32_t* const row, const struct grid* const g)
+{
+    const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int spins = 0;
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == DOMAIN_RING_SLOTS) {
+        spin(&spins);
+    }
+    memcpy(ring_row(ring, head, g->stride), row, g->width * sizeof(uint32_t));
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static void ring_receive(struct halo_ring* const ring, uint32_t* const row, const struct grid* const g)
+{
+    const uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int spins = 0;
+    while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+        spin(&spins);
+    }
+    memcpy(row, ring_row(ring, tail, g->stride), g->width * sizeof(uint32_t));
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// Moves every transfer along as its socket allows, so that neither side of
+// a socket waits on the other for buffer space
+static bool run_transfers(struct transfer* const transfers, const size_t num_transfers)
+{
+    for (;;) {
+        struct pollfd fds[4];
+        struct transfer* pending[4];
+        nfds_t n = 0;
+        for (size_t i = 0; i < num_transfers; i++) {
+            if (transfers[i].done < transfers[i].size) {
+                fds[n].fd = transfers[i].fd;
+                fds[n].events = transfers[i].sending ? POLLOUT : POLLIN;
+                fds[n].revents = 0;
+                pending[n] = &transfers[i];
+                n++;
+            }
+        }
+        if (n == 0) {
+            return true;
+        }
+        if (poll(fds, n, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        for (nfds_t i = 0; i < n; i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            struct transfer* const t = pending[i];
+            const ssize_t num_bytes = t->sending
+                ? send(t->fd, t->data + t->done, t->size - t->done, MSG_DONTWAIT | SEND_FLAGS)
+                : recv(t->fd, t->data + t->done, t->size - t->done, MSG_DONTWAIT);
+            if (num_bytes > 0) {
+                t->done += (size_t)num_bytes;
+            } else if ((num_bytes == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+                return false;
+            }
+        }
+    }
+}
+
+// Sends the first and last rows of the slab to the workers above and below
+// and receives theirs into the halo rows
+static bool exchange_halos(struct worker* const w)
+{
+    const struct grid* const g = &w->g;
+    uint32_t* const cells = w->cells[w->current];
+    uint32_t* const first = cells;
+    uint32_t* const last = cells + ((g->height - 1) * g->stride);
+    uint32_t* const above = cells - g->stride;
+    uint32_t* const below = cells + (g->height * g->stride);
+    if (w->transport == TRANSPORT_SHM) {
+        if (w->up.present) {
+            ring_send(w->up.out, first, g);
+        }
+        if (w->down.present) {
+            ring_send(w->down.out, last, g);
+        }
+        if (w->up.present) {
+            ring_receive(w->up.in, above, g);
+        }
+        if (w->down.present) {
+            ring_receive(w->down.in, below, g);
+        }
+        return true;
+    }
+    const size_t row_bytes = g->width * sizeof(uint32_t);
+    struct transfer transfers[4];
+    size_t n = 0;
+    if (w->up.present) {
+        transfers[n++] = (struct transfer){w->up.fd, (uint8_t*)first, row_bytes, 0, true};
+        transfers[n++] = (struct transfer){w->up.fd, (uint8_t*)above, row_bytes, 0, false};
+    }
+    if (w->down.present) {
+        transfers[n++] = (struct transfer){w->down.fd, (uint8_t*)last, row_bytes, 0, true};
+        transfers[n++] = (struct transfer){w->down.fd, (uint8_t*)below, row_bytes, 0, false};
+    }
+    return run_transfers(transfers, n);
+}
+
+static bool worker_step(struct worker* const w, struct domain_reply* const reply)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!exchange_halos(w)) {
+        return false;
+    }
+    grid_refresh_ghost_columns(&w->g, w->cells[w->current]);
+    struct timespec exchanged;
+    clock_gettime(CLOCK_MONOTONIC, &exchanged);
+    update_cells_parallel(&w->pool, w->kernel, &w->g, w->cells[w->current], w->cells[1 - w->current], w->row_hashes, NULL);
+    if (!w->kernel->in_place) {
+        w->current = 1 - w->current;
+    }
+    w->generation++;
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    reply->wait_ns += get_time_diff_ns(&start, &exchanged);
+    reply->step_ns += get_time_diff_ns(&exchanged, &stop);
+    return true;
+}
+
+// Serves commands until told to quit or the coordinator goes away
+static int worker_main(struct worker* const w)
+{
+    for (;;) {
+        struct domain_command command;
+        if (!read_all(w->control_fd, &command, sizeof(command))) {
+            return EXIT_FAILURE;
+        }
+        struct domain_reply reply = {0};
+        switch ((enum domain_command_type)command.type) {
+        case DOMAIN_STEP:
+            for (uint64_t i = 0; i < command.count; i++) {
+                if (!worker_step(w, &reply)) {
+                    fprintf(stderr, "Error: A worker lost its neighbor.\n");
+                    return EXIT_FAILURE;
+                }
+            }
+            break;
+        case DOMAIN_FRAME:
+            bitgrid_from_argb(&w->frame, w->cells[w->current], w->g.stride);
+            break;
+        case DOMAIN_QUIT:
+            return EXIT_SUCCESS;
+        }
+        reply.generation = w->generation;
+        for (size_t y = 0; y < w->g.height; y++) {
+            reply.hash += w->row_hashes[y];
+        }
+        if (!send_all(w->control_fd, &reply, sizeof(reply))) {
+            return EXIT_FAILURE;
+        }
+        if ((command.type == DOMAIN_FRAME) && !w->frame_shared
+            && !send_all(w->control_fd, w->frame.words, w->frame.words_per_row * w->frame.height * sizeof(uint64_t))) {
+            return EXIT_FAILURE;
+        }
+    }
+}
+
+struct worker_fds {
+    int control;
+    int up;
+    int down;
+};
+
+// Runs in the forked worker process. Its slab is expanded from the start
+// grid, which the fork left it a copy of. d only counts the workers forked
+// before it.
+static int run_worker(
+    const struct domain* const d,
+    const size_t index,
+    const size_t num_workers,
+    const struct cell_kernel* const kernel,
+    const size_t num_threads,
+    const struct bitgrid* const start,
+    const struct worker_fds* const fds)
+{
+    const struct domain_worker* const dw = &d->workers[index];
+    const size_t n = num_workers;
+    const bool wrap = d->g.boundary == BOUNDARY_TORUS;
+    struct worker w = {
+        .g = grid_init(d->g.width, dw->y_end - dw->y_start, d->g.boundary, &d->g.rule),
+        .kernel = kernel,
+        .transport = d->transport,
+        .control_fd = fds->control,
+        .generation = d->generation,
+        .up = {.present = wrap || (index > 0), .fd = fds->up},
+        .down = {.present = wrap || (index + 1 < n), .fd = fds->down}
+    };
+    w.g.first_row = dw->y_start;
+    if (d->transport == TRANSPORT_SHM) {
+        uint8_t* const rings = d->shared;
+        const size_t bytes = ring_bytes(&d->g);
+        w.down.out = (struct halo_ring*)(rings + ((2 * index) * bytes));
+        w.up.out = (struct halo_ring*)(rings + (((2 * index) + 1) * bytes));
+        w.up.in = (struct halo_ring*)(rings + ((2 * ((index + n - 1) % n)) * bytes));
+        w.down.in = (struct halo_ring*)(rings + (((2 * ((index + 1) % n)) + 1) * bytes));
+        w.frame = d->frame;
+        w.frame.words += dw->y_start * d->frame.words_per_row;
+        w.frame.height = w.g.height;
+        w.frame_shared = true;
+    } else {
+        w.frame = bitgrid_create(w.g.width, w.g.height, w.g.boundary, &w.g.rule);
+    }
+
+    int status = EXIT_FAILURE;
+    if (!cell_kernel_prepare(kernel, &w.g)) {
+        goto free_frame;
+    }
+    if (!pool_create(&w.pool, num_threads)) {
+        cell_kernel_release(&w.g);
+        goto free_frame;
+    }
+    w.cells[0] = grid_alloc_cells(&w.g);
+    w.cells[1] = grid_alloc_cells(&w.g);
+    w.row_hashes = calloc(w.g.height, sizeof(uint64_t));
+    if ((w.cells[0] == NULL) || (w.cells[1] == NULL) || (w.row_hashes == NULL) || (w.frame.words == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for worker %zu.\n", index);
+    } else {
+        bitgrid_to_argb_rect(start, w.cells[0], 0, dw->y_start, w.g.width, w.g.height, w.g.stride);
+        status = worker_main(&w);
+    }
+    grid_free_cells(&w.g, w.cells[0]);
+    grid_free_cells(&w.g, w.cells[1]);
+    free(w.row_hashes);
+    pool_destroy(&w.pool);
+    cell_kernel_release(&w.g);
+free_frame:
+    if (!w.frame_shared) {
+        bitgrid_destroy(&w.frame);
+    }
+    return status;
+}
+
+// The object is unlinked as soon as it is mapped; the workers inherit the
+// mapping when they are forked
+static void* map_shared(const size_t size)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/game_of_life.%ld", (long)getpid());
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        fprintf(stderr, "Error when creating shared memory %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    shm_unlink(name);
+    if (ftruncate(fd, (off_t)size) == -1) {
+        fprintf(stderr, "Error when sizing shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    void* const map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error when mapping shared memory %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    return map;
+}
+
+static void close_fds(int* const fds, const size_t num_fds)
+{
+    for (size_t i = 0; i < num_fds; i++) {
+        if (fds[i] != -1) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+// Forks num_workers processes, each with a slab of about the same number
+// of rows of start, which has the dimensions of g, and threads_per_worker
+// threads to step it with. With sockets, pair k of halo_fds connects the
+// bottom of worker k to the top of the worker below it.
+bool domain_start(
+    struct domain* const d,
+    const struct grid* const g,
+    const struct cell_kernel* const kernel,
+    const size_t num_workers,
+    const size_t threads_per_worker,
+    const enum transport transport,
+    const struct bitgrid* const start,
+    const uint64_t generation)
+{
+    memset(d, 0, sizeof(*d));
+    d->g = *g;
+    d->transport = transport;
+    d->generation = generation;
+    if (num_workers > g->height) {
+        fprintf(stderr, "Error: %zu workers need a grid at least %zu rows tall.\n", num_workers, num_workers);
+        return false;
+    }
+    const size_t words_per_row = (g->width + 63) / 64;
+    const size_t num_pairs = (g->boundary == BOUNDARY_TORUS) ? num_workers : num_workers - 1;
+    d->workers = calloc(num_workers, sizeof(struct domain_worker));
+    int* const control_fds = malloc(2 * num_workers * sizeof(int));
+    int* const halo_fds = malloc((2 * num_pairs + 1) * sizeof(int));
+    if ((d->workers == NULL) || (control_fds == NULL) || (halo_fds == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the workers.\n");
+        free(d->workers);
+        free(control_fds);
+        free(halo_fds);
+        d->workers = NULL;
+        return false;
+    }
+    for (size_t i = 0; i < 2 * num_workers; i++) {
+        control_fds[i] = -1;
+    }
+    for (size_t i = 0; i < 2 * num_pairs; i++) {
+        halo_fds[i] = -1;
+    }
+
+    if (transport == TRANSPORT_SHM) {
+        const size_t rings_size = 2 * num_workers * ring_bytes(g);
+        d->shared_size = rings_size + (words_per_row * g->height * sizeof(uint64_t));
+        d->shared = map_shared(d->shared_size);
+        if (d->shared == NULL) {
+            goto fail;
+        }
+        for (size_t i = 0; i < 2 * num_workers; i++) {
+            struct halo_ring* const ring = (struct halo_ring*)((uint8_t*)d->shared + (i * ring_bytes(g)));
+            atomic_init(&ring->head, 0);
+            atomic_init(&ring->tail, 0);
+        }
+        d->frame = (struct bitgrid){
+            .words = (uint64_t*)((uint8_t*)d->shared + rings_size),
+            .width = g->width,
+            .height = g->height,
+            .words_per_row = words_per_row,
+            .boundary = g->boundary,
+            .rule = g->rule
+        };
+    } else {
+        d->frame = bitgrid_create(g->width, g->height, g->boundary, &g->rule);
+        if (d->frame.words == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for the frame.\n");
+            goto fail;
+        }
+        for (size_t k = 0; k < num_pairs; k++) {
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, halo_fds + (2 * k)) == -1) {
+                fprintf(stderr, "Error when creating a halo socket: %s\n", strerror(errno));
+                goto fail;
+            }
+        }
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, control_fds + (2 * i)) == -1) {
+            fprintf(stderr, "Error when creating a control socket: %s\n", strerror(errno));
+            goto fail;
+        }
+        d->workers[i].control_fd = -1;
+        d->workers[i].y_start = (i * g->height) / num_workers;
+        d->workers[i].y_end = ((i + 1) * g->height) / num_workers;
+    }
+
+    // Buffered output would otherwise be written again by every worker
+    fflush(stdout);
+    fflush(stderr);
+    for (size_t i = 0; i < num_workers; i++) {
+        const pid_t pid = fork();
+        if (pid == -1) {
+            fprintf(stderr, "Error when starting worker %zu: %s\n", i, strerror(errno));
+            goto fail;
+        }
+        if (pid == 0) {
+            // Each worker keeps its end of its control socket and the halo
+            // sockets of its own top and bottom rows, and none of the
+            // coordinator's ends, so that it sees the coordinator go away
+            struct worker_fds fds = {
+                .control = control_fds[(2 * i) + 1],
+                .up = -1,
+                .down = -1
+            };
+            control_fds[(2 * i) + 1] = -1;
+            const size_t above = (i + num_workers - 1) % num_workers;
+            if ((transport == TRANSPORT_SOCKET) && (i < num_pairs)) {
+                fds.down = halo_fds[2 * i];
+                halo_fds[2 * i] = -1;
+            }
+            if ((transport == TRANSPORT_SOCKET) && (above < num_pairs)) {
+                fds.up = halo_fds[(2 * above) + 1];
+                halo_fds[(2 * above) + 1] = -1;
+            }
+            close_fds(control_fds, 2 * num_workers);
+            close_fds(halo_fds, 2 * num_pairs);
+            for (size_t j = 0; j < i; j++) {
+                close(d->workers[j].control_fd);
+            }
+            _exit(run_worker(d, i, num_workers, kernel, threads_per_worker, start, &fds));
+        }
+        d->workers[i].pid = pid;
+        d->workers[i].control_fd = control_fds[2 * i];
+        control_fds[2 * i] = -1;
+        d->num_workers = i + 1;
+    }
+    close_fds(control_fds, 2 * num_workers);
+    close_fds(halo_fds, 2 * num_pairs);
+    free(control_fds);
+    free(halo_fds);
+    return true;
+
+fail:
+    close_fds(control_fds, 2 * num_workers);
+    close_fds(halo_fds, 2 * num_pairs);
+    free(control_fds);
+    free(halo_fds);
+    d->failed = true;
+    domain_stop(d);
+    return false;
+}
+
+static bool send_command(struct domain* const d, const enum domain_command_type type, const uint64_t count)
+{
+    const struct domain_command command = {
+        .type = (uint32_t)type,
+        .count = count
+    };
+    for (size_t i = 0; i < d->num_workers; i++) {
+        if (!send_all(d->workers[i].control_fd, &command, sizeof(command))) {
+            fprintf(stderr, "Error: Worker %zu has stopped.\n", i);
+            d->failed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Waits for every worker to finish the command, and with sockets, reads
+// the rows of the frame that follow each reply
+static bool collect_replies(struct domain* const d, const bool frame)
+{
+    d->hash = 0;
+    d->step_ns = 0;
+    d->wait_ns = 0;
+    for (size_t i = 0; i < d->num_workers; i++) {
+        const struct domain_worker* const dw = &d->workers[i];
+        struct domain_reply reply;
+        bool ok = read_all(dw->control_fd, &reply, sizeof(reply));
+        if (ok && frame && (d->transport == TRANSPORT_SOCKET)) {
+            const size_t words_per_row = d->frame.words_per_row;
+            ok = read_all(dw->control_fd,
+                          d->frame.words + (dw->y_start * words_per_row),
+                          (dw->y_end - dw->y_start) * words_per_row * sizeof(uint64_t));
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Worker %zu has stopped.\n", i);
+            d->failed = true;
+            return false;
+        }
+        d->generation = reply.generation;
+        d->hash += reply.hash;
+        d->step_ns = (reply.step_ns > d->step_ns) ? reply.step_ns : d->step_ns;
+        d->wait_ns = (reply.wait_ns > d->wait_ns) ? reply.wait_ns : d->wait_ns;
+    }
+    return true;
+}
+
+bool domain_step(struct domain* const d, const uint64_t generations)
+{
+    return !d->failed && send_command(d, DOMAIN_STEP, generations) && collect_replies(d, false);
+}
+
+// Fills frame with the current generation
+bool domain_gather(struct domain* const d)
+{
+    return !d->failed && send_command(d, DOMAIN_FRAME, 0) && collect_replies(d, true);
+}
+
+// Workers that may be stuck waiting for a neighbor that is gone are killed
+// rather than told to quit
+void domain_stop(struct domain* const d)
+{
+    if (!d->failed) {
+        send_command(d, DOMAIN_QUIT, 0);
+    }
+    for (size_t i = 0; i < d->num_workers; i++) {
+        if (d->failed) {
+            kill(d->workers[i].pid, SIGKILL);
+        }
+        close(d->workers[i].control_fd);
+    }
+    for (size_t i = 0; i < d->num_workers; i++) {
+        while ((waitpid(d->workers[i].pid, NULL, 0) == -1) && (errno == EINTR)) {
+        }
+    }
+    if (d->shared != NULL) {
+        munmap(d->shared, d->shared_size);
+    } else {
+        bitgrid_destroy(&d->frame);
+    }
+    free(d->workers);
+    memset(d, 0, sizeof(*d));
+}
+
+const char* transport_name(const enum transport transport)
+{
+    switch (transport) {
+    case TRANSPORT_SHM:
+        return "shared memory";
+    case TRANSPORT_SOCKET:
+        return "sockets";
+    }
+    return "unknown";
+}
+
+bool parse_transport(const char* const str, enum transport* const transport)
+{
+    if (strcmp(str, "shm") == 0) {
+        *transport = TRANSPORT_SHM;
+    } else if (strcmp(str, "socket") == 0) {
+        *transport = TRANSPORT_SOCKET;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef domain_h
+#define domain_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "grid.h"
+#include "bitgrid.h"
+#include "kernels.h"
+
+// Halo rows a worker can publish before its neighbor has read them
+#define DOMAIN_RING_SLOTS 4
+
+enum transport {
+    TRANSPORT_SHM,
+    TRANSPORT_SOCKET
+};
+
+// A worker process owns rows y_start to y_end of the grid, stepped in cells
+// laid out as in the cells engine, and takes commands from the coordinator
+// over control_fd
+struct domain_worker {
+    pid_t pid;
+    int control_fd;
+    size_t y_start;
+    size_t y_end;
+};
+
+// The grid split into slabs of rows, one per worker process. Each
+// generation, every worker sends its first and last rows to the workers
+// above and below it and steps its slab once their rows have arrived as its
+// halo rows, so workers only wait for their neighbors, never for the
+// coordinator or each other. Rows travel through rings in a POSIX shared
+// memory object, or through sockets, which is what workers on different
+// hosts would have to use. The coordinator only gathers a generation into
+// frame when asked to: through the shared memory object, or with sockets,
+// over the control sockets. generation and hash are those of the last
+// generation the workers reached, and step_ns and wait_ns the time the
+// slowest of them spent stepping and waiting for halo rows on the last
+// command.
+struct domain {
+    struct grid g;
+    enum transport transport;
+    size_t num_workers;
+    struct domain_worker* workers;
+    void* shared;
+    size_t shared_size;
+    struct bitgrid frame;
+    uint64_t generation;
+    uint64_t hash;
+    int64_t step_ns;
+    int64_t wait_ns;
+    bool failed;
+};
+
+bool domain_start(struct domain* const d, const struct grid* const g, const struct cell_kernel* const kernel, const size_t num_workers, const size_t threads_per_worker, const enum transport transport, const struct bitgrid* const start, const uint64_t generation);
+bool domain_step(struct domain* const d, const uint64_t generations);
+bool domain_gather(struct domain* const d);
+void domain_stop(struct domain* const d);
+const char* transport_name(const enum transport transport);
+bool parse_transport(const char* const str, enum transport* const transport);
+
+#endif
@@ -0,0 +1,373 @@
+#include "ensemble.h"
+#include "cycle.h"
+#include "hash.h"
+#include "planes.h"
+#include "timing.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Results are written in runs of this many, to keep the lock on the output
+// file out of the way
+#define RESULTS_PER_FLUSH 256
+
+// The universes a worker has yet to start, first << 32 | end. The worker
+// takes them from the front and idle workers steal the back half, each with
+// a compare and swap, so that a universe is started exactly once. Ranges
+// are only ever split, so a stale range never matches again.
+struct universe_queue {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t range;
+};
+
+// Bit u of every cell is universe u: the cells of a row are width + 2
+// words, with a word of halo on either side and a row of halo above and
+// below. A dead boundary leaves the halo clear, and a torus copies the
+// opposite edges into it before each generation. Lanes that are not active
+// hold no universe and are kept clear.
+struct batch {
+    uint64_t* cells;
+    uint64_t* next;
+    uint64_t* row_words;
+    uint64_t active;
+    uint64_t seeds[ENSEMBLE_LANES];
+    uint64_t generations[ENSEMBLE_LANES];
+    uint64_t hashes[ENSEMBLE_LANES];
+    uint64_t populations[ENSEMBLE_LANES];
+    struct cycle_detector detectors[ENSEMBLE_LANES];
+    struct ensemble_result results[RESULTS_PER_FLUSH];
+    size_t num_results;
+    struct ensemble_stats stats;
+};
+
+struct ensemble {
+    const struct ensemble_config* config;
+    size_t num_workers;
+    struct universe_queue* queues;
+    struct batch* batches;
+    FILE* out;
+    pthread_mutex_t out_lock;
+    bool write_failed;
+};
+
+static inline uint64_t pack_range(const uint64_t first, const uint64_t end)
+{
+    return (first << 32) | end;
+}
+
+// Takes the next universe of a worker's own queue
+static bool pop_universe(struct universe_queue* const q, uint64_t* const universe)
+{
+    uint_fast64_t range = atomic_load_explicit(&q->range, memory_order_acquire);
+    for (;;) {
+        const uint64_t first = range >> 32;
+        const uint64_t end = range & UINT32_MAX;
+        if (first >= end) {
+            return false;
+        }
+        if (atomic_compare_exchange_weak_explicit(&q->range, &range, pack_range(first + 1, end), memory_order_acq_rel, memory_order_acquire)) {
+            *universe = first;
+            return true;
+        }
+    }
+}
+
+// Takes the back half of the first other queue with any universes left,
+// rounded up so that the last one can be stolen too. The first universe
+// stolen is returned and the rest become the thief's own queue, which is
+// empty, so no one else is touching it.
+static bool steal_universes(struct ensemble* const e, const size_t index, uint64_t* const universe)
+{
+    for (size_t k = 1; k < e->num_workers; k++) {
+        struct universe_queue* const victim = &e->queues[(index + k) % e->num_workers];
+        uint_fast64_t range = atomic_load_explicit(&victim->range, memory_order_acquire);
+        for (;;) {
+            const uint64_t first = range >> 32;
+            const uint64_t end = range & UINT32_MAX;
+            if (first >= end) {
+                break;
+            }
+            const uint64_t middle = end - ((end - first + 1) / 2);
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &range, pack_range(first, middle), memory_order_acq_rel, memory_order_acquire)) {
+                atomic_store_explicit(&e->queues[index].range, pack_range(middle + 1, end), memory_order_release);
+                *universe = middle;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Transposes a 64x64 matrix of bits in place, so that bit j of word u comes
+// from bit u of word j, by swapping ever smaller blocks across the diagonal
+static void transpose_64(uint64_t* const m)
+{
+    uint64_t mask = UINT64_C(0x00000000FFFFFFFF);
+    for (unsigned int j = 32; j != 0; j >>= 1, mask ^= mask << j) {
+        for (unsigned int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            const uint64_t t = ((m[k] >> j) ^ m[k | j]) & mask;
+            m[k] ^= t << j;
+            m[k | j] ^= t;
+        }
+    }
+}
+
+static void flush_results(struct ensemble* const e, struct batch* const b)
+{
+    if ((e->out != NULL) && (b->num_results > 0)) {
+        pthread_mutex_lock(&e->out_lock);
+        for (size_t i = 0; i < b->num_results; i++) {
+            const struct ensemble_result* const r = &b->results[i];
+            if (fprintf(e->out, "%" PRIu64 ",%" PRIu64 ",%zu,%" PRIu64 "\n", r->seed, r->population, r->period, r->generations) < 0) {
+                e->write_failed = true;
+            }
+        }
+        pthread_mutex_unlock(&e->out_lock);
+    }
+    b->num_results = 0;
+}
+
+static void add_result(struct ensemble* const e, struct batch* const b, const size_t lane, const size_t period)
+{
+    struct ensemble_result* const r = &b->results[b->num_results++];
+    r->seed = b->seeds[lane];
+    r->population = b->populations[lane];
+    r->generations = b->generations[lane];
+    r->period = period;
+    if (period == 0) {
+        b->stats.num_unsettled++;
+    } else if (r->population == 0) {
+        b->stats.num_dead++;
+    } else if (period == 1) {
+        b->stats.num_still++;
+    } else {
+        b->stats.num_oscillating++;
+    }
+    if (b->num_results == RESULTS_PER_FLUSH) {
+        flush_results(e, b);
+    }
+}
+
+// Starts the next universe in lane, or clears the lane when there are none
+// left
+static void fill_lane(struct ensemble* const e, const size_t index, struct batch* const b, const size_t lane)
+{
+    const struct ensemble_config* const config = e->config;
+    const size_t stride = config->width + 2;
+    const uint64_t bit = UINT64_C(1) << lane;
+    uint64_t universe;
+    bool started = pop_universe(&e->queues[index], &universe);
+    if (!started && steal_universes(e, index, &universe)) {
+        started = true;
+        b->stats.num_stolen++;
+    }
+    if (!started) {
+        for (size_t y = 1; y <= config->height; y++) {
+            for (size_t x = 1; x <= config->width; x++) {
+                b->cells[(y * stride) + x] &= ~bit;
+            }
+        }
+        b->active &= ~bit;
+        return;
+    }
+    const struct board_seed seed = {
+        .seed = config->first_seed + universe,
+        .density = config->density
+    };
+    for (size_t y = 0; y < config->height; y++) {
+        seed_row_words(&seed, config->width, y, b->row_words);
+        uint64_t* const row = b->cells + ((y + 1) * stride) + 1;
+        for (size_t x = 0; x < config->width; x++) {
+            const uint64_t alive = (b->row_words[x / 64] >> (x % 64)) & 1;
+            row[x] = (row[x] & ~bit) | (alive << lane);
+        }
+    }
+    b->seeds[lane] = seed.seed;
+    b->generations[lane] = 0;
+    cycle_detector_reset(&b->detectors[lane]);
+    b->active |= bit;
+}
+
+static void refresh_halo(const struct ensemble_config* const config, uint64_t* const cells)
+{
+    const size_t stride = config->width + 2;
+    for (size_t y = 1; y <= config->height; y++) {
+        uint64_t* const row = cells + (y * stride);
+        row[0] = row[config->width];
+        row[config->width + 1] = row[1];
+    }
+    memcpy(cells, cells + (config->height * stride), stride * sizeof(uint64_t));
+    memcpy(cells + ((config->height + 1) * stride), cells + stride, stride * sizeof(uint64_t));
+}
+
+// Steps every lane of the batch at once: each word of the rows around a
+// cell is a bit plane of one of its neighbors across all the universes
+static inline __attribute__((always_inline)) void step_lanes(
+    const struct ensemble_config* const config,
+    const uint64_t* const prev,
+    uint64_t* const next,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    const size_t stride = config->width + 2;
+    for (size_t y = 1; y <= config->height; y++) {
+        const uint64_t* const row = prev + (y * stride);
+        const uint64_t* const above = row - stride;
+        const uint64_t* const below = row + stride;
+        uint64_t* const out = next + (y * stride);
+        for (size_t x = 1; x <= config->width; x++) {
+            out[x] = step_planes(
+                above[x-1], above[x], above[x+1],
+                row[x-1], row[x], row[x+1],
+                below[x-1], below[x], below[x+1],
+                birth, survival
+            );
+        }
+    }
+}
+
+// Each common rule gets its own copy of the stepping loop
+static void step_batch(const struct ensemble_config* const config, struct batch* const b)
+{
+    if (config->boundary == BOUNDARY_TORUS) {
+        refresh_halo(config, b->cells);
+    }
+    RULE_DISPATCH_MASKS(&config->rule, step_lanes, config, b->cells, b->next);
+    uint64_t* const swap = b->cells;
+    b->cells = b->next;
+    b->next = swap;
+}
+
+// Hashes and counts each universe as a bitgrid would hold it, so that the
+// periods found match a single run's. Every 64 cells of a row are
+// transposed into the words each universe has for them.
+static void census_batch(const struct ensemble_config* const config, struct batch* const b)
+{
+    const size_t stride = config->width + 2;
+    const size_t words_per_row = (config->width + 63) / 64;
+    memset(b->hashes, 0, sizeof(b->hashes));
+    memset(b->populations, 0, sizeof(b->populations));
+    uint64_t words[64];
+    for (size_t y = 0; y < config->height; y++) {
+        const uint64_t* const row = b->cells + ((y + 1) * stride) + 1;
+        for (size_t x = 0; x < config->width; x += 64) {
+            const size_t num_cells = (config->width - x < 64) ? config->width - x : 64;
+            memcpy(words, row + x, num_cells * sizeof(uint64_t));
+            memset(words + num_cells, 0, (64 - num_cells) * sizeof(uint64_t));
+            transpose_64(words);
+            const size_t index = (y * words_per_row) + (x / 64);
+            for (uint64_t lanes = b->active; lanes != 0; lanes &= lanes - 1) {
+                const unsigned int lane = (unsigned int)__builtin_ctzll(lanes);
+                b->hashes[lane] += hash_word(words[lane], index);
+                b->populations[lane] += (uint64_t)__builtin_popcountll(words[lane]);
+            }
+        }
+    }
+}
+
+// Each worker keeps a batch of universes going until there are none left
+// to start, refilling lanes as their universes settle
+static void run_batches(void* const ctx, const size_t index, const size_t num_threads)
+{
+    (void)num_threads;
+    struct ensemble* const e = ctx;
+    const struct ensemble_config* const config = e->config;
+    struct batch* const b = &e->batches[index];
+    for (size_t lane = 0; lane < ENSEMBLE_LANES; lane++) {
+        fill_lane(e, index, b, lane);
+    }
+    while (b->active != 0) {
+        step_batch(config, b);
+        census_batch(config, b);
+        b->stats.cell_generations += (uint64_t)__builtin_popcountll(b->active) * config->width * config->height;
+        for (uint64_t lanes = b->active; lanes != 0; lanes &= lanes - 1) {
+            const size_t lane = (size_t)__builtin_ctzll(lanes);
+            b->generations[lane]++;
+            const size_t period = cycle_detector_push(&b->detectors[lane], b->hashes[lane]);
+            if ((period > 0) || (b->generations[lane] >= config->max_generations)) {
+                add_result(e, b, lane, period);
+                fill_lane(e, index, b, lane);
+            }
+        }
+    }
+    flush_results(e, b);
+}
+
+static void free_batches(struct ensemble* const e)
+{
+    for (size_t i = 0; (e->batches != NULL) && (i < e->num_workers); i++) {
+        free(e->batches[i].cells);
+        free(e->batches[i].next);
+        free(e->batches[i].row_words);
+    }
+    free(e->batches);
+    free(e->queues);
+}
+
+// Runs every universe of config on the pool, writing a line of CSV per
+// universe to out, if not NULL, as they finish, in no particular order
+bool ensemble_run(struct thread_pool* const pool, const struct ensemble_config* const config, FILE* const out, struct ensemble_stats* const stats)
+{
+    if (config->num_universes > UINT32_MAX) {
+        fprintf(stderr, "Error: At most %" PRIu32 " universes can be run at once.\n", UINT32_MAX);
+        return false;
+    }
+    struct ensemble e = {
+        .config = config,
+        .num_workers = pool->num_threads,
+        .out = out,
+        .write_failed = false
+    };
+    const size_t num_words = (config->width + 2) * (config->height + 2);
+    e.queues = aligned_alloc(CACHE_LINE_SIZE, e.num_workers * sizeof(struct universe_queue));
+    e.batches = calloc(e.num_workers, sizeof(struct batch));
+    bool ok = (e.queues != NULL) && (e.batches != NULL);
+    for (size_t i = 0; ok && (i < e.num_workers); i++) {
+        struct batch* const b = &e.batches[i];
+        b->cells = calloc(num_words, sizeof(uint64_t));
+        b->next = calloc(num_words, sizeof(uint64_t));
+        b->row_words = malloc(((config->width + 63) / 64) * sizeof(uint64_t));
+        ok = (b->cells != NULL) && (b->next != NULL) && (b->row_words != NULL);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to allocate memory for the universes.\n");
+        free_batches(&e);
+        return false;
+    }
+    for (size_t i = 0; i < e.num_workers; i++) {
+        const uint64_t first = (i * config->num_universes) / e.num_workers;
+        const uint64_t end = ((i + 1) * config->num_universes) / e.num_workers;
+        atomic_init(&e.queues[i].range, pack_range(first, end));
+    }
+    pthread_mutex_init(&e.out_lock, NULL);
+    if (out != NULL) {
+        fprintf(out, "seed,population,period,generations\n");
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pool_run(pool, run_batches, &e);
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->elapsed_ns = get_time_diff_ns(&start, &stop);
+    for (size_t i = 0; i < e.num_workers; i++) {
+        const struct ensemble_stats* const s = &e.batches[i].stats;
+        stats->num_still += s->num_still;
+        stats->num_oscillating += s->num_oscillating;
+        stats->num_dead += s->num_dead;
+        stats->num_unsettled += s->num_unsettled;
+        stats->num_stolen += s->num_stolen;
+        stats->cell_generations += s->cell_generations;
+    }
+    pthread_mutex_destroy(&e.out_lock);
+    free_batches(&e);
+    if (e.write_failed || ((out != NULL) && (fflush(out) != 0))) {
+        fprintf(stderr, "Error: Failed to write the results.\n");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef ensemble_h
+#define ensemble_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "grid.h"
+#include "rule.h"
+#include "seed.h"
+#include "pool.h"
+
+// Universes stepped side by side in a batch, one per bit of a word
+#define ENSEMBLE_LANES 64
+
+// Runs num_universes small boards of width by height cells, seeded with
+// first_seed, first_seed + 1 and so on, each until it settles into a cycle
+// or reaches max_generations. Universe i is the board that --seed
+// first_seed + i gives a single run of the same size and density.
+struct ensemble_config {
+    size_t width;
+    size_t height;
+    enum boundary boundary;
+    struct rule rule;
+    uint64_t first_seed;
+    double density;
+    uint64_t num_universes;
+    uint64_t max_generations;
+};
+
+// period is 0 for a universe that had not settled by max_generations
+struct ensemble_result {
+    uint64_t seed;
+    uint64_t population;
+    uint64_t generations;
+    size_t period;
+};
+
+struct ensemble_stats {
+    uint64_t num_still;
+    uint64_t num_oscillating;
+    uint64_t num_dead;
+    uint64_t num_unsettled;
+    uint64_t num_stolen;
+    uint64_t cell_generations;
+    int64_t elapsed_ns;
+};
+
+bool ensemble_run(struct thread_pool* const pool, const struct ensemble_config* const config, FILE* const out, struct ensemble_stats* const stats);
+
+#endif
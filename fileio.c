@@ -0,0 +1,51 @@
+#include "fileio.h"
+#include <errno.h>
+#include <unistd.h>
+
+enum transfer_call {
+    TRANSFER_WRITE,
+    TRANSFER_SEND,
+    TRANSFER_READ
+};
+
+static bool transfer_all(const int fd, char* const data, const size_t num_bytes, const enum transfer_call call)
+{
+    size_t total = 0;
+    while (total < num_bytes) {
+        ssize_t n;
+        switch (call) {
+        case TRANSFER_WRITE:
+            n = write(fd, data + total, num_bytes - total);
+            break;
+        case TRANSFER_SEND:
+            n = send(fd, data + total, num_bytes - total, SEND_FLAGS);
+            break;
+        default:
+            n = read(fd, data + total, num_bytes - total);
+            break;
+        }
+        if (n <= 0) {
+            if ((n == -1) && (errno == EINTR)) {
+                continue;
+            }
+            return false;
+        }
+        total += (size_t)n;
+    }
+    return true;
+}
+
+bool write_all(const int fd, const void* const data, const size_t num_bytes)
+{
+    return transfer_all(fd, (char*)data, num_bytes, TRANSFER_WRITE);
+}
+
+bool send_all(const int fd, const void* const data, const size_t num_bytes)
+{
+    return transfer_all(fd, (char*)data, num_bytes, TRANSFER_SEND);
+}
+
+bool read_all(const int fd, void* const data, const size_t num_bytes)
+{
+    return transfer_all(fd, data, num_bytes, TRANSFER_READ);
+}
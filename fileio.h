@@ -0,0 +1,24 @@
+#ifndef fileio_h
+#define fileio_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+// Writing to a socket whose other end is gone fails instead of raising
+// SIGPIPE where the platform allows it
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+// Transfer all num_bytes, retrying short transfers and calls interrupted by
+// a signal, and fail on an error or the end of the file. send_all writes to
+// a socket with SEND_FLAGS.
+bool write_all(const int fd, const void* const data, const size_t num_bytes);
+bool send_all(const int fd, const void* const data, const size_t num_bytes);
+bool read_all(const int fd, void* const data, const size_t num_bytes);
+
+#endif
@@ -0,0 +1,103 @@
+#include "frames.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Set in middle while the middle frame has not been picked up yet
+#define FRAME_FRESH 4u
+
+bool frame_buffer_create(struct frame_buffer* const fb, const size_t width, const size_t height, const size_t num_tiles, const bool packed)
+{
+    fb->width = width;
+    fb->height = height;
+    fb->num_tiles = num_tiles;
+    bool ok = true;
+    for (size_t i = 0; i < 3; i++) {
+        struct frame* const frame = &fb->frames[i];
+        if (packed) {
+            frame->pixels = NULL;
+            frame->bits = bitgrid_create(width, height, BOUNDARY_DEAD, &conway_rule);
+            ok = ok && (frame->bits.words != NULL);
+        } else {
+            frame->pixels = malloc(width * height * sizeof(uint32_t));
+            frame->bits.words = NULL;
+            ok = ok && (frame->pixels != NULL);
+        }
+        frame->dirty = malloc((num_tiles == 0) ? 1 : num_tiles);
+        frame->generation = 0;
+        ok = ok && (frame->dirty != NULL);
+    }
+    fb->back = 0;
+    fb->front = 1;
+    atomic_init(&fb->middle, 2u);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to allocate memory for the frame buffers.\n");
+        frame_buffer_destroy(fb);
+    }
+    return ok;
+}
+
+void frame_buffer_destroy(struct frame_buffer* const fb)
+{
+    for (size_t i = 0; i < 3; i++) {
+        free(fb->frames[i].pixels);
+        bitgrid_destroy(&fb->frames[i].bits);
+        free(fb->frames[i].dirty);
+        fb->frames[i].pixels = NULL;
+        fb->frames[i].dirty = NULL;
+    }
+}
+
+// The frame the producer may fill
+struct frame* frame_buffer_back(struct frame_buffer* const fb)
+{
+    return &fb->frames[fb->back];
+}
+
+// Whether the consumer has picked up the last published frame. A producer
+// that only publishes then never drops a frame, so dirty flags add up.
+bool frame_buffer_consumed(const struct frame_buffer* const fb)
+{
+    return !(atomic_load_explicit(&fb->middle, memory_order_acquire) & FRAME_FRESH);
+}
+
+void frame_buffer_publish(struct frame_buffer* const fb)
+{
+    const unsigned int old = atomic_exchange_explicit(&fb->middle, fb->back | FRAME_FRESH, memory_order_acq_rel);
+    fb->back = old & ~FRAME_FRESH;
+}
+
+// Returns the newest published frame, or NULL if there is none since the
+// last call
+const struct frame* frame_buffer_acquire(struct frame_buffer* const fb)
+{
+    if (!(atomic_load_explicit(&fb->middle, memory_order_acquire) & FRAME_FRESH)) {
+        return NULL;
+    }
+    const unsigned int old = atomic_exchange_explicit(&fb->middle, fb->front, memory_order_acq_rel);
+    fb->front = old & ~FRAME_FRESH;
+    return &fb->frames[fb->front];
+}
+
+// Draws width x height pixels of a frame from x, y to pixels, which points
+// at the first of them and has pitch bytes between rows
+void frame_to_argb_rect(
+    const struct frame_buffer* const fb,
+    const struct frame* const frame,
+    uint32_t* const pixels,
+    const size_t pitch,
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height)
+{
+    if (frame->pixels == NULL) {
+        bitgrid_to_argb_rect(&frame->bits, pixels, x, y, width, height, pitch / sizeof(uint32_t));
+        return;
+    }
+    for (size_t row = 0; row < height; row++) {
+        memcpy((uint8_t*)pixels + (row * pitch),
+               frame->pixels + ((y + row) * fb->width) + x,
+               width * sizeof(uint32_t));
+    }
+}
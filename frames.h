@@ -0,0 +1,43 @@
+#ifndef frames_h
+#define frames_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "bitgrid.h"
+
+// A rendered generation. Frames of packed engines keep one bit per cell in
+// bits and are only expanded to pixels as they are drawn; the others keep
+// ARGB pixels. dirty has one flag per tile for the tiles that changed since
+// the frame before it, or is all set when that is not known.
+struct frame {
+    uint32_t* pixels;
+    struct bitgrid bits;
+    uint8_t* dirty;
+    uint64_t generation;
+};
+
+// Hands frames from the simulation thread to the render thread without
+// locks. The producer fills the back frame and swaps it with the middle one,
+// and the consumer swaps the middle frame with its front frame whenever the
+// middle one is newer. Neither side ever waits for the other.
+struct frame_buffer {
+    struct frame frames[3];
+    size_t width;
+    size_t height;
+    size_t num_tiles;
+    unsigned int back;
+    unsigned int front;
+    atomic_uint middle;
+};
+
+bool frame_buffer_create(struct frame_buffer* const fb, const size_t width, const size_t height, const size_t num_tiles, const bool packed);
+void frame_buffer_destroy(struct frame_buffer* const fb);
+struct frame* frame_buffer_back(struct frame_buffer* const fb);
+bool frame_buffer_consumed(const struct frame_buffer* const fb);
+void frame_buffer_publish(struct frame_buffer* const fb);
+const struct frame* frame_buffer_acquire(struct frame_buffer* const fb);
+void frame_to_argb_rect(const struct frame_buffer* const fb, const struct frame* const frame, uint32_t* const pixels, const size_t pitch, const size_t x, const size_t y, const size_t width, const size_t height);
+
+#endif
@@ -2,10 +2,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 
 bool was_initialized = false;
 
-struct sdl_graphics init_graphics(const char* const title)
+struct sdl_graphics init_graphics(
+    const char* const title,
+    const int window_width,
+    const int window_height,
+    const int texture_width,
+    const int texture_height)
 {
     if (was_initialized) {
         fprintf(stderr, "Only one instance of sdl_graphics may exist at a time.\n");
@@ -21,8 +27,8 @@ struct sdl_graphics init_graphics(const char* const title)
         title,
         SDL_WINDOWPOS_UNDEFINED,
         SDL_WINDOWPOS_UNDEFINED,
-        SCREEN_WIDTH,
-        SCREEN_HEIGHT,
+        window_width,
+        window_height,
         SDL_WINDOW_SHOWN
     );
     if (window == NULL) {
@@ -39,9 +45,9 @@ struct sdl_graphics init_graphics(const char* const title)
     SDL_Texture* const texture = SDL_CreateTexture(
         renderer,
         SDL_PIXELFORMAT_ARGB8888,
-        SDL_TEXTUREACCESS_STATIC,
-        SCREEN_WIDTH,
-        SCREEN_HEIGHT
+        SDL_TEXTUREACCESS_STREAMING,
+        texture_width,
+        texture_height
     );
     if (texture != NULL) {
         was_initialized = true;
@@ -49,6 +55,8 @@ struct sdl_graphics init_graphics(const char* const title)
             .window = window,
             .renderer = renderer,
             .texture = texture,
+            .texture_width = texture_width,
+            .texture_height = texture_height
         };
         return gfx;
     }
@@ -63,14 +71,141 @@ quit_sdl:
     exit(EXIT_FAILURE);
 }
 
-void render_graphics(struct sdl_graphics* const gfx, const uint32_t pixels[const static NUM_PIXELS])
+// pitch is the distance between rows of pixels in bytes
+void render_graphics(struct sdl_graphics* const gfx, const uint32_t* const pixels, const size_t pitch)
 {
+    void* locked;
+    int locked_pitch;
+    if (SDL_LockTexture(gfx->texture, NULL, &locked, &locked_pitch) < 0) {
+        fprintf(stderr, "Error when locking texture: %s\n", SDL_GetError());
+        return;
+    }
+    for (int y = 0; y < gfx->texture_height; y++) {
+        memcpy((uint8_t*)locked + ((size_t)y * (size_t)locked_pitch),
+               (const uint8_t*)pixels + ((size_t)y * pitch),
+               (size_t)gfx->texture_width * sizeof(uint32_t));
+    }
+    SDL_UnlockTexture(gfx->texture);
     //SDL_RenderClear(gfx->renderer);
-    SDL_UpdateTexture(gfx->texture, NULL, pixels, TEXTURE_PITCH);
     SDL_RenderCopy(gfx->renderer, gfx->texture, NULL, NULL);
     SDL_RenderPresent(gfx->renderer);
 }
 
+static void draw_rect(struct sdl_graphics* const gfx, const SDL_Rect* const rect, const draw_rect_fn draw, void* const ctx)
+{
+    void* locked;
+    int locked_pitch;
+    if (SDL_LockTexture(gfx->texture, rect, &locked, &locked_pitch) < 0) {
+        fprintf(stderr, "Error when locking texture: %s\n", SDL_GetError());
+        return;
+    }
+    draw(ctx, locked, (size_t)locked_pitch, (size_t)rect->x, (size_t)rect->y, (size_t)rect->w, (size_t)rect->h);
+    SDL_UnlockTexture(gfx->texture);
+}
+
+// Has draw write the dirty tiles straight into the locked texture. Each run
+// of dirty tiles in a row of tiles is locked as one rectangle, as locked
+// pixels are write only and only the locked rectangle is uploaded. When most
+// tiles are dirty, the whole texture is drawn at once. dirty has one flag
+// per tile of the grid, which is tiles_x tiles wide. The texture is shown by
+// the next present_graphics.
+void update_graphics_rects(
+    struct sdl_graphics* const gfx,
+    const uint8_t* const dirty,
+    const size_t tiles_x,
+    const draw_rect_fn draw,
+    void* const ctx)
+{
+    const int view_tiles_x = (gfx->texture_width + TILE_SIZE - 1) / TILE_SIZE;
+    const int view_tiles_y = (gfx->texture_height + TILE_SIZE - 1) / TILE_SIZE;
+    int num_dirty = 0;
+    for (int ty = 0; ty < view_tiles_y; ty++) {
+        for (int tx = 0; tx < view_tiles_x; tx++) {
+            num_dirty += dirty[((size_t)ty * tiles_x) + (size_t)tx];
+        }
+    }
+    if (num_dirty * 2 > view_tiles_x * view_tiles_y) {
+        const SDL_Rect all = {0, 0, gfx->texture_width, gfx->texture_height};
+        draw_rect(gfx, &all, draw, ctx);
+    } else if (num_dirty > 0) {
+        for (int ty = 0; ty < view_tiles_y; ty++) {
+            const uint8_t* const row = dirty + ((size_t)ty * tiles_x);
+            int tx = 0;
+            while (tx < view_tiles_x) {
+                if (!row[tx]) {
+                    tx++;
+                    continue;
+                }
+                const int run_start = tx;
+                while ((tx < view_tiles_x) && row[tx]) {
+                    tx++;
+                }
+                SDL_Rect rect = {
+                    .x = run_start * TILE_SIZE,
+                    .y = ty * TILE_SIZE,
+                    .w = (tx - run_start) * TILE_SIZE,
+                    .h = TILE_SIZE
+                };
+                if (rect.x + rect.w > gfx->texture_width) {
+                    rect.w = gfx->texture_width - rect.x;
+                }
+                if (rect.y + rect.h > gfx->texture_height) {
+                    rect.h = gfx->texture_height - rect.y;
+                }
+                draw_rect(gfx, &rect, draw, ctx);
+            }
+        }
+    }
+}
+
+// Shows the texture with the bars, if any, drawn over its top left corner
+void present_graphics(struct sdl_graphics* const gfx, const struct overlay_bar* const bars, const size_t num_bars)
+{
+    static const SDL_Color colors[] = {
+        {230, 80, 80, 255},
+        {230, 160, 60, 255},
+        {220, 220, 70, 255},
+        {90, 200, 90, 255},
+        {70, 180, 220, 255},
+        {110, 110, 240, 255},
+        {190, 100, 220, 255},
+        {200, 200, 200, 255}
+    };
+    SDL_RenderCopy(gfx->renderer, gfx->texture, NULL, NULL);
+    if (num_bars > 0) {
+        int window_width;
+        int window_height;
+        SDL_GetRendererOutputSize(gfx->renderer, &window_width, &window_height);
+        const SDL_Rect background = {
+            .x = 0,
+            .y = 0,
+            .w = window_width / 2 + OVERLAY_MARGIN * 2,
+            .h = (int)num_bars * (OVERLAY_BAR_HEIGHT + OVERLAY_MARGIN) + OVERLAY_MARGIN
+        };
+        SDL_SetRenderDrawBlendMode(gfx->renderer, SDL_BLENDMODE_BLEND);
+        SDL_SetRenderDrawColor(gfx->renderer, 0, 0, 0, 160);
+        SDL_RenderFillRect(gfx->renderer, &background);
+        for (size_t i = 0; i < num_bars; i++) {
+            const SDL_Color color = colors[i % (sizeof(colors) / sizeof(colors[0]))];
+            const int y = OVERLAY_MARGIN + (int)i * (OVERLAY_BAR_HEIGHT + OVERLAY_MARGIN);
+            const float length = (bars[i].length < 1.0f) ? bars[i].length : 1.0f;
+            const float mark = (bars[i].mark < 1.0f) ? bars[i].mark : 1.0f;
+            const SDL_Rect bar = {OVERLAY_MARGIN, y, (int)(length * (float)(window_width / 2)), OVERLAY_BAR_HEIGHT};
+            const SDL_Rect tick = {OVERLAY_MARGIN + (int)(mark * (float)(window_width / 2)), y, 2, OVERLAY_BAR_HEIGHT};
+            SDL_SetRenderDrawColor(gfx->renderer, color.r, color.g, color.b, color.a);
+            SDL_RenderFillRect(gfx->renderer, &bar);
+            SDL_SetRenderDrawColor(gfx->renderer, 255, 255, 255, 255);
+            SDL_RenderFillRect(gfx->renderer, &tick);
+        }
+    }
+    SDL_RenderPresent(gfx->renderer);
+}
+
+void set_graphics_title(struct sdl_graphics* const gfx, const char* const title)
+{
+    SDL_SetWindowTitle(gfx->window, title);
+}
+
 void end_graphics(struct sdl_graphics* const gfx)
 {
     SDL_DestroyTexture(gfx->texture);
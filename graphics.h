@@ -3,21 +3,39 @@
 
 #include <stdint.h>
 #include <SDL2/SDL.h>
+#include "tiles.h"
 
 #define SCREEN_WIDTH         640
 #define SCREEN_HEIGHT        480
-#define NUM_PIXELS           (SCREEN_WIDTH * SCREEN_HEIGHT)
-#define NUM_BYTES_IN_TEXTURE (NUM_PIXELS * sizeof(uint32_t))
-#define TEXTURE_PITCH        (SCREEN_WIDTH * sizeof(uint32_t))
+#define OVERLAY_BAR_HEIGHT   6
+#define OVERLAY_MARGIN       3
 
+// The texture holds the part of the grid that is shown and is stretched to
+// fill the window
 struct sdl_graphics {
     SDL_Window* const window;
     SDL_Renderer* const renderer;
     SDL_Texture* const texture;
+    const int texture_width;
+    const int texture_height;
 };
 
-struct sdl_graphics init_graphics(const char* const title);
-void render_graphics(struct sdl_graphics* const gfx, const uint32_t pixels[const static NUM_PIXELS]);
+// Writes width x height pixels from x, y of the view to pixels, which points
+// at the first of them in locked texture memory with pitch bytes between rows
+typedef void (*draw_rect_fn)(void* ctx, uint32_t* pixels, size_t pitch, size_t x, size_t y, size_t width, size_t height);
+
+// A bar of the overlay and a mark across it, as fractions of half the
+// window width
+struct overlay_bar {
+    float length;
+    float mark;
+};
+
+struct sdl_graphics init_graphics(const char* const title, const int window_width, const int window_height, const int texture_width, const int texture_height);
+void render_graphics(struct sdl_graphics* const gfx, const uint32_t* const pixels, const size_t pitch);
+void update_graphics_rects(struct sdl_graphics* const gfx, const uint8_t* const dirty, const size_t tiles_x, const draw_rect_fn draw, void* const ctx);
+void present_graphics(struct sdl_graphics* const gfx, const struct overlay_bar* const bars, const size_t num_bars);
+void set_graphics_title(struct sdl_graphics* const gfx, const char* const title);
 void end_graphics(struct sdl_graphics* const gfx);
 
 #endif
@@ -0,0 +1,126 @@
+#include "grid.h"
+#include "cells.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+struct grid grid_init(const size_t width, const size_t height, const enum boundary boundary, const struct rule* const rule)
+{
+    const size_t stride = ((width + 1 + CELLS_PER_LINE) / CELLS_PER_LINE) * CELLS_PER_LINE;
+    struct grid g = {
+        .width = width,
+        .height = height,
+        .stride = stride,
+        .first_row = 0,
+        .first_column = 0,
+        .whole_width = width,
+        .boundary = boundary,
+        .rule = *rule,
+        .lookup_table = NULL
+    };
+    return g;
+}
+
+// Size of the rows of the grid itself, not counting the halo rows
+size_t grid_num_bytes(const struct grid* const g)
+{
+    return g->stride * g->height * sizeof(uint32_t);
+}
+
+// Returns a pointer to the first row, with every cell dead. The halo rows
+// are surrounded by one spare cache line on either side, which keeps the
+// neighbors of the corner cells and the vectors that run past the end of
+// the last row inside the allocation.
+uint32_t* grid_alloc_cells(const struct grid* const g)
+{
+    const size_t num_cells = (g->stride * (g->height + 2)) + (2 * CELLS_PER_LINE);
+    uint32_t* const alloc = aligned_alloc(CACHE_LINE_SIZE, num_cells * sizeof(uint32_t));
+    if (alloc == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < num_cells; i++) {
+        alloc[i] = DEAD_CELL;
+    }
+    return alloc + CELLS_PER_LINE + g->stride;
+}
+
+void grid_free_cells(const struct grid* const g, uint32_t* const cells)
+{
+    if (cells != NULL) {
+        free(cells - g->stride - CELLS_PER_LINE);
+    }
+}
+
+// Copies the edges of a torus into the ghost cells on the opposite side.
+// Kernels keep dead ghost cells dead, so there is nothing to do for a dead
+// boundary.
+void grid_refresh_halo(const struct grid* const g, uint32_t* const cells)
+{
+    if (g->boundary != BOUNDARY_TORUS) {
+        return;
+    }
+    const size_t stride = g->stride;
+    const size_t width = g->width;
+    uint32_t* const first = cells;
+    uint32_t* const last = cells + ((g->height - 1) * stride);
+    uint32_t* const above = cells - stride;
+    uint32_t* const below = cells + (g->height * stride);
+    for (size_t x = 0; x < width; x++) {
+        above[x] = last[x];
+        below[x] = first[x];
+    }
+    grid_refresh_ghost_columns(g, cells);
+}
+
+// Only wraps the rows around, including the halo rows, for slabs whose halo
+// rows come from their neighbors
+void grid_refresh_ghost_columns(const struct grid* const g, uint32_t* const cells)
+{
+    if (g->boundary != BOUNDARY_TORUS) {
+        return;
+    }
+    const size_t stride = g->stride;
+    const size_t width = g->width;
+    uint32_t* const above = cells - stride;
+    // The ghost cell left of a row is the last padding cell of the row
+    // before it, which for the halo row above is in the spare cache line
+    for (size_t y = 0; y < g->height + 2; y++) {
+        uint32_t* const row = above + (y * stride);
+        row[-1] = row[width - 1];
+        row[width] = row[0];
+    }
+}
+
+bool parse_boundary(const char* const str, enum boundary* const boundary)
+{
+    if (strcmp(str, "dead") == 0) {
+        *boundary = BOUNDARY_DEAD;
+    } else if (strcmp(str, "torus") == 0) {
+        *boundary = BOUNDARY_TORUS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Parses "WIDTHxHEIGHT"
+bool parse_dimensions(const char* const str, size_t* const width, size_t* const height)
+{
+    char* end;
+    errno = 0;
+    const unsigned long long w = strtoull(str, &end, 10);
+    if ((errno != 0) || (end == str) || (*end != 'x')) {
+        return false;
+    }
+    const char* const h_str = end + 1;
+    const unsigned long long h = strtoull(h_str, &end, 10);
+    if ((errno != 0) || (end == h_str) || (*end != '\0')) {
+        return false;
+    }
+    if ((w == 0) || (h == 0) || (w > MAX_GRID_SIDE) || (h > MAX_GRID_SIDE)) {
+        return false;
+    }
+    *width = (size_t)w;
+    *height = (size_t)h;
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef grid_h
+#define grid_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "rule.h"
+
+#define CACHE_LINE_SIZE   64
+#define CELLS_PER_LINE    (CACHE_LINE_SIZE / sizeof(uint32_t))
+#define MAX_GRID_SIDE     (1 << 20)
+
+enum boundary {
+    BOUNDARY_DEAD,
+    BOUNDARY_TORUS
+};
+
+// Rows are stride cells apart, with stride a whole number of cache lines and
+// at least two cells wider than the grid. The halo row above and below the
+// grid, the padding cell right after each row and the last padding cell
+// before it are ghost cells, so kernels can read one cell past any edge
+// without checking, and SIMD loads can run to the end of a row without
+// tails. Ghost cells are dead, or with a torus boundary, copies of the cells
+// on the opposite edge that grid_refresh_halo updates once per generation.
+// Padding cells that are not ghost cells are always dead. A grid can also be
+// a slab of rows of a larger one, whose row 0 is row first_row of the whole
+// grid, as far as the hashes and census of its rows go, and whose halo rows
+// are filled in by whoever owns the rows next to it. A window of the whole
+// grid also starts first_column cells in, a multiple of 64, and hashes its
+// words as those of a row whole_width cells wide. lookup_table is the table
+// of the lookup kernel for the rule, when that kernel steps the grid, and
+// NULL otherwise.
+struct grid {
+    size_t width;
+    size_t height;
+    size_t stride;
+    size_t first_row;
+    size_t first_column;
+    size_t whole_width;
+    enum boundary boundary;
+    struct rule rule;
+    const uint8_t* lookup_table;
+};
+
+struct grid grid_init(const size_t width, const size_t height, const enum boundary boundary, const struct rule* const rule);
+uint32_t* grid_alloc_cells(const struct grid* const g);
+void grid_free_cells(const struct grid* const g, uint32_t* const cells);
+size_t grid_num_bytes(const struct grid* const g);
+void grid_refresh_halo(const struct grid* const g, uint32_t* const cells);
+void grid_refresh_ghost_columns(const struct grid* const g, uint32_t* const cells);
+bool parse_boundary(const char* const str, enum boundary* const boundary);
+bool parse_dimensions(const char* const str, size_t* const width, size_t* const height);
+
+#endif
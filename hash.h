@@ -0,0 +1,25 @@
+#ifndef hash_h
+#define hash_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Generations are hashed 64 cells at a time, as the words of a bitgrid:
+// word index (y * words_per_row) + (x / 64) holds cell x of row y in bit
+// x % 64, and bits past the right edge of the grid are clear. The hash of a
+// generation is the sum of the hashes of all its words, so the rows or
+// tiles of a generation can be hashed separately, by any engine, and added
+// up to the same hash, and the sum of a part that did not change can be
+// kept.
+static inline uint64_t hash_word(const uint64_t word, const size_t index)
+{
+    uint64_t h = word ^ ((uint64_t)index * UINT64_C(0x9E3779B97F4A7C15));
+    h ^= h >> 31;
+    h *= UINT64_C(0x7FB5D329728EA185);
+    h ^= h >> 27;
+    h *= UINT64_C(0x81DADEF4BC2DD44D);
+    h ^= h >> 33;
+    return h;
+}
+
+#endif
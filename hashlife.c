@@ -0,0 +1,455 @@
+#include "hashlife.h"
+#include "cells.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HL_BLOCK_NODES      16384
+#define HL_INITIAL_BUCKETS  (1 << 16)
+
+struct hl_block {
+    struct hl_block* next;
+    struct hl_node nodes[HL_BLOCK_NODES];
+};
+
+// Cells are shared by every universe and never collected
+static struct hl_node dead_cell = {.population = 0, .level = 0, .result_step = -1};
+static struct hl_node live_cell = {.population = 1, .level = 0, .result_step = -1};
+
+static inline size_t hash_children(
+    const struct hl_node* const nw,
+    const struct hl_node* const ne,
+    const struct hl_node* const sw,
+    const struct hl_node* const se)
+{
+    uint64_t h = (uint64_t)(uintptr_t)nw * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)(uintptr_t)ne * 0xC2B2AE3D27D4EB4Full;
+    h ^= (uint64_t)(uintptr_t)sw * 0x165667B19E3779F9ull;
+    h ^= (uint64_t)(uintptr_t)se * 0x27D4EB2F165667C5ull;
+    return (size_t)(h ^ (h >> 29));
+}
+
+static void grow_buckets(struct hashlife* const hl)
+{
+    const size_t num_buckets = hl->num_buckets * 2;
+    struct hl_node** const buckets = calloc(num_buckets, sizeof(struct hl_node*));
+    if (buckets == NULL) {
+        // A longer chain is slower but still correct
+        return;
+    }
+    for (size_t i = 0; i < hl->num_buckets; i++) {
+        struct hl_node* n = hl->buckets[i];
+        while (n != NULL) {
+            struct hl_node* const next = n->next;
+            const size_t b = hash_children(n->nw, n->ne, n->sw, n->se) & (num_buckets - 1);
+            n->next = buckets[b];
+            buckets[b] = n;
+            n = next;
+        }
+    }
+    free(hl->buckets);
+    hl->buckets = buckets;
+    hl->num_buckets = num_buckets;
+}
+
+static struct hl_node* alloc_node(struct hashlife* const hl)
+{
+    if (hl->free_list == NULL) {
+        struct hl_block* const block = malloc(sizeof(struct hl_block));
+        if (block == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for HashLife nodes.\n");
+            exit(EXIT_FAILURE);
+        }
+        block->next = hl->blocks;
+        hl->blocks = block;
+        for (size_t i = 0; i < HL_BLOCK_NODES; i++) {
+            block->nodes[i].next = hl->free_list;
+            hl->free_list = &block->nodes[i];
+        }
+    }
+    struct hl_node* const n = hl->free_list;
+    hl->free_list = n->next;
+    return n;
+}
+
+// Returns the unique node with these children
+static struct hl_node* find_node(
+    struct hashlife* const hl,
+    struct hl_node* const nw,
+    struct hl_node* const ne,
+    struct hl_node* const sw,
+    struct hl_node* const se)
+{
+    const size_t b = hash_children(nw, ne, sw, se) & (hl->num_buckets - 1);
+    for (struct hl_node* n = hl->buckets[b]; n != NULL; n = n->next) {
+        if ((n->nw == nw) && (n->ne == ne) && (n->sw == sw) && (n->se == se)) {
+            return n;
+        }
+    }
+    struct hl_node* const n = alloc_node(hl);
+    n->nw = nw;
+    n->ne = ne;
+    n->sw = sw;
+    n->se = se;
+    n->result = NULL;
+    n->population = nw->population + ne->population + sw->population + se->population;
+    n->level = (uint8_t)(nw->level + 1);
+    n->result_step = -1;
+    n->marked = false;
+    n->next = hl->buckets[b];
+    hl->buckets[b] = n;
+    if (++hl->num_nodes > hl->num_buckets) {
+        grow_buckets(hl);
+    }
+    return n;
+}
+
+bool hashlife_create(struct hashlife* const hl, const size_t max_bytes, const struct rule* const rule)
+{
+    memset(hl, 0, sizeof(*hl));
+    hl->rule = *rule;
+    hl->num_buckets = HL_INITIAL_BUCKETS;
+    hl->buckets = calloc(hl->num_buckets, sizeof(struct hl_node*));
+    if (hl->buckets == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for the HashLife table.\n");
+        return false;
+    }
+    hl->max_nodes = max_bytes / sizeof(struct hl_node);
+    hl->collect_at = hl->max_nodes;
+    hl->empty[0] = &dead_cell;
+    for (size_t level = 1; level <= HASHLIFE_MAX_LEVEL; level++) {
+        struct hl_node* const e = hl->empty[level - 1];
+        hl->empty[level] = find_node(hl, e, e, e, e);
+    }
+    hl->root = hl->empty[3];
+    return true;
+}
+
+void hashlife_destroy(struct hashlife* const hl)
+{
+    struct hl_block* block = hl->blocks;
+    while (block != NULL) {
+        struct hl_block* const next = block->next;
+        free(block);
+        block = next;
+    }
+    free(hl->buckets);
+    memset(hl, 0, sizeof(*hl));
+}
+
+static struct hl_node* build(
+    struct hashlife* const hl,
+    const struct bitgrid* const grid,
+    const unsigned int level,
+    const int64_t x0,
+    const int64_t y0)
+{
+    const int64_t size = INT64_C(1) << level;
+    if ((x0 + size <= 0) || (y0 + size <= 0) || (x0 >= (int64_t)grid->width) || (y0 >= (int64_t)grid->height)) {
+        return hl->empty[level];
+    }
+    if (level == 0) {
+        const uint64_t word = grid->words[((size_t)y0 * grid->words_per_row) + ((size_t)x0 / 64)];
+        return ((word >> ((size_t)x0 % 64)) & 1) ? &live_cell : &dead_cell;
+    }
+    const int64_t half = size / 2;
+    return find_node(
+        hl,
+        build(hl, grid, level - 1, x0, y0),
+        build(hl, grid, level - 1, x0 + half, y0),
+        build(hl, grid, level - 1, x0, y0 + half),
+        build(hl, grid, level - 1, x0 + half, y0 + half)
+    );
+}
+
+// The grid's top left cell becomes (0, 0)
+bool hashlife_load_bitgrid(struct hashlife* const hl, const struct bitgrid* const grid)
+{
+    const size_t side = (grid->width > grid->height) ? grid->width : grid->height;
+    unsigned int level = 3;
+    while ((INT64_C(1) << (level - 1)) < (int64_t)side) {
+        level++;
+    }
+    if (level > HASHLIFE_MAX_LEVEL) {
+        return false;
+    }
+    const int64_t half = INT64_C(1) << (level - 1);
+    hl->root = build(hl, grid, level, -half, -half);
+    hl->generation = 0;
+    return true;
+}
+
+uint64_t hashlife_population(const struct hashlife* const hl)
+{
+    return hl->root->population;
+}
+
+static inline bool cell_at(const struct hl_node* const n, const unsigned int x, const unsigned int y)
+{
+    const struct hl_node* const quadrants[4] = {n->nw, n->ne, n->sw, n->se};
+    const struct hl_node* const q = quadrants[((y >= 2) * 2) + (x >= 2)];
+    const struct hl_node* const cells[4] = {q->nw, q->ne, q->sw, q->se};
+    return cells[((y & 1) * 2) + (x & 1)]->population != 0;
+}
+
+// One generation of the center 2x2 of a 4x4 node
+static struct hl_node* step_level2(struct hashlife* const hl, const struct hl_node* const n)
+{
+    uint32_t bits = 0;
+    for (unsigned int y = 0; y < 4; y++) {
+        for (unsigned int x = 0; x < 4; x++) {
+            bits |= (uint32_t)cell_at(n, x, y) << ((y * 4) + x);
+        }
+    }
+    struct hl_node* next[4];
+    for (unsigned int i = 0; i < 4; i++) {
+        const unsigned int x = 1 + (i & 1);
+        const unsigned int y = 1 + (i >> 1);
+        unsigned int num_neighbors = 0;
+        for (unsigned int dy = 0; dy < 3; dy++) {
+            for (unsigned int dx = 0; dx < 3; dx++) {
+                num_neighbors += (bits >> (((y + dy - 1) * 4) + (x + dx - 1))) & 1;
+            }
+        }
+        const bool alive = (bits >> ((y * 4) + x)) & 1;
+        num_neighbors -= alive;
+        next[i] = rule_next(&hl->rule, alive, num_neighbors) ? &live_cell : &dead_cell;
+    }
+    return find_node(hl, next[0], next[1], next[2], next[3]);
+}
+
+static inline struct hl_node* center(struct hashlife* const hl, const struct hl_node* const n)
+{
+    return find_node(hl, n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+static inline struct hl_node* hold(struct hashlife* const hl, struct hl_node* const n)
+{
+    hl->held[hl->num_held++] = n;
+    return n;
+}
+
+// A collection that cannot bring the nodes under half the limit would have
+// to be repeated almost at once, so the next one waits until they double
+static void collect_if_full(struct hashlife* const hl)
+{
+    if (hl->num_nodes > hl->collect_at) {
+        hashlife_collect(hl);
+        hl->collect_at = (2 * hl->num_nodes > hl->max_nodes) ? 2 * hl->num_nodes : hl->max_nodes;
+    }
+}
+
+// The center half of n advanced by 2^min(step_log2, level - 2) generations.
+// Nodes are only collected on the way into advance, so every node a level
+// still needs after advancing another one is held until it returns; the
+// children of n are kept by n.
+static struct hl_node* advance(struct hashlife* const hl, struct hl_node* const n, const unsigned int step_log2)
+{
+    const int step = ((int)step_log2 < n->level - 2) ? (int)step_log2 : n->level - 2;
+    if ((n->result != NULL) && (n->result_step == step)) {
+        return n->result;
+    }
+
+    struct hl_node* result;
+    if (n->population == 0) {
+        result = hl->empty[n->level - 1];
+    } else if (n->level == 2) {
+        result = step_level2(hl, n);
+    } else {
+        const size_t num_held = hl->num_held;
+        hold(hl, n);
+        collect_if_full(hl);
+        // Nine overlapping squares of half the size, each advanced by up to
+        // half the step
+        struct hl_node* const t00 = n->nw;
+        struct hl_node* const t01 = hold(hl, find_node(hl, n->nw->ne, n->ne->nw, n->nw->se, n->ne->sw));
+        struct hl_node* const t02 = n->ne;
+        struct hl_node* const t10 = hold(hl, find_node(hl, n->nw->sw, n->nw->se, n->sw->nw, n->sw->ne));
+        struct hl_node* const t11 = hold(hl, find_node(hl, n->nw->se, n->ne->sw, n->sw->ne, n->se->nw));
+        struct hl_node* const t12 = hold(hl, find_node(hl, n->ne->sw, n->ne->se, n->se->nw, n->se->ne));
+        struct hl_node* const t20 = n->sw;
+        struct hl_node* const t21 = hold(hl, find_node(hl, n->sw->ne, n->se->nw, n->sw->se, n->se->sw));
+        struct hl_node* const t22 = n->se;
+
+        struct hl_node* const r00 = hold(hl, advance(hl, t00, step_log2));
+        struct hl_node* const r01 = hold(hl, advance(hl, t01, step_log2));
+        struct hl_node* const r02 = hold(hl, advance(hl, t02, step_log2));
+        struct hl_node* const r10 = hold(hl, advance(hl, t10, step_log2));
+        struct hl_node* const r11 = hold(hl, advance(hl, t11, step_log2));
+        struct hl_node* const r12 = hold(hl, advance(hl, t12, step_log2));
+        struct hl_node* const r20 = hold(hl, advance(hl, t20, step_log2));
+        struct hl_node* const r21 = hold(hl, advance(hl, t21, step_log2));
+        struct hl_node* const r22 = hold(hl, advance(hl, t22, step_log2));
+
+        struct hl_node* const q_nw = hold(hl, find_node(hl, r00, r01, r10, r11));
+        struct hl_node* const q_ne = hold(hl, find_node(hl, r01, r02, r11, r12));
+        struct hl_node* const q_sw = hold(hl, find_node(hl, r10, r11, r20, r21));
+        struct hl_node* const q_se = hold(hl, find_node(hl, r11, r12, r21, r22));
+        if (step == n->level - 2) {
+            // Full speed: the second half of the step comes from advancing
+            // the four intermediate squares again
+            struct hl_node* const s_nw = hold(hl, advance(hl, q_nw, step_log2));
+            struct hl_node* const s_ne = hold(hl, advance(hl, q_ne, step_log2));
+            struct hl_node* const s_sw = hold(hl, advance(hl, q_sw, step_log2));
+            struct hl_node* const s_se = advance(hl, q_se, step_log2);
+            result = find_node(hl, s_nw, s_ne, s_sw, s_se);
+        } else {
+            result = find_node(hl, center(hl, q_nw), center(hl, q_ne), center(hl, q_sw), center(hl, q_se));
+        }
+        hl->num_held = num_held;
+    }
+    n->result = result;
+    n->result_step = (int8_t)step;
+    return result;
+}
+
+static struct hl_node* expand(struct hashlife* const hl, struct hl_node* const root)
+{
+    struct hl_node* const e = hl->empty[root->level - 1];
+    return find_node(
+        hl,
+        find_node(hl, e, e, e, root->nw),
+        find_node(hl, e, e, root->ne, e),
+        find_node(hl, e, root->sw, e, e),
+        find_node(hl, root->se, e, e, e)
+    );
+}
+
+// True when every live cell is in the center half of the root
+static bool is_padded(const struct hl_node* const root)
+{
+    return (root->nw->population == root->nw->se->population)
+        && (root->ne->population == root->ne->sw->population)
+        && (root->sw->population == root->sw->ne->population)
+        && (root->se->population == root->se->nw->population);
+}
+
+// Advances the universe by 2^step_log2 generations, unless the pattern has
+// grown too large for the root to hold it
+bool hashlife_jump(struct hashlife* const hl, const unsigned int step_log2)
+{
+    if (step_log2 + 3 > HASHLIFE_MAX_LEVEL) {
+        return false;
+    }
+    collect_if_full(hl);
+    // The pattern must sit in the center quarter of the root, so that it
+    // cannot grow out of the center half while it is advanced
+    struct hl_node* root = hl->root;
+    while ((root->level < step_log2 + 2) || !is_padded(root)) {
+        if (root->level >= HASHLIFE_MAX_LEVEL) {
+            return false;
+        }
+        root = expand(hl, root);
+    }
+    if (root->level >= HASHLIFE_MAX_LEVEL) {
+        return false;
+    }
+    root = expand(hl, root);
+    hl->root = advance(hl, root, step_log2);
+    hl->generation += UINT64_C(1) << step_log2;
+    return true;
+}
+
+static void mark(struct hl_node* const n, const bool keep_results)
+{
+    if ((n->level == 0) || n->marked) {
+        return;
+    }
+    n->marked = true;
+    mark(n->nw, keep_results);
+    mark(n->ne, keep_results);
+    mark(n->sw, keep_results);
+    mark(n->se, keep_results);
+    if (keep_results && (n->result != NULL)) {
+        mark(n->result, keep_results);
+    }
+}
+
+static void sweep(struct hashlife* const hl, const bool keep_results)
+{
+    for (size_t i = 0; i < hl->num_buckets; i++) {
+        struct hl_node** link = &hl->buckets[i];
+        while (*link != NULL) {
+            struct hl_node* const n = *link;
+            if (n->marked) {
+                n->marked = false;
+                if (!keep_results) {
+                    n->result = NULL;
+                    n->result_step = -1;
+                }
+                link = &n->next;
+            } else {
+                *link = n->next;
+                n->next = hl->free_list;
+                hl->free_list = n;
+                hl->num_nodes--;
+            }
+        }
+    }
+}
+
+// Frees every node that is not reachable from the root or the held nodes.
+// Memoized results are kept when that frees enough nodes, and dropped
+// otherwise.
+void hashlife_collect(struct hashlife* const hl)
+{
+    for (int pass = 0; pass < 2; pass++) {
+        const bool keep_results = (pass == 0);
+        mark(hl->root, keep_results);
+        for (size_t i = 0; i < hl->num_held; i++) {
+            mark(hl->held[i], keep_results);
+        }
+        for (size_t level = 1; level <= HASHLIFE_MAX_LEVEL; level++) {
+            mark(hl->empty[level], keep_results);
+        }
+        sweep(hl, keep_results);
+        if (hl->num_nodes <= hl->max_nodes / 2) {
+            break;
+        }
+    }
+    hl->num_collections++;
+}
+
+static void render_node(
+    const struct hl_node* const n,
+    const int64_t x0,
+    const int64_t y0,
+    uint32_t* const pixels,
+    const int64_t view_width,
+    const int64_t view_height,
+    const size_t pitch)
+{
+    const int64_t size = INT64_C(1) << n->level;
+    if ((n->population == 0) || (x0 + size <= 0) || (y0 + size <= 0) || (x0 >= view_width) || (y0 >= view_height)) {
+        return;
+    }
+    if (n->level == 0) {
+        pixels[((size_t)y0 * pitch) + (size_t)x0] = LIVE_CELL;
+        return;
+    }
+    const int64_t half = size / 2;
+    render_node(n->nw, x0, y0, pixels, view_width, view_height, pitch);
+    render_node(n->ne, x0 + half, y0, pixels, view_width, view_height, pitch);
+    render_node(n->sw, x0, y0 + half, pixels, view_width, view_height, pitch);
+    render_node(n->se, x0 + half, y0 + half, pixels, view_width, view_height, pitch);
+}
+
+// Draws the cells from (view_x, view_y) to (view_x + view_width, view_y +
+// view_height). pitch is the distance between rows of pixels in cells.
+void hashlife_render(
+    const struct hashlife* const hl,
+    uint32_t* const pixels,
+    const size_t view_width,
+    const size_t view_height,
+    const size_t pitch,
+    const int64_t view_x,
+    const int64_t view_y)
+{
+    for (size_t y = 0; y < view_height; y++) {
+        for (size_t x = 0; x < view_width; x++) {
+            pixels[(y * pitch) + x] = DEAD_CELL;
+        }
+    }
+    const int64_t half = INT64_C(1) << (hl->root->level - 1);
+    render_node(hl->root, -half - view_x, -half - view_y, pixels, (int64_t)view_width, (int64_t)view_height, pitch);
+}
@@ -0,0 +1,64 @@
+#ifndef hashlife_h
+#define hashlife_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bitgrid.h"
+#include "rule.h"
+
+#define HASHLIFE_MAX_LEVEL        62
+#define HASHLIFE_DEFAULT_MAX_MB   512
+// Each level of a jump holds on to at most 23 nodes while it advances the
+// nodes below it
+#define HASHLIFE_MAX_HELD         (HASHLIFE_MAX_LEVEL * 24)
+
+// A node of level k is a square of 2^k cells. Level 0 nodes are single
+// cells. Nodes are hash-consed, so equal squares are the same node, and
+// result caches the center square advanced by 2^result_step generations.
+struct hl_node {
+    struct hl_node* nw;
+    struct hl_node* ne;
+    struct hl_node* sw;
+    struct hl_node* se;
+    struct hl_node* result;
+    struct hl_node* next;
+    uint64_t population;
+    uint8_t level;
+    int8_t result_step;
+    bool marked;
+};
+
+struct hl_block;
+
+// The root is centered on the origin, and the cell at (0, 0) is the top left
+// of the grid the universe was loaded from. Nodes come from blocks that are
+// never returned to the system; freed nodes go on a free list. Nodes are
+// collected once there are more than collect_at of them, even in the middle
+// of a jump, which keeps the nodes it is still working on in held.
+struct hashlife {
+    struct hl_node** buckets;
+    size_t num_buckets;
+    size_t num_nodes;
+    size_t max_nodes;
+    size_t collect_at;
+    struct hl_node* held[HASHLIFE_MAX_HELD];
+    size_t num_held;
+    struct hl_block* blocks;
+    struct hl_node* free_list;
+    struct hl_node* empty[HASHLIFE_MAX_LEVEL + 1];
+    struct hl_node* root;
+    uint64_t generation;
+    size_t num_collections;
+    struct rule rule;
+};
+
+bool hashlife_create(struct hashlife* const hl, const size_t max_bytes, const struct rule* const rule);
+void hashlife_destroy(struct hashlife* const hl);
+bool hashlife_load_bitgrid(struct hashlife* const hl, const struct bitgrid* const grid);
+bool hashlife_jump(struct hashlife* const hl, const unsigned int step_log2);
+uint64_t hashlife_population(const struct hashlife* const hl);
+void hashlife_collect(struct hashlife* const hl);
+void hashlife_render(const struct hashlife* const hl, uint32_t* const pixels, const size_t view_width, const size_t view_height, const size_t pitch, const int64_t view_x, const int64_t view_y);
+
+#endif
@@ -0,0 +1,1044 @@
+#include "kernels.h"
+#include "cells.h"
+#include "hash.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define USE_SIMD
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Kernels take the rule as birth and survival masks, and are written as
+// always inlined templates that RULE_DISPATCH instantiates once per common
+// rule with constant masks. Matching neighbor counts against constants
+// folds down to the compares of that rule alone, which for Conway's rule
+// are the same as a kernel written for it by hand. Other rules fall back to
+// looking up the next state in the masks.
+
+// The SIMD kernels match each count with a MATCH_COUNT_* macro, the vector
+// form of MATCH_COUNT in planes.h, which explains the split into either,
+// born and survives.
+#define FOR_EACH_COUNT(match) \
+    match(0); match(1); match(2); match(3); match(4); match(5); match(6); match(7); match(8)
+
+static inline __attribute__((always_inline)) bool cell_is_alive(const uint32_t cell, const uint8_t num_neighbors, const unsigned int birth, const unsigned int survival);
+
+// Kernels hash each row of the next generation as they store it, and leave
+// the hash in row_hashes[y]. Rows are stepped 64 cells at a time, whose
+// next states are packed into a word laid out like a bitgrid word and
+// hashed, so the rows sum up to the same hash as the bitgrid engine's. The
+// same word and one of the cells the step read are counted into the census
+// of the row, which is left in row_census[y], so that counting the cells
+// takes no pass of its own.
+static inline size_t first_word_of_row(const struct grid* const g, const size_t y)
+{
+    return ((g->first_row + y) * ((g->whole_width + 63) / 64)) + (g->first_column / 64);
+}
+
+// The end of the word of cells that starts at x_word
+static inline size_t word_end(const size_t x_word, const size_t width)
+{
+    return (x_word + 64 < width) ? x_word + 64 : width;
+}
+
+// The ghost cells around the grid stand in for the neighbors past its edges,
+// so there are no edge checks. Returns whether the cell is alive.
+static inline __attribute__((always_inline)) bool update_cell(
+    const struct grid* const g,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    const size_t x,
+    const size_t y,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    const size_t i = (y * g->stride) + x;
+    const uint32_t* const above = prev + i - g->stride;
+    const uint32_t* const middle = prev + i;
+    const uint32_t* const below = prev + i + g->stride;
+    const uint8_t num_neighbors = (above[-1] == LIVE_CELL) + (above[0] == LIVE_CELL) + (above[1] == LIVE_CELL)
+                                + (middle[-1] == LIVE_CELL) + (middle[1] == LIVE_CELL)
+                                + (below[-1] == LIVE_CELL) + (below[0] == LIVE_CELL) + (below[1] == LIVE_CELL);
+    const bool alive = cell_is_alive(prev[i], num_neighbors, birth, survival);
+    next[i] = alive ? LIVE_CELL : DEAD_CELL;
+    return alive;
+}
+
+static inline __attribute__((always_inline)) void update_rows_rule(
+    const struct grid* const g,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    for (size_t y = y_start; y < y_end; y++) {
+        const uint32_t* const row = prev + (y * g->stride);
+        uint64_t hash = 0;
+        struct census census;
+        census_clear(&census);
+        for (size_t x_word = 0; x_word < g->width; x_word += 64) {
+            uint64_t word = 0;
+            uint64_t before = 0;
+            for (size_t x = x_word; x < word_end(x_word, g->width); x++) {
+                const bool alive = update_cell(g, prev, next, x, y, birth, survival);
+                word |= (uint64_t)alive << (x - x_word);
+                before |= (uint64_t)(row[x] == LIVE_CELL) << (x - x_word);
+            }
+            hash += hash_word(word, first_word_of_row(g, y) + (x_word / 64));
+            census_add_word(&census, before, word, g->first_column + x_word, g->first_row + y);
+        }
+        row_hashes[y] = hash;
+        if (row_census != NULL) {
+            row_census[y] = census;
+        }
+    }
+}
+
+void update_rows(
+    const struct grid* const g,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    RULE_DISPATCH_MASKS(&g->rule, update_rows_rule, g, prev, next, y_start, y_end, row_hashes, row_census);
+}
+
+void update_cells(const struct grid* const g, uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census)
+{
+    update_rows(g, prev, next, 0, g->height, row_hashes, row_census);
+}
+
+static inline __attribute__((always_inline)) bool cell_is_alive(const uint32_t cell, const uint8_t num_neighbors, const unsigned int birth, const unsigned int survival)
+{
+    return ((((cell == LIVE_CELL) ? survival : birth) >> num_neighbors) & 1) != 0;
+}
+
+// Unpacks num_cells cells from words laid out like a bitgrid row, such as a
+// row of random cells. num_cells is a multiple of 16, so the SIMD versions
+// have no tails.
+void expand_cells(const uint64_t* const words, uint32_t* const cells, const size_t num_cells)
+{
+    for (size_t x = 0; x < num_cells; x++) {
+        cells[x] = ((words[x / 64] >> (x % 64)) & 1) ? LIVE_CELL : DEAD_CELL;
+    }
+}
+
+static inline __attribute__((always_inline)) void apply_counts(
+    const struct grid* const g,
+    uint32_t* const cells,
+    const uint32_t* const neighbor_counts,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * g->stride;
+        uint64_t hash = 0;
+        struct census census;
+        census_clear(&census);
+        for (size_t x_word = 0; x_word < g->width; x_word += 64) {
+            uint64_t word = 0;
+            uint64_t before = 0;
+            for (size_t x = x_word; x < word_end(x_word, g->width); x++) {
+                const size_t i = row + x;
+                const uint8_t num_neighbors = (uint8_t)neighbor_counts[i];
+                const bool alive = cell_is_alive(cells[i], num_neighbors, birth, survival);
+                before |= (uint64_t)(cells[i] == LIVE_CELL) << (x - x_word);
+                cells[i] = alive ? LIVE_CELL : DEAD_CELL;
+                word |= (uint64_t)alive << (x - x_word);
+            }
+            hash += hash_word(word, first_word_of_row(g, y) + (x_word / 64));
+            census_add_word(&census, before, word, g->first_column + x_word, g->first_row + y);
+        }
+        row_hashes[y] = hash;
+        if (row_census != NULL) {
+            row_census[y] = census;
+        }
+    }
+}
+
+// Counts the neighbors of rows y_start to y_end one direction at a time.
+// Only the counts of those rows are written, so bands of rows can be
+// counted at once, as long as all of them are counted before any cells are
+// updated.
+static void count_rows_alt(
+    const struct grid* const g,
+    const uint32_t* const cells,
+    uint32_t* const neighbor_counts,
+    const size_t y_start,
+    const size_t y_end)
+{
+    const size_t stride = g->stride;
+    // Each neighbor of cell i, which the halo rows and padding keep in bounds
+    const uint32_t* const up_left = cells - stride - 1;
+    const uint32_t* const up = cells - stride;
+    const uint32_t* const up_right = cells - stride + 1;
+    const uint32_t* const left = cells - 1;
+    const uint32_t* const right = cells + 1;
+    const uint32_t* const down_left = cells + stride - 1;
+    const uint32_t* const down = cells + stride;
+    const uint32_t* const down_right = cells + stride + 1;
+
+    // Up left
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * stride;
+        for (size_t x = 0; x < g->width; x++) {
+            const size_t i = row + x;
+            neighbor_counts[i] = (up_left[i] == LIVE_CELL);
+        }
+    }
+
+    // Up
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * stride;
+        for (size_t x = 0; x < g->width; x++) {
+            const size_t i = row + x;
+            neighbor_counts[i] += (up[i] == LIVE_CELL);
+        }
+    }
+
+    // Up right
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * stride;
+        for (size_t x = 0; x < g->width; x++) {
+            const size_t i = row + x;
+            neighbor_counts[i] += (up_right[i] == LIVE_CELL);
+        }
+    }
+
+    // Left
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * stride;
+        for (size_t x = 0; x < g->width; x++) {
+            const size_t i = row + x;
+            neighbor_counts[i] += (left[i] == LIVE_CELL);
+        }
+    }
+
+    // Right
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * stride;
+        for (size_t x = 0; x < g->width; x++) {
+            const size_t i = row + x;
+            neighbor_counts[i] += (right[i] == LIVE_CELL);
+        }
+    }
+
+    // Down left
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * stride;
+        for (size_t x = 0; x < g->width; x++) {
+            const size_t i = row + x;
+            neighbor_counts[i] += (down_left[i] == LIVE_CELL);
+        }
+    }
+
+    // Down
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * stride;
+        for (size_t x = 0; x < g->width; x++) {
+            const size_t i = row + x;
+            neighbor_counts[i] += (down[i] == LIVE_CELL);
+        }
+    }
+
+    // Down right
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * stride;
+        for (size_t x = 0; x < g->width; x++) {
+            const size_t i = row + x;
+            neighbor_counts[i] += (down_right[i] == LIVE_CELL);
+        }
+    }
+}
+
+static void apply_rows_alt(
+    const struct grid* const g,
+    uint32_t* const cells,
+    const uint32_t* const neighbor_counts,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    RULE_DISPATCH_MASKS(&g->rule, apply_counts, g, cells, neighbor_counts, y_start, y_end, row_hashes, row_census);
+}
+
+// Counts the neighbors one direction at a time, then updates the cells in
+// place. It is kept as a point of comparison for the benchmark.
+void update_cells_alt(
+    const struct grid* const g,
+    uint32_t* const cells,
+    uint32_t* const neighbor_counts,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    count_rows_alt(g, cells, neighbor_counts, 0, g->height);
+    apply_rows_alt(g, cells, neighbor_counts, 0, g->height, row_hashes, row_census);
+}
+
+// The block lookup kernel steps 2x2 cells at a time by looking up the 4x4
+// block around them. Bit (column * 4) + row of an index is the cell at that
+// column and row of the block, and bits 0, 1, 2 and 3 of the entry are the
+// next states of its top left, top right, bottom left and bottom right
+// center cells. The table is built for the rule of a grid by
+// cell_kernel_prepare, before any thread steps the grid, and only read after
+// that.
+#define LOOKUP_TABLE_SIZE (1 << 16)
+
+static void build_lookup_table(const struct rule* const rule, uint8_t* const table)
+{
+    for (unsigned int index = 0; index < LOOKUP_TABLE_SIZE; index++) {
+        uint8_t entry = 0;
+        for (unsigned int i = 0; i < 4; i++) {
+            const unsigned int col = 1 + (i & 1);
+            const unsigned int row = 1 + (i >> 1);
+            unsigned int num_neighbors = 0;
+            for (unsigned int dc = 0; dc < 3; dc++) {
+                for (unsigned int dr = 0; dr < 3; dr++) {
+                    num_neighbors += (index >> (((col + dc - 1) * 4) + (row + dr - 1))) & 1;
+                }
+            }
+            const bool alive = (index >> ((col * 4) + row)) & 1;
+            num_neighbors -= alive;
+            entry |= (uint8_t)(rule_next(rule, alive, num_neighbors) << i);
+        }
+        table[index] = entry;
+    }
+}
+
+// Four cells of a column of the block as four bits, top first. The bottom
+// row is NULL past the last row of the grid.
+static inline unsigned int block_column(const uint32_t* const rows[4], const ptrdiff_t x)
+{
+    return (unsigned int)(rows[0][x] == LIVE_CELL)
+         | ((unsigned int)(rows[1][x] == LIVE_CELL) << 1)
+         | ((unsigned int)(rows[2][x] == LIVE_CELL) << 2)
+         | ((unsigned int)((rows[3] != NULL) && (rows[3][x] == LIVE_CELL)) << 3);
+}
+
+// Rows are stepped in pairs and columns two at a time. Sliding the block
+// two columns to the right drops the low byte of the index and brings in
+// two new columns, so each pair of rows reads every cell of four rows once.
+// A band with an odd number of rows steps its last row alone.
+void update_rows_lookup(
+    const struct grid* const g,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    const uint8_t* const table = g->lookup_table;
+    const size_t stride = g->stride;
+    for (size_t y = y_start; y < y_end; y += 2) {
+        const bool pair = (y + 1) < y_end;
+        const uint32_t* const middle = prev + (y * stride);
+        const uint32_t* const rows[4] = {
+            middle - stride,
+            middle,
+            middle + stride,
+            pair ? middle + (2 * stride) : NULL
+        };
+        uint32_t* const top = next + (y * stride);
+        uint32_t* const bottom = top + stride;
+        uint64_t top_hash = 0;
+        uint64_t bottom_hash = 0;
+        struct census top_census;
+        struct census bottom_census;
+        census_clear(&top_census);
+        census_clear(&bottom_census);
+        // The ghost column left of the row and the first column
+        unsigned int index = (block_column(rows, -1) << 8) | (block_column(rows, 0) << 12);
+        for (size_t x_word = 0; x_word < g->width; x_word += 64) {
+            uint64_t top_word = 0;
+            uint64_t bottom_word = 0;
+            uint64_t top_before = 0;
+            uint64_t bottom_before = 0;
+            for (size_t x = x_word; x < word_end(x_word, g->width); x += 2) {
+                index = (index >> 8) | (block_column(rows, (ptrdiff_t)x + 1) << 8) | (block_column(rows, (ptrdiff_t)x + 2) << 12);
+                // The right cell of the last block of an odd width is a ghost
+                // cell
+                const unsigned int in_grid = (x + 1 < g->width) ? 3 : 1;
+                const unsigned int entry = table[index] & ((x + 1 < g->width) ? 0xF : 0x5);
+                top[x] = (entry & 1) ? LIVE_CELL : DEAD_CELL;
+                top_word |= (uint64_t)(entry & 3) << (x - x_word);
+                // The center cells as they were, bits 5 and 9 of the index
+                // for the top row and 6 and 10 for the bottom one
+                top_before |= (uint64_t)((((index >> 5) & 1) | ((index >> 8) & 2)) & in_grid) << (x - x_word);
+                if (pair) {
+                    bottom[x] = (entry & 4) ? LIVE_CELL : DEAD_CELL;
+                    bottom_word |= (uint64_t)(entry >> 2) << (x - x_word);
+                    bottom_before |= (uint64_t)((((index >> 6) & 1) | ((index >> 9) & 2)) & in_grid) << (x - x_word);
+                }
+                if (x + 1 < g->width) {
+                    top[x + 1] = (entry & 2) ? LIVE_CELL : DEAD_CELL;
+                    if (pair) {
+                        bottom[x + 1] = (entry & 8) ? LIVE_CELL : DEAD_CELL;
+                    }
+                }
+            }
+            top_hash += hash_word(top_word, first_word_of_row(g, y) + (x_word / 64));
+            bottom_hash += hash_word(bottom_word, first_word_of_row(g, y + 1) + (x_word / 64));
+            census_add_word(&top_census, top_before, top_word, g->first_column + x_word, g->first_row + y);
+            census_add_word(&bottom_census, bottom_before, bottom_word, g->first_column + x_word, g->first_row + y + 1);
+        }
+        row_hashes[y] = top_hash;
+        if (row_census != NULL) {
+            row_census[y] = top_census;
+        }
+        if (pair) {
+            row_hashes[y + 1] = bottom_hash;
+            if (row_census != NULL) {
+                row_census[y + 1] = bottom_census;
+            }
+        }
+    }
+}
+
+void update_cells_lookup(const struct grid* const g, uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census)
+{
+    update_rows_lookup(g, prev, next, 0, g->height, row_hashes, row_census);
+}
+
+#ifdef __ARM_NEON__
+#define MATCH_COUNT_NEON(count)                                                      \
+    do {                                                                             \
+        if (((birth | survival) >> (count)) & 1) {                                   \
+            const uint32x4_t match = vceqq_u32(num_neighbors_vec, vdupq_n_u32(count)); \
+            if (((birth & survival) >> (count)) & 1) {                               \
+                either = vorrq_u32(either, match);                                   \
+            } else if ((birth >> (count)) & 1) {                                     \
+                born = vorrq_u32(born, match);                                       \
+            } else {                                                                 \
+                survives = vorrq_u32(survives, match);                               \
+            }                                                                        \
+        }                                                                            \
+    } while (0)
+
+static inline __attribute__((always_inline)) void apply_counts_neon(
+    const struct grid* const g,
+    uint32_t* const cells,
+    const uint32_t* const neighbor_counts,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census,
+    const unsigned int birth,
+    const unsigned int survival,
+    const bool lookup)
+{
+    static const uint32_t lanes[4] = {0, 1, 2, 3};
+    static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+    const uint32x4_t lane_vec = vld1q_u32(lanes);
+    const uint32x4_t lane_bits_vec = vld1q_u32(lane_bits);
+    const uint32x4_t width_vec = vdupq_n_u32((uint32_t)g->width);
+    const uint32x4_t live_vec = vdupq_n_u32(LIVE_CELL);
+    const uint32x4_t dead_vec = vdupq_n_u32(DEAD_CELL);
+    const uint32x4_t zero_vec = vdupq_n_u32(0);
+    const uint32x4_t one_vec = vdupq_n_u32(1);
+    const uint32x4_t birth_vec = vdupq_n_u32(birth);
+    const uint32x4_t survival_vec = vdupq_n_u32(survival);
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * g->stride;
+        uint64_t hash = 0;
+        struct census census;
+        census_clear(&census);
+        for (size_t x_word = 0; x_word < g->width; x_word += 64) {
+            uint64_t word = 0;
+            uint64_t before = 0;
+            for (size_t x = x_word; x < word_end(x_word, g->width); x += 4) {
+                const size_t i = row + x;
+                const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i);
+                const uint32x4_t cell_vec = vld1q_u32(cells + i);
+                const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
+                uint32x4_t next_vec;
+                if (lookup) {
+                    // Shifting left by a negative count shifts right
+                    const uint32x4_t masks = vbslq_u32(is_alive_vec, survival_vec, birth_vec);
+                    const int32x4_t shift = vnegq_s32(vreinterpretq_s32_u32(num_neighbors_vec));
+                    next_vec = vtstq_u32(vshlq_u32(masks, shift), one_vec);
+                } else {
+                    uint32x4_t either = zero_vec;
+                    uint32x4_t born = zero_vec;
+                    uint32x4_t survives = zero_vec;
+                    FOR_EACH_COUNT(MATCH_COUNT_NEON);
+                    next_vec = vorrq_u32(either, vorrq_u32(vbicq_u32(born, is_alive_vec), vandq_u32(survives, is_alive_vec)));
+                }
+                const uint32x4_t in_grid_vec = vcltq_u32(vaddq_u32(vdupq_n_u32((uint32_t)x), lane_vec), width_vec);
+                const uint32x4_t should_live_vec = vandq_u32(in_grid_vec, next_vec);
+                const uint32x4_t should_die_vec = vmvnq_u32(should_live_vec);
+                const uint32x4_t new_cell_vec = vorrq_u32(
+                    vandq_u32(should_die_vec, dead_vec),
+                    vandq_u32(should_live_vec, live_vec)
+                );
+                vst1q_u32(cells + i, new_cell_vec);
+                // One bit per live lane, summed across the lanes
+                const uint32x4_t bits_vec = vandq_u32(should_live_vec, lane_bits_vec);
+                const uint32x2_t pairs = vadd_u32(vget_low_u32(bits_vec), vget_high_u32(bits_vec));
+                word |= (uint64_t)vget_lane_u32(vpadd_u32(pairs, pairs), 0) << (x - x_word);
+                const uint32x4_t before_bits_vec = vandq_u32(vandq_u32(in_grid_vec, is_alive_vec), lane_bits_vec);
+                const uint32x2_t before_pairs = vadd_u32(vget_low_u32(before_bits_vec), vget_high_u32(before_bits_vec));
+                before |= (uint64_t)vget_lane_u32(vpadd_u32(before_pairs, before_pairs), 0) << (x - x_word);
+            }
+            hash += hash_word(word, first_word_of_row(g, y) + (x_word / 64));
+            census_add_word(&census, before, word, g->first_column + x_word, g->first_row + y);
+        }
+        row_hashes[y] = hash;
+        if (row_census != NULL) {
+            row_census[y] = census;
+        }
+    }
+}
+
+// The halo rows and padding make every neighbor of every cell addressable,
+// so each pass reads one neighbor of a whole row with no edge cases. Only
+// the counts of rows y_start to y_end are written, as in count_rows_alt.
+static void count_rows_neon(
+    const struct grid* const g,
+    const uint32_t* const cells,
+    uint32_t* const neighbor_counts,
+    const size_t y_start,
+    const size_t y_end)
+{
+    const uint32x4_t live_vec = vdupq_n_u32(LIVE_CELL);
+    const uint32x4_t one_vec = vdupq_n_u32(1);
+    const ptrdiff_t stride = (ptrdiff_t)g->stride;
+    const ptrdiff_t neighbor_offsets[8] = {
+        -stride - 1, -stride, -stride + 1,
+        -1, 1,
+        stride - 1, stride, stride + 1
+    };
+
+    // Up left
+    for (size_t y = y_start; y < y_end; y++) {
+        const size_t row = y * g->stride;
+        for (size_t x = 0; x < g->width; x += 4) {
+            const size_t i = row + x;
+            const uint32x4_t cell_vec = vld1q_u32(cells + i + neighbor_offsets[0]);
+            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
+            vst1q_u32(neighbor_counts + i, vandq_u32(is_alive_vec, one_vec));
+        }
+    }
+
+    // Up, up right, left, right, down left, down, down right
+    for (size_t n = 1; n < 8; n++) {
+        for (size_t y = y_start; y < y_end; y++) {
+            const size_t row = y * g->stride;
+            for (size_t x = 0; x < g->width; x += 4) {
+                const size_t i = row + x;
+                const uint32x4_t cell_vec = vld1q_u32(cells + i + neighbor_offsets[n]);
+                const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
+                const uint32x4_t inc_vec = vandq_u32(is_alive_vec, one_vec);
+                const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i);
+                vst1q_u32(neighbor_counts + i, vaddq_u32(num_neighbors_vec, inc_vec));
+            }
+        }
+    }
+
+}
+
+// Lanes past the right edge are masked back to dead cells
+static void apply_rows_neon(
+    const struct grid* const g,
+    uint32_t* const cells,
+    const uint32_t* const neighbor_counts,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    RULE_DISPATCH(&g->rule, apply_counts_neon, g, cells, neighbor_counts, y_start, y_end, row_hashes, row_census);
+}
+
+void update_cells_neon(
+    const struct grid* const g,
+    uint32_t* const cells,
+    uint32_t* const neighbor_counts,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    count_rows_neon(g, cells, neighbor_counts, 0, g->height);
+    apply_rows_neon(g, cells, neighbor_counts, 0, g->height, row_hashes, row_census);
+}
+
+void expand_cells_neon(const uint64_t* const words, uint32_t* const cells, const size_t num_cells)
+{
+    static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+    const uint32x4_t lane_bits_vec = vld1q_u32(lane_bits);
+    const uint32x4_t live_vec = vdupq_n_u32(LIVE_CELL);
+    const uint32x4_t dead_vec = vdupq_n_u32(DEAD_CELL);
+    for (size_t x = 0; x < num_cells; x += 4) {
+        const uint32x4_t bits_vec = vdupq_n_u32((uint32_t)(words[x / 64] >> (x % 64)) & 0xF);
+        const uint32x4_t is_live_vec = vtstq_u32(bits_vec, lane_bits_vec);
+        vst1q_u32(cells + x, vbslq_u32(is_live_vec, live_vec, dead_vec));
+    }
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+// The x86 kernels are compiled for their instruction set regardless of the
+// -march flags, and are only ever called after select_cell_kernel has
+// checked that the CPU supports them.
+
+// Vectors run to the end of each row and lanes past the right edge of the
+// grid are masked back to dead cells, so there are no scalar tail loops.
+
+#define MATCH_COUNT_AVX2(count)                                                      \
+    do {                                                                             \
+        if (((birth | survival) >> (count)) & 1) {                                   \
+            const __m256i match = _mm256_cmpeq_epi32(sum, _mm256_set1_epi32(-(count))); \
+            if (((birth & survival) >> (count)) & 1) {                               \
+                either = _mm256_or_si256(either, match);                             \
+            } else if ((birth >> (count)) & 1) {                                     \
+                born = _mm256_or_si256(born, match);                                 \
+            } else {                                                                 \
+                survives = _mm256_or_si256(survives, match);                         \
+            }                                                                        \
+        }                                                                            \
+    } while (0)
+
+__attribute__((target("avx2")))
+static inline __attribute__((always_inline)) void update_rows_avx2_rule(
+    const struct grid* const g,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census,
+    const unsigned int birth,
+    const unsigned int survival,
+    const bool lookup)
+{
+    const __m256i live_vec = _mm256_set1_epi32((int)LIVE_CELL);
+    const __m256i dead_vec = _mm256_set1_epi32((int)DEAD_CELL);
+    const __m256i lane_vec = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i width_vec = _mm256_set1_epi32((int)g->width);
+    // Comparison masks are -1 per live cell, so the sums are negative counts
+    const __m256i zero_vec = _mm256_setzero_si256();
+    const __m256i one_vec = _mm256_set1_epi32(1);
+    const __m256i birth_vec = _mm256_set1_epi32((int)birth);
+    const __m256i survival_vec = _mm256_set1_epi32((int)survival);
+    const size_t stride = g->stride;
+
+    for (size_t y = y_start; y < y_end; y++) {
+        const uint32_t* const row = prev + (y * stride);
+        uint32_t* const out = next + (y * stride);
+        uint64_t hash = 0;
+        struct census census;
+        census_clear(&census);
+        for (size_t x_word = 0; x_word < g->width; x_word += 64) {
+            uint64_t word = 0;
+            uint64_t before = 0;
+            for (size_t x = x_word; x < word_end(x_word, g->width); x += 8) {
+                const uint32_t* const above = row + x - stride;
+                const uint32_t* const middle = row + x;
+                const uint32_t* const below = row + x + stride;
+                __m256i sum = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(above - 1)), live_vec);
+                sum = _mm256_add_epi32(sum, _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)above), live_vec));
+                sum = _mm256_add_epi32(sum, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(above + 1)), live_vec));
+                sum = _mm256_add_epi32(sum, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(middle - 1)), live_vec));
+                sum = _mm256_add_epi32(sum, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(middle + 1)), live_vec));
+                sum = _mm256_add_epi32(sum, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(below - 1)), live_vec));
+                sum = _mm256_add_epi32(sum, _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)below), live_vec));
+                sum = _mm256_add_epi32(sum, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(below + 1)), live_vec));
+                const __m256i is_alive_vec = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)middle), live_vec);
+                __m256i next_vec;
+                if (lookup) {
+                    // Each lane shifts its birth or survival mask by its count
+                    const __m256i masks = _mm256_blendv_epi8(birth_vec, survival_vec, is_alive_vec);
+                    const __m256i shifted = _mm256_srlv_epi32(masks, _mm256_sub_epi32(zero_vec, sum));
+                    next_vec = _mm256_cmpeq_epi32(_mm256_and_si256(shifted, one_vec), one_vec);
+                } else {
+                    __m256i either = zero_vec;
+                    __m256i born = zero_vec;
+                    __m256i survives = zero_vec;
+                    FOR_EACH_COUNT(MATCH_COUNT_AVX2);
+                    next_vec = _mm256_or_si256(either, _mm256_or_si256(
+                        _mm256_andnot_si256(is_alive_vec, born),
+                        _mm256_and_si256(is_alive_vec, survives)
+                    ));
+                }
+                const __m256i in_grid_vec = _mm256_cmpgt_epi32(width_vec, _mm256_add_epi32(_mm256_set1_epi32((int)x), lane_vec));
+                const __m256i should_live_vec = _mm256_and_si256(in_grid_vec, next_vec);
+                _mm256_store_si256((__m256i*)(out + x), _mm256_blendv_epi8(dead_vec, live_vec, should_live_vec));
+                word |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(should_live_vec)) << (x - x_word);
+                before |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(in_grid_vec, is_alive_vec))) << (x - x_word);
+            }
+            hash += hash_word(word, first_word_of_row(g, y) + (x_word / 64));
+            census_add_word(&census, before, word, g->first_column + x_word, g->first_row + y);
+        }
+        row_hashes[y] = hash;
+        if (row_census != NULL) {
+            row_census[y] = census;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void update_rows_avx2(
+    const struct grid* const g,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    RULE_DISPATCH(&g->rule, update_rows_avx2_rule, g, prev, next, y_start, y_end, row_hashes, row_census);
+}
+
+void update_cells_avx2(const struct grid* const g, uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census)
+{
+    update_rows_avx2(g, prev, next, 0, g->height, row_hashes, row_census);
+}
+
+__attribute__((target("avx2")))
+void expand_cells_avx2(const uint64_t* const words, uint32_t* const cells, const size_t num_cells)
+{
+    const __m256i live_vec = _mm256_set1_epi32((int)LIVE_CELL);
+    const __m256i dead_vec = _mm256_set1_epi32((int)DEAD_CELL);
+    const __m256i lane_bits_vec = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    for (size_t x = 0; x < num_cells; x += 8) {
+        const __m256i bits_vec = _mm256_set1_epi32((int)((words[x / 64] >> (x % 64)) & 0xFF));
+        const __m256i is_live_vec = _mm256_cmpeq_epi32(_mm256_and_si256(bits_vec, lane_bits_vec), lane_bits_vec);
+        _mm256_store_si256((__m256i*)(cells + x), _mm256_blendv_epi8(dead_vec, live_vec, is_live_vec));
+    }
+}
+
+#define MATCH_COUNT_AVX512(count)                                                    \
+    do {                                                                             \
+        if (((birth | survival) >> (count)) & 1) {                                   \
+            const __mmask16 match = _mm512_cmpeq_epi32_mask(sum, _mm512_set1_epi32(count)); \
+            if (((birth & survival) >> (count)) & 1) {                               \
+                either |= match;                                                     \
+            } else if ((birth >> (count)) & 1) {                                     \
+                born |= match;                                                       \
+            } else {                                                                 \
+                survives |= match;                                                   \
+            }                                                                        \
+        }                                                                            \
+    } while (0)
+
+__attribute__((target("avx512f")))
+static inline __attribute__((always_inline)) void update_rows_avx512_rule(
+    const struct grid* const g,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census,
+    const unsigned int birth,
+    const unsigned int survival,
+    const bool lookup)
+{
+    const __m512i live_vec = _mm512_set1_epi32((int)LIVE_CELL);
+    const __m512i dead_vec = _mm512_set1_epi32((int)DEAD_CELL);
+    const __m512i one_vec = _mm512_set1_epi32(1);
+    const __m512i birth_vec = _mm512_set1_epi32((int)birth);
+    const __m512i survival_vec = _mm512_set1_epi32((int)survival);
+    const __m512i lane_vec = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i width_vec = _mm512_set1_epi32((int)g->width);
+    const size_t stride = g->stride;
+
+    for (size_t y = y_start; y < y_end; y++) {
+        const uint32_t* const row = prev + (y * stride);
+        uint32_t* const out = next + (y * stride);
+        uint64_t hash = 0;
+        struct census census;
+        census_clear(&census);
+        for (size_t x_word = 0; x_word < g->width; x_word += 64) {
+            uint64_t word = 0;
+            uint64_t before = 0;
+            for (size_t x = x_word; x < word_end(x_word, g->width); x += 16) {
+                const uint32_t* const middle = row + x;
+                const uint32_t* const neighbors[8] = {
+                    middle - stride - 1, middle - stride, middle - stride + 1,
+                    middle - 1, middle + 1,
+                    middle + stride - 1, middle + stride, middle + stride + 1
+                };
+                __m512i sum = _mm512_setzero_si512();
+                for (size_t n = 0; n < 8; n++) {
+                    const __mmask16 is_live = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(neighbors[n]), live_vec);
+                    sum = _mm512_mask_add_epi32(sum, is_live, sum, one_vec);
+                }
+                const __mmask16 in_grid = _mm512_cmpgt_epu32_mask(width_vec, _mm512_add_epi32(_mm512_set1_epi32((int)x), lane_vec));
+                const __mmask16 is_alive = _mm512_cmpeq_epi32_mask(_mm512_load_si512(middle), live_vec);
+                __mmask16 next_mask;
+                if (lookup) {
+                    // Each lane shifts its birth or survival mask by its count
+                    const __m512i masks = _mm512_mask_blend_epi32(is_alive, birth_vec, survival_vec);
+                    next_mask = _mm512_test_epi32_mask(_mm512_srlv_epi32(masks, sum), one_vec);
+                } else {
+                    __mmask16 either = 0;
+                    __mmask16 born = 0;
+                    __mmask16 survives = 0;
+                    FOR_EACH_COUNT(MATCH_COUNT_AVX512);
+                    next_mask = either | (born & (__mmask16)~is_alive) | (survives & is_alive);
+                }
+                const __mmask16 should_live = in_grid & next_mask;
+                _mm512_store_si512(out + x, _mm512_mask_blend_epi32(should_live, dead_vec, live_vec));
+                word |= (uint64_t)should_live << (x - x_word);
+                before |= (uint64_t)(in_grid & is_alive) << (x - x_word);
+            }
+            hash += hash_word(word, first_word_of_row(g, y) + (x_word / 64));
+            census_add_word(&census, before, word, g->first_column + x_word, g->first_row + y);
+        }
+        row_hashes[y] = hash;
+        if (row_census != NULL) {
+            row_census[y] = census;
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+void update_rows_avx512(
+    const struct grid* const g,
+    const uint32_t* const prev,
+    uint32_t* const next,
+    const size_t y_start,
+    const size_t y_end,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    RULE_DISPATCH(&g->rule, update_rows_avx512_rule, g, prev, next, y_start, y_end, row_hashes, row_census);
+}
+
+void update_cells_avx512(const struct grid* const g, uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census)
+{
+    update_rows_avx512(g, prev, next, 0, g->height, row_hashes, row_census);
+}
+
+__attribute__((target("avx512f")))
+void expand_cells_avx512(const uint64_t* const words, uint32_t* const cells, const size_t num_cells)
+{
+    const __m512i live_vec = _mm512_set1_epi32((int)LIVE_CELL);
+    const __m512i dead_vec = _mm512_set1_epi32((int)DEAD_CELL);
+    for (size_t x = 0; x < num_cells; x += 16) {
+        const __mmask16 is_live = (__mmask16)(words[x / 64] >> (x % 64));
+        _mm512_store_si512(cells + x, _mm512_mask_blend_epi32(is_live, dead_vec, live_vec));
+    }
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+// __builtin_cpu_supports reads cpuid and also checks that the OS saves the
+// wider registers
+static bool cpu_has_avx512(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+static bool cpu_has_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+static bool cpu_has_baseline(void)
+{
+    return true;
+}
+
+// Ordered from most to least preferred
+const struct cell_kernel cell_kernels[] = {
+#ifdef __ARM_NEON__
+    {
+        .name = "NEON",
+        .update = update_cells_neon,
+        .update_rows = NULL,
+        .count_rows = count_rows_neon,
+        .apply_rows = apply_rows_neon,
+        .expand = expand_cells_neon,
+        .in_place = true,
+        .is_supported = cpu_has_baseline
+    },
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    {
+        .name = "AVX-512",
+        .update = update_cells_avx512,
+        .update_rows = update_rows_avx512,
+        .count_rows = NULL,
+        .apply_rows = NULL,
+        .expand = expand_cells_avx512,
+        .in_place = false,
+        .is_supported = cpu_has_avx512
+    },
+    {
+        .name = "AVX2",
+        .update = update_cells_avx2,
+        .update_rows = update_rows_avx2,
+        .count_rows = NULL,
+        .apply_rows = NULL,
+        .expand = expand_cells_avx2,
+        .in_place = false,
+        .is_supported = cpu_has_avx2
+    },
+#endif
+    {
+        .name = "scalar",
+        .update = update_cells,
+        .update_rows = update_rows,
+        .count_rows = NULL,
+        .apply_rows = NULL,
+        .expand = expand_cells,
+        .in_place = false,
+        .is_supported = cpu_has_baseline
+    }
+};
+const size_t num_cell_kernels = sizeof(cell_kernels) / sizeof(cell_kernels[0]);
+
+// Never picked by select_cell_kernel
+const struct cell_kernel alt_cell_kernel = {
+    .name = "scalar-alt",
+    .update = update_cells_alt,
+    .update_rows = NULL,
+    .count_rows = count_rows_alt,
+    .apply_rows = apply_rows_alt,
+    .expand = expand_cells,
+    .in_place = true,
+    .is_supported = cpu_has_baseline
+};
+
+// Never picked by select_cell_kernel
+const struct cell_kernel lookup_cell_kernel = {
+    .name = "lookup",
+    .update = update_cells_lookup,
+    .update_rows = update_rows_lookup,
+    .count_rows = NULL,
+    .apply_rows = NULL,
+    .expand = expand_cells,
+    .in_place = false,
+    .is_supported = cpu_has_baseline
+};
+
+// Sets up whatever kernel needs for stepping g, which for the lookup kernel
+// is a table for the rule of g. Copies of g share the table, and whoever
+// prepared g releases it once they are done stepping.
+bool cell_kernel_prepare(const struct cell_kernel* const kernel, struct grid* const g)
+{
+    g->lookup_table = NULL;
+    if (kernel != &lookup_cell_kernel) {
+        return true;
+    }
+    uint8_t* const table = malloc(LOOKUP_TABLE_SIZE);
+    if (table == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for the lookup table.\n");
+        return false;
+    }
+    build_lookup_table(&g->rule, table);
+    g->lookup_table = table;
+    return true;
+}
+
+void cell_kernel_release(struct grid* const g)
+{
+    free((void*)g->lookup_table);
+    g->lookup_table = NULL;
+}
+
+struct update_args {
+    const struct cell_kernel* kernel;
+    const struct grid* g;
+    uint32_t* prev;
+    uint32_t* next;
+    uint64_t* row_hashes;
+    struct census* row_census;
+};
+
+static void update_band(void* const ctx, const size_t y_start, const size_t y_end)
+{
+    const struct update_args* const args = ctx;
+    args->kernel->update_rows(args->g, args->prev, args->next, y_start, y_end, args->row_hashes, args->row_census);
+}
+
+static void count_band(void* const ctx, const size_t y_start, const size_t y_end)
+{
+    const struct update_args* const args = ctx;
+    args->kernel->count_rows(args->g, args->prev, args->next, y_start, y_end);
+}
+
+static void apply_band(void* const ctx, const size_t y_start, const size_t y_end)
+{
+    const struct update_args* const args = ctx;
+    args->kernel->apply_rows(args->g, args->prev, args->next, y_start, y_end, args->row_hashes, args->row_census);
+}
+
+// In-place kernels count every band before they update any, as a band reads
+// the rows next to it. Kernels that can do neither run on the calling
+// thread.
+void update_cells_parallel(
+    struct thread_pool* const pool,
+    const struct cell_kernel* const kernel,
+    const struct grid* const g,
+    uint32_t* const cells,
+    uint32_t* const buf,
+    uint64_t* const row_hashes,
+    struct census* const row_census)
+{
+    struct update_args args = {
+        .kernel = kernel,
+        .g = g,
+        .prev = cells,
+        .next = buf,
+        .row_hashes = row_hashes,
+        .row_census = row_census
+    };
+    if (kernel->update_rows != NULL) {
+        pool_run_rows(pool, update_band, &args, g->height, g->stride * sizeof(uint32_t));
+    } else if (kernel->count_rows != NULL) {
+        pool_run_rows(pool, count_band, &args, g->height, g->stride * sizeof(uint32_t));
+        pool_run_rows(pool, apply_band, &args, g->height, g->stride * sizeof(uint32_t));
+    } else {
+        kernel->update(g, cells, buf, row_hashes, row_census);
+    }
+}
+
+// Finds a kernel by name, among those this CPU supports
+const struct cell_kernel* find_cell_kernel(const char* const name)
+{
+    const struct cell_kernel* const extra[] = {&alt_cell_kernel, &lookup_cell_kernel};
+    for (size_t i = 0; i < num_cell_kernels + 2; i++) {
+        const struct cell_kernel* const kernel = (i < num_cell_kernels) ? &cell_kernels[i] : extra[i - num_cell_kernels];
+        if ((strcmp(kernel->name, name) == 0) && kernel->is_supported()) {
+            return kernel;
+        }
+    }
+    return NULL;
+}
+
+const struct cell_kernel* select_cell_kernel(void)
+{
+#ifdef USE_SIMD
+    for (size_t i = 0; i < num_cell_kernels; i++) {
+        if (cell_kernels[i].is_supported()) {
+            return &cell_kernels[i];
+        }
+    }
+#endif
+    return &cell_kernels[num_cell_kernels - 1];
+}
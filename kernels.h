@@ -0,0 +1,63 @@
+#ifndef kernels_h
+#define kernels_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "grid.h"
+#include "pool.h"
+#include "census.h"
+
+// A kernel either steps prev into next, or (when in_place is set) steps the
+// first buffer in place and uses the second one as scratch space. Only
+// double-buffered kernels can step a range of rows on its own. An in-place
+// kernel can instead have count_rows, which counts the neighbors of a range
+// of rows into the scratch space, reading only the cells, and apply_rows,
+// which then updates that range. Either way, the hash of each row it steps
+// goes to row_hashes, which has one entry per row of the grid, and the
+// census of the row to row_census, unless it is NULL. expand unpacks
+// bitgrid words into cells, such as those of a random board.
+struct cell_kernel {
+    const char* const name;
+    void (*const update)(const struct grid* const g, uint32_t* const cells, uint32_t* const buf, uint64_t* const row_hashes, struct census* const row_census);
+    void (*const update_rows)(const struct grid* const g, const uint32_t* const prev, uint32_t* const next, const size_t y_start, const size_t y_end, uint64_t* const row_hashes, struct census* const row_census);
+    void (*const count_rows)(const struct grid* const g, const uint32_t* const cells, uint32_t* const buf, const size_t y_start, const size_t y_end);
+    void (*const apply_rows)(const struct grid* const g, uint32_t* const cells, const uint32_t* const buf, const size_t y_start, const size_t y_end, uint64_t* const row_hashes, struct census* const row_census);
+    void (*const expand)(const uint64_t* const words, uint32_t* const cells, const size_t num_cells);
+    const bool in_place;
+    bool (*const is_supported)(void);
+};
+
+extern const struct cell_kernel cell_kernels[];
+extern const size_t num_cell_kernels;
+extern const struct cell_kernel alt_cell_kernel;
+extern const struct cell_kernel lookup_cell_kernel;
+
+const struct cell_kernel* select_cell_kernel(void);
+const struct cell_kernel* find_cell_kernel(const char* const name);
+bool cell_kernel_prepare(const struct cell_kernel* const kernel, struct grid* const g);
+void cell_kernel_release(struct grid* const g);
+void update_cells_parallel(struct thread_pool* const pool, const struct cell_kernel* const kernel, const struct grid* const g, uint32_t* const cells, uint32_t* const buf, uint64_t* const row_hashes, struct census* const row_census);
+
+void update_cells(const struct grid* const g, uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census);
+void update_rows(const struct grid* const g, const uint32_t* const prev, uint32_t* const next, const size_t y_start, const size_t y_end, uint64_t* const row_hashes, struct census* const row_census);
+void expand_cells(const uint64_t* const words, uint32_t* const cells, const size_t num_cells);
+void update_cells_alt(const struct grid* const g, uint32_t* const cells, uint32_t* const neighbor_counts, uint64_t* const row_hashes, struct census* const row_census);
+void update_cells_lookup(const struct grid* const g, uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census);
+void update_rows_lookup(const struct grid* const g, const uint32_t* const prev, uint32_t* const next, const size_t y_start, const size_t y_end, uint64_t* const row_hashes, struct census* const row_census);
+
+#ifdef __ARM_NEON__
+void update_cells_neon(const struct grid* const g, uint32_t* const cells, uint32_t* const neighbor_counts, uint64_t* const row_hashes, struct census* const row_census);
+void expand_cells_neon(const uint64_t* const words, uint32_t* const cells, const size_t num_cells);
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+void update_cells_avx2(const struct grid* const g, uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census);
+void update_rows_avx2(const struct grid* const g, const uint32_t* const prev, uint32_t* const next, const size_t y_start, const size_t y_end, uint64_t* const row_hashes, struct census* const row_census);
+void expand_cells_avx2(const uint64_t* const words, uint32_t* const cells, const size_t num_cells);
+void update_cells_avx512(const struct grid* const g, uint32_t* const prev, uint32_t* const next, uint64_t* const row_hashes, struct census* const row_census);
+void update_rows_avx512(const struct grid* const g, const uint32_t* const prev, uint32_t* const next, const size_t y_start, const size_t y_end, uint64_t* const row_hashes, struct census* const row_census);
+void expand_cells_avx512(const uint64_t* const words, uint32_t* const cells, const size_t num_cells);
+#endif
+
+#endif
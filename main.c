@@ -1,108 +1,1236 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <time.h>
-#include <fcntl.h>
-#include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#ifndef HEADLESS
+#include <pthread.h>
+#include <stdatomic.h>
 #include <SDL2/SDL.h>
 #include "graphics.h"
+#include "frames.h"
+#endif
 #include "timing.h"
+#include "grid.h"
+#include "pool.h"
+#include "sim.h"
+#include "profile.h"
+#include "cycle.h"
+#include "domain.h"
+#include "ensemble.h"
+#include "census.h"
+
+#define DEFAULT_GRID_WIDTH         640
+#define DEFAULT_GRID_HEIGHT        480
+#define DEFAULT_REPORT_GENERATIONS 500
+#define DEFAULT_HEADLESS_GENERATIONS 1000
+#define DEFAULT_HASHLIFE_STEP_LOG2 0
+#define DEFAULT_CHECKPOINT_EVERY   10000
+#define DEFAULT_PROFILE_EVERY      10
+#define DEFAULT_KEYFRAME_EVERY     1000
+
+struct options {
+    size_t grid_width;
+    size_t grid_height;
+    enum boundary boundary;
+    struct rule rule;
+    bool rule_given;
+    size_t window_width;
+    size_t window_height;
+    size_t num_threads;
+    struct sim_config sim;
+    size_t report_generations;
+    struct board_seed seed;
+    bool seed_given;
+    bool headless;
+    size_t generations;
+    const char* pattern_path;
+    int64_t pattern_x;
+    int64_t pattern_y;
+    const char* checkpoint_path;
+    size_t checkpoint_every;
+    const struct checkpoint* restore;
+    const char* record_path;
+    size_t keyframe_every;
+    const char* census_path;
+    struct replay* replay;
+    uint64_t seek;
+    bool seek_given;
+    size_t num_workers;
+    enum transport transport;
+    uint64_t num_universes;
+    const char* results_path;
+    double rate;
+    const char* profile_path;
+    size_t profile_every;
+    bool overlay;
+    enum cycle_action on_cycle;
+};
+
+// Checkpoints are taken every checkpoint_every generations, and skipped when
+// the last one is still being written
+struct checkpoints {
+    struct checkpoint_writer writer;
+    uint64_t next_generation;
+    bool enabled;
+};
 
-#define USE_SIMD
-#define LIVE_CELL 0xFF000000
-#define DEAD_CELL 0xFFFFFFFF
+// Every generation is recorded when record_path is set
+struct recording {
+    struct recorder rec;
+    bool enabled;
+};
 
-void update_cells(uint32_t prev[const static NUM_PIXELS], uint32_t next[const static NUM_PIXELS]);
-//void update_cells_alt(uint32_t cells[const static NUM_PIXELS], uint32_t neighbor_counts[const static NUM_PIXELS]);
-inline bool cell_is_alive(const uint32_t cell, const uint8_t num_neighbors);
+// The census of every step is logged when census_path is set
+struct census_series {
+    struct census_log log;
+    bool enabled;
+};
 
-#ifdef __ARM_NEON__
-#include <arm_neon.h>
-void update_cells_neon(uint32_t cells[const static NUM_PIXELS], uint32_t neighbor_counts[const static NUM_PIXELS]);
+static int print_scaling_report(const struct options* const opts);
+static int run_headless(const struct options* const opts);
+static int run_replay_headless(const struct options* const opts);
+static int run_domain_headless(const struct options* const opts);
+static int print_domain_report(const struct options* const opts);
+static int run_ensemble(const struct options* const opts);
+#ifndef HEADLESS
+static int run_window(const struct options* const opts);
+static int run_replay_window(const struct options* const opts);
+static int run_domain_window(const struct options* const opts);
 #endif
 
-int main(void)
+// Restores the checkpoint or loads the pattern file if there is one, and
+// random cells otherwise
+static bool seed_sim(struct simulation* const sim, struct thread_pool* const pool, const struct options* const opts)
+{
+    if (opts->restore != NULL) {
+        if (!sim_restore(sim, pool, opts->restore)) {
+            return false;
+        }
+        printf("Restored generation %" PRIu64 "\n", sim->generation);
+        return true;
+    }
+    if (opts->pattern_path == NULL) {
+        // Runs without a seed get a new one, which is printed so that they
+        // can be repeated
+        struct board_seed seed = opts->seed;
+        if (!opts->seed_given && !random_seed(&seed.seed)) {
+            return false;
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!sim_randomize(sim, pool, &seed)) {
+            return false;
+        }
+        struct timespec stop;
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        printf("Seeded with %" PRIu64 " at density %.3f in %.3f s\n",
+               seed.seed,
+               seed.density,
+               (double)get_time_diff_ns(&start, &stop) / NS_PER_S);
+        return true;
+    }
+    struct pattern_stats stats;
+    if (!sim_load_pattern(sim, opts->pattern_path, opts->pattern_x, opts->pattern_y, &stats)) {
+        return false;
+    }
+    const double megabytes = (double)stats.num_bytes / (1024.0 * 1024.0);
+    const double seconds = (double)stats.elapsed_ns / NS_PER_S;
+    printf("Loaded %s (%s): %" PRIu64 " live cells, %.1f MB in %.3f s (%.1f MB/s)\n",
+           opts->pattern_path,
+           pattern_format_name(stats.format),
+           stats.num_live,
+           megabytes,
+           seconds,
+           megabytes / seconds);
+    return true;
+}
+
+static bool checkpoints_start(struct checkpoints* const cps, const struct options* const opts, const struct simulation* const sim)
 {
-    struct sdl_graphics gfx = init_graphics("Conway's Game of Life");
+    cps->enabled = opts->checkpoint_path != NULL;
+    if (!cps->enabled) {
+        return true;
+    }
+    cps->next_generation = ((sim->generation / opts->checkpoint_every) + 1) * opts->checkpoint_every;
+    return checkpoint_writer_start(&cps->writer, opts->checkpoint_path, sim->g.width, sim->g.height, sim->g.boundary, &sim->g.rule);
+}
 
-    // Create the cell buffers
-    uint32_t* const cellbuf1 = malloc(NUM_BYTES_IN_TEXTURE);
-#if defined(USE_SIMD) && defined(__ARM_NEON__)
-    uint32_t* const neighbor_counts = malloc(NUM_BYTES_IN_TEXTURE);
-    if ((cellbuf1 == NULL) || (neighbor_counts == NULL)) {
-#else
-    uint32_t* const cellbuf2 = malloc(NUM_BYTES_IN_TEXTURE);
-    if ((cellbuf1 == NULL) || (cellbuf2 == NULL)) {
+static void checkpoints_update(struct checkpoints* const cps, const struct options* const opts, struct simulation* const sim)
+{
+    if (!cps->enabled || (sim->generation < cps->next_generation)) {
+        return;
+    }
+    sim_checkpoint(sim, &cps->writer, false);
+    cps->next_generation = ((sim->generation / opts->checkpoint_every) + 1) * opts->checkpoint_every;
+}
+
+// Writes the last generation and waits for it to be on disk
+static void checkpoints_finish(struct checkpoints* const cps, struct simulation* const sim)
+{
+    if (!cps->enabled) {
+        return;
+    }
+    sim_checkpoint(sim, &cps->writer, true);
+    checkpoint_writer_stop(&cps->writer);
+    printf("Checkpoints: %zu written, %zu skipped, last %.1f KB in %.3f s\n",
+           cps->writer.num_written,
+           cps->writer.num_skipped,
+           (double)cps->writer.last_num_bytes / 1024.0,
+           (double)cps->writer.last_elapsed_ns / NS_PER_S);
+}
+
+// Starts with the generation the simulation was seeded with
+static bool recording_start(struct recording* const rec, const struct options* const opts, struct simulation* const sim)
+{
+    rec->enabled = opts->record_path != NULL;
+    if (!rec->enabled) {
+        return true;
+    }
+    if (!recorder_start(&rec->rec, opts->record_path, sim->g.width, sim->g.height, sim->g.boundary, &sim->g.rule, opts->keyframe_every)) {
+        return false;
+    }
+    sim_record(sim, &rec->rec);
+    return true;
+}
+
+static void recording_update(struct recording* const rec, struct simulation* const sim)
+{
+    if (rec->enabled) {
+        sim_record(sim, &rec->rec);
+    }
+}
+
+// Writes the generations still queued and the keyframe index
+static void recording_finish(struct recording* const rec)
+{
+    if (!rec->enabled || !recorder_stop(&rec->rec)) {
+        return;
+    }
+    printf("Recording:   %zu generations, %zu keyframes, %.1f MB (%.2f%% of the bitgrids), %.0f ns/generation to encode, %zu waits\n",
+           rec->rec.num_frames,
+           rec->rec.num_keyframes,
+           (double)rec->rec.num_bytes / (1024.0 * 1024.0),
+           100.0 * (double)rec->rec.num_bytes / (double)rec->rec.raw_bytes,
+           (double)rec->rec.encode_ns / (double)rec->rec.num_frames,
+           rec->rec.num_waits);
+}
+
+static bool census_series_start(struct census_series* const series, const struct options* const opts, const struct simulation* const sim)
+{
+    series->enabled = opts->census_path != NULL;
+    return !series->enabled || census_log_open(&series->log, opts->census_path, sim->g.width, sim->g.height);
+}
+
+static void census_series_update(struct census_series* const series, const struct simulation* const sim)
+{
+    if (series->enabled) {
+        census_log_write(&series->log, sim->generation, &sim->census);
+    }
+}
+
+static void census_series_finish(struct census_series* const series)
+{
+    if (series->enabled) {
+        census_log_close(&series->log);
+    }
+}
+
+// The census the last step took, which the hashlife engine does not take
+static void print_census(const struct simulation* const sim)
+{
+    const struct census* const c = &sim->census;
+    if ((sim->engine == ENGINE_HASHLIFE) || (sim->generation == 0)) {
+        return;
+    }
+    if (c->population == 0) {
+        printf("Census:      no live cells, %" PRIu64 " deaths in the last step\n", c->deaths);
+        return;
+    }
+    printf("Census:      %" PRIu64 " live cells in %" PRIu64 "x%" PRIu64 " at %" PRId64 ",%" PRId64 ", %" PRIu64 " births and %" PRIu64 " deaths in the last step\n",
+           c->population, c->x_end - c->x_min, c->y_end - c->y_min, (int64_t)c->x_min, (int64_t)c->y_min, c->births, c->deaths);
+}
+
+// Writes a single checkpoint of a grid that is not being stepped and waits
+// for it to be on disk
+static bool write_checkpoint(const char* const path, const struct bitgrid* const grid, const uint64_t generation)
+{
+    struct checkpoint_writer writer;
+    if (!checkpoint_writer_start(&writer, path, grid->width, grid->height, grid->boundary, &grid->rule)) {
+        return false;
+    }
+    checkpoint_writer_submit(&writer, grid, generation, true);
+    checkpoint_writer_stop(&writer);
+    if (writer.num_written == 0) {
+        return false;
+    }
+    printf("Checkpoint:  generation %" PRIu64 " written to %s\n", generation, path);
+    return true;
+}
+
+// Workers share the threads out between them
+static size_t threads_per_worker(const struct options* const opts)
+{
+    return (opts->num_threads > opts->num_workers) ? opts->num_threads / opts->num_workers : 1;
+}
+
+// Seeds the whole grid as a bitgrid, which the workers are forked with a
+// copy of and expand their slabs from. The seeding threads are gone by the
+// time the workers are forked.
+static bool start_domain(struct domain* const d, const struct grid* const g, const struct options* const opts)
+{
+    const struct sim_config config = {
+        .engine = ENGINE_BITGRID
+    };
+    struct simulation start;
+    if (!sim_create(&start, g, &config)) {
+        return false;
+    }
+    struct thread_pool pool;
+    if (!pool_create(&pool, opts->num_threads)) {
+        sim_destroy(&start);
+        return false;
+    }
+    const bool seeded = seed_sim(&start, &pool, opts);
+    pool_destroy(&pool);
+    const struct cell_kernel* const kernel = (opts->sim.kernel != NULL) ? opts->sim.kernel : select_cell_kernel();
+    const bool started = seeded && domain_start(d, g, kernel, opts->num_workers, threads_per_worker(opts), opts->transport, sim_bitgrid(&start), start.generation);
+    sim_destroy(&start);
+    return started;
+}
+
+// Rewrites the profile every profile_every seconds
+static void profile_update(const struct profile* const profile, const struct options* const opts, struct timespec* const last_dump, const struct timespec* const now)
+{
+    if ((opts->profile_path == NULL) || (get_time_diff_ns(last_dump, now) < (int64_t)opts->profile_every * NS_PER_S)) {
+        return;
+    }
+    profile_dump(profile, opts->profile_path);
+    *last_dump = *now;
+}
+
+static void profile_finish(const struct profile* const profile, const struct options* const opts)
+{
+    if (opts->profile_path == NULL) {
+        return;
+    }
+    profile_dump(profile, opts->profile_path);
+    profile_print(profile);
+}
+
+static void print_usage(const char* const program)
+{
+    printf("Usage: %s [options]\n"
+           "  -g, --grid WxH              simulate a W by H grid (default: %dx%d)\n"
+           "  -b, --boundary NAME         dead or torus (default: dead)\n"
+           "      --rule RULE             B/S rule such as B36/S23, or conway, highlife,\n"
+           "                              daynight or seeds (default: the rule of the\n"
+           "                              --pattern, or B3/S23)\n",
+           program,
+           DEFAULT_GRID_WIDTH, DEFAULT_GRID_HEIGHT);
+#ifndef HEADLESS
+    printf("  -w, --window WxH            open a W by H window (default: %dx%d)\n",
+           DEFAULT_GRID_WIDTH, DEFAULT_GRID_HEIGHT);
 #endif
-        fprintf(stderr, "Error: Failed to allocate memory for the cell buffers.\n");
-        end_graphics(&gfx);
-        return EXIT_FAILURE;
+    printf("  -e, --engine NAME           bitgrid, cells, hashlife or plane, an unbounded\n"
+           "                              plane of tiles (default: bitgrid)\n"
+           "      --kernel NAME           kernel of the cells engine: NEON, AVX-512, AVX2,\n"
+           "                              scalar, scalar-alt or lookup (default: the best\n"
+           "                              one for the CPU)\n"
+           "      --block-generations K   step the cells engine K generations at a time,\n"
+           "                              one tile at a time in cache (default: off)\n"
+           "      --block-size N          tiles of N by N cells for --block-generations,\n"
+           "                              a multiple of %d (default: %d)\n"
+           "  -t, --threads N             step generations on N threads (default: all CPUs)\n"
+           "      --headless              run without a window and report the step rate\n"
+           "  -n, --generations N         generations to run headless (default: %d)\n"
+           "      --scaling-report[=GENS] time GENS generations on 1 to N threads and exit\n"
+           "      --hashlife-step K       advance the hashlife engine 2^K generations per step\n"
+           "                              (default: %d)\n"
+           "      --hashlife-mb MB        collect hashlife nodes above MB megabytes (default: %d)\n"
+           "      --seed N                seed of the random starting board (default: a new\n"
+           "                              one every run, which is printed)\n"
+           "      --density D             fraction of live cells on the random starting\n"
+           "                              board (default: %.1f)\n"
+           "  -p, --pattern FILE          start from an RLE, Life 1.06 or macrocell file\n"
+           "                              instead of random cells\n"
+           "      --offset X,Y            place the pattern at X,Y (default: 0,0)\n"
+           "      --checkpoint FILE       write the grid to FILE in the background every\n"
+           "                              --checkpoint-every generations and on exit\n"
+           "      --checkpoint-every N    generations between checkpoints (default: %d)\n"
+           "      --restore FILE          continue from a checkpoint, with its grid size\n"
+           "      --record FILE           write every generation to FILE as deltas in the\n"
+           "                              background\n"
+           "      --keyframe-every N      generations between whole generations in the\n"
+           "                              recording (default: %d)\n",
+           BLOCK_SIZE_MULTIPLE, DEFAULT_BLOCK_SIZE,
+           DEFAULT_HEADLESS_GENERATIONS,
+           DEFAULT_HASHLIFE_STEP_LOG2,
+           HASHLIFE_DEFAULT_MAX_MB,
+           DEFAULT_SEED_DENSITY,
+           DEFAULT_CHECKPOINT_EVERY,
+           DEFAULT_KEYFRAME_EVERY);
+    // Split in two to stay under the length of string literals C requires
+    // compilers to support
+    printf("      --census FILE           write the population, births, deaths and bounding\n"
+           "                              box of every generation to FILE, as binary if it\n"
+           "                              ends in .bin and CSV otherwise\n"
+           "      --replay FILE           play back a recording instead of simulating\n"
+           "      --seek N                start the replay at generation N; headless, only\n"
+           "                              decode generation N, and write it to --checkpoint\n"
+           "      --workers N             split the grid into slabs stepped by N processes\n"
+           "                              with the cells engine's kernel, and with\n"
+           "                              --scaling-report, time 1 to N of them\n"
+           "      --transport NAME        how workers exchange rows: shm or socket\n"
+           "                              (default: shm)\n"
+           "      --ensemble N            run N random boards of the grid size, 64 at a time\n"
+           "                              per thread, each until it settles or reaches\n"
+           "                              --generations, and report what they settled into\n"
+           "      --results FILE          write the population, period and generations of\n"
+           "                              each --ensemble board to FILE as CSV\n");
+#ifndef HEADLESS
+    printf("      --rate N                step the window at most N generations/s\n"
+           "                              (default: 0, as fast as possible)\n");
+#endif
+    printf("      --profile FILE          time each phase and write p50/p99/max to FILE,\n"
+           "                              as JSON if it ends in .json and CSV otherwise\n"
+           "      --profile-every SECS    seconds between profile writes (default: %d)\n",
+           DEFAULT_PROFILE_EVERY);
+#ifndef HEADLESS
+    printf("      --overlay               draw p50 and p99 of each phase over the window\n");
+#endif
+    printf("      --on-cycle ACTION       when the grid repeats itself: none, report, stop,\n"
+           "                              or jump to the last headless generation\n"
+           "                              (default: none)\n"
+           "  -h, --help                  show this message\n");
+}
+
+static bool parse_size(const char* const str, size_t* const value)
+{
+    char* end;
+    errno = 0;
+    const unsigned long long parsed = strtoull(str, &end, 10);
+    if ((errno != 0) || (end == str) || (*end != '\0') || (parsed == 0)) {
+        return false;
     }
+    *value = (size_t)parsed;
+    return true;
+}
+
+static bool parse_step_log2(const char* const str, unsigned int* const step_log2)
+{
+    char* end;
+    errno = 0;
+    const unsigned long parsed = strtoul(str, &end, 10);
+    if ((errno != 0) || (end == str) || (*end != '\0') || (parsed + 3 > HASHLIFE_MAX_LEVEL)) {
+        return false;
+    }
+    *step_log2 = (unsigned int)parsed;
+    return true;
+}
 
-    // Randomize cellbuf1
-    static const char dev_urand_path[] = "/dev/urandom";
-    const int devurand_fd = open(dev_urand_path, O_RDONLY);
-    if (devurand_fd == -1) {
-        fprintf(stderr, "Error when opening %s: %s\n", dev_urand_path, strerror(errno));
-        free(cellbuf1);
-#ifndef USE_SIMD
-        free(cellbuf2);
+int main(int argc, char* argv[])
+{
+    struct options opts = {
+        .grid_width = DEFAULT_GRID_WIDTH,
+        .grid_height = DEFAULT_GRID_HEIGHT,
+        .boundary = BOUNDARY_DEAD,
+        .rule = conway_rule,
+        .rule_given = false,
+        .window_width = DEFAULT_GRID_WIDTH,
+        .window_height = DEFAULT_GRID_HEIGHT,
+        .num_threads = pool_default_threads(),
+        .sim = {
+            .engine = ENGINE_BITGRID,
+            .kernel = NULL,
+            .hashlife_step_log2 = DEFAULT_HASHLIFE_STEP_LOG2,
+            .hashlife_max_bytes = (size_t)HASHLIFE_DEFAULT_MAX_MB << 20,
+            .block_generations = 0,
+            .block_size = DEFAULT_BLOCK_SIZE
+        },
+        .report_generations = 0,
+        .seed = {
+            .seed = 0,
+            .density = DEFAULT_SEED_DENSITY
+        },
+        .seed_given = false,
+#ifdef HEADLESS
+        .headless = true,
 #else
-        free(neighbor_counts);
+        .headless = false,
 #endif
-        end_graphics(&gfx);
+        .generations = DEFAULT_HEADLESS_GENERATIONS,
+        .pattern_path = NULL,
+        .pattern_x = 0,
+        .pattern_y = 0,
+        .checkpoint_path = NULL,
+        .checkpoint_every = DEFAULT_CHECKPOINT_EVERY,
+        .restore = NULL,
+        .record_path = NULL,
+        .keyframe_every = DEFAULT_KEYFRAME_EVERY,
+        .census_path = NULL,
+        .replay = NULL,
+        .seek = 0,
+        .seek_given = false,
+        .num_workers = 0,
+        .transport = TRANSPORT_SHM,
+        .num_universes = 0,
+        .results_path = NULL,
+        .rate = 0.0,
+        .profile_path = NULL,
+        .profile_every = DEFAULT_PROFILE_EVERY,
+        .overlay = false,
+        .on_cycle = CYCLE_NONE
+    };
+    const char* restore_path = NULL;
+    const char* replay_path = NULL;
+    // The last option given that only a window uses
+    const char* window_option = NULL;
+
+    static const struct option long_options[] = {
+        {"grid",           required_argument, NULL, 'g'},
+        {"boundary",       required_argument, NULL, 'b'},
+        {"rule",           required_argument, NULL, 'L'},
+        {"window",         required_argument, NULL, 'w'},
+        {"engine",         required_argument, NULL, 'e'},
+        {"kernel",         required_argument, NULL, 'K'},
+        {"block-generations", required_argument, NULL, 'B'},
+        {"block-size",     required_argument, NULL, 'Q'},
+        {"threads",        required_argument, NULL, 't'},
+        {"headless",       no_argument,       NULL, 'H'},
+        {"generations",    required_argument, NULL, 'n'},
+        {"scaling-report", optional_argument, NULL, 'r'},
+        {"hashlife-step",  required_argument, NULL, 'k'},
+        {"hashlife-mb",    required_argument, NULL, 'm'},
+        {"seed",           required_argument, NULL, 'S'},
+        {"density",        required_argument, NULL, 'D'},
+        {"pattern",        required_argument, NULL, 'p'},
+        {"offset",         required_argument, NULL, 'o'},
+        {"checkpoint",     required_argument, NULL, 'c'},
+        {"checkpoint-every", required_argument, NULL, 'C'},
+        {"restore",        required_argument, NULL, 'R'},
+        {"record",         required_argument, NULL, 'V'},
+        {"keyframe-every", required_argument, NULL, 'F'},
+        {"census",         required_argument, NULL, 'A'},
+        {"replay",         required_argument, NULL, 'X'},
+        {"seek",           required_argument, NULL, 'Z'},
+        {"workers",        required_argument, NULL, 'U'},
+        {"transport",      required_argument, NULL, 'T'},
+        {"ensemble",       required_argument, NULL, 'N'},
+        {"results",        required_argument, NULL, 'W'},
+        {"rate",           required_argument, NULL, 'G'},
+        {"profile",        required_argument, NULL, 'P'},
+        {"profile-every",  required_argument, NULL, 'E'},
+        {"overlay",        no_argument,       NULL, 'O'},
+        {"on-cycle",       required_argument, NULL, 'Y'},
+        {"help",           no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "g:b:w:e:t:n:p:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'g':
+            if (!parse_dimensions(optarg, &opts.grid_width, &opts.grid_height)) {
+                fprintf(stderr, "Error: Invalid grid size: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            if (!parse_boundary(optarg, &opts.boundary)) {
+                fprintf(stderr, "Error: Unknown boundary: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'L':
+            if (!parse_rule(optarg, &opts.rule)) {
+                fprintf(stderr, "Error: Invalid or unsupported rule: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            opts.rule_given = true;
+            break;
+        case 'w':
+            if (!parse_dimensions(optarg, &opts.window_width, &opts.window_height)) {
+                fprintf(stderr, "Error: Invalid window size: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            window_option = "--window";
+            break;
+        case 'e':
+            if (!parse_engine(optarg, &opts.sim.engine)) {
+                fprintf(stderr, "Error: Unknown engine: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'K':
+            opts.sim.kernel = find_cell_kernel(optarg);
+            if (opts.sim.kernel == NULL) {
+                fprintf(stderr, "Error: Unknown or unsupported kernel: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'B':
+            if (!parse_size(optarg, &opts.sim.block_generations)) {
+                fprintf(stderr, "Error: Invalid generations per block: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'Q':
+            if (!parse_size(optarg, &opts.sim.block_size) || (opts.sim.block_size % BLOCK_SIZE_MULTIPLE != 0)) {
+                fprintf(stderr, "Error: Invalid block size, which must be a multiple of %d: %s\n", BLOCK_SIZE_MULTIPLE, optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 't':
+            if (!parse_size(optarg, &opts.num_threads)) {
+                fprintf(stderr, "Error: Invalid thread count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'H':
+            opts.headless = true;
+            break;
+        case 'n':
+            if (!parse_size(optarg, &opts.generations)) {
+                fprintf(stderr, "Error: Invalid generation count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            opts.report_generations = DEFAULT_REPORT_GENERATIONS;
+            if ((optarg != NULL) && !parse_size(optarg, &opts.report_generations)) {
+                fprintf(stderr, "Error: Invalid generation count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'k':
+            if (!parse_step_log2(optarg, &opts.sim.hashlife_step_log2)) {
+                fprintf(stderr, "Error: Invalid hashlife step: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'm': {
+            size_t max_mb;
+            if (!parse_size(optarg, &max_mb)) {
+                fprintf(stderr, "Error: Invalid hashlife memory limit: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            opts.sim.hashlife_max_bytes = max_mb << 20;
+            break;
+        }
+        case 'S': {
+            char* end;
+            errno = 0;
+            opts.seed.seed = strtoull(optarg, &end, 0);
+            if ((errno != 0) || (end == optarg) || (*end != '\0')) {
+                fprintf(stderr, "Error: Invalid seed: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            opts.seed_given = true;
+            break;
+        }
+        case 'D':
+            if (!parse_density(optarg, &opts.seed.density)) {
+                fprintf(stderr, "Error: Invalid density: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'p':
+            opts.pattern_path = optarg;
+            break;
+        case 'o':
+            if (!parse_offset(optarg, &opts.pattern_x, &opts.pattern_y)) {
+                fprintf(stderr, "Error: Invalid offset: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'c':
+            opts.checkpoint_path = optarg;
+            break;
+        case 'C':
+            if (!parse_size(optarg, &opts.checkpoint_every)) {
+                fprintf(stderr, "Error: Invalid generation count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'R':
+            restore_path = optarg;
+            break;
+        case 'V':
+            opts.record_path = optarg;
+            break;
+        case 'F':
+            if (!parse_size(optarg, &opts.keyframe_every)) {
+                fprintf(stderr, "Error: Invalid generation count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'A':
+            opts.census_path = optarg;
+            break;
+        case 'X':
+            replay_path = optarg;
+            break;
+        case 'Z': {
+            char* end;
+            errno = 0;
+            opts.seek = strtoull(optarg, &end, 10);
+            if ((errno != 0) || (end == optarg) || (*end != '\0')) {
+                fprintf(stderr, "Error: Invalid generation: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            opts.seek_given = true;
+            break;
+        }
+        case 'U':
+            if (!parse_size(optarg, &opts.num_workers)) {
+                fprintf(stderr, "Error: Invalid worker count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'T':
+            if (!parse_transport(optarg, &opts.transport)) {
+                fprintf(stderr, "Error: Unknown transport: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'N': {
+            size_t num_universes;
+            if (!parse_size(optarg, &num_universes)) {
+                fprintf(stderr, "Error: Invalid universe count: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            opts.num_universes = num_universes;
+            break;
+        }
+        case 'W':
+            opts.results_path = optarg;
+            break;
+        case 'G': {
+            char* end;
+            errno = 0;
+            opts.rate = strtod(optarg, &end);
+            if ((errno != 0) || (end == optarg) || (*end != '\0') || !(opts.rate >= 0.0)) {
+                fprintf(stderr, "Error: Invalid rate: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            window_option = "--rate";
+            break;
+        }
+        case 'P':
+            opts.profile_path = optarg;
+            break;
+        case 'E':
+            if (!parse_size(optarg, &opts.profile_every)) {
+                fprintf(stderr, "Error: Invalid profile interval: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'O':
+            opts.overlay = true;
+            window_option = "--overlay";
+            break;
+        case 'Y':
+            if (!parse_cycle_action(optarg, &opts.on_cycle)) {
+                fprintf(stderr, "Error: Unknown cycle action: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (opts.headless && (window_option != NULL)) {
+        fprintf(stderr, "Error: %s only applies to a window, which headless runs do not open.\n", window_option);
+        return EXIT_FAILURE;
+    }
+    // The unbounded engines have no grid to save or to split up
+    const bool unbounded = engine_is_unbounded(opts.sim.engine);
+    if ((opts.checkpoint_path != NULL) && unbounded) {
+        fprintf(stderr, "Error: The hashlife and plane engines cannot write checkpoints.\n");
         return EXIT_FAILURE;
     }
-    if (read(devurand_fd, cellbuf1, NUM_BYTES_IN_TEXTURE) == -1) {
-        fprintf(stderr, "Error when reading from %s: %s\n", dev_urand_path, strerror(errno));
-    }
-    close(devurand_fd);
-    size_t i = 0;
-#if defined(USE_SIMD) && defined(__ARM_NEON__)
-    const uint32x4_t all_live = vdupq_n_u32(LIVE_CELL);
-    const uint32x4_t all_dead = vdupq_n_u32(DEAD_CELL);
-    const uint32x4_t one_vec = vdupq_n_u32(0x00000001);
-    for (; (i + 4) <= NUM_PIXELS; i += 4) {
-        uint32_t* const ptr_cells = cellbuf1 + i;
-        const uint32x4_t current_cells = vandq_u32(vld1q_u32(ptr_cells), one_vec);
-        const uint32x4_t live_mask = vceqq_u32(current_cells, one_vec);
-        const uint32x4_t dead_mask = vmvnq_u32(live_mask);
-        const uint32x4_t live_cells = vandq_u32(live_mask, all_live);
-        const uint32x4_t dead_cells = vandq_u32(dead_mask, all_dead);
-        vst1q_u32(ptr_cells, vorrq_u32(live_cells, dead_cells));
+    if ((opts.on_cycle == CYCLE_JUMP) && !opts.headless) {
+        fprintf(stderr, "Error: --on-cycle jump skips to the last headless generation, which a window does not have.\n");
+        return EXIT_FAILURE;
     }
+    if ((opts.on_cycle != CYCLE_NONE) && (opts.sim.engine == ENGINE_HASHLIFE)) {
+        fprintf(stderr, "Error: The hashlife engine does not hash generations.\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.record_path != NULL) && unbounded) {
+        fprintf(stderr, "Error: The hashlife and plane engines cannot record generations.\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.num_workers > 0) && unbounded) {
+        fprintf(stderr, "Error: Workers step slabs of a grid, not an unbounded plane.\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.census_path != NULL) && ((opts.sim.engine == ENGINE_HASHLIFE) || (opts.num_workers > 0))) {
+        fprintf(stderr, "Error: Only the bitgrid, cells and plane engines take a census, on a single process.\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.sim.block_generations > 0) && (opts.sim.engine != ENGINE_CELLS)) {
+        fprintf(stderr, "Error: Only the cells engine steps blocks of generations.\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.sim.block_generations > 0) && (opts.sim.block_size < opts.sim.block_generations)) {
+        fprintf(stderr, "Error: Blocks must be at least as many cells wide as the generations they are stepped.\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.sim.block_generations > 0) && ((opts.on_cycle != CYCLE_NONE) || (opts.num_workers > 0))) {
+        fprintf(stderr, "Error: Blocks of generations cannot be used with cycle detection or workers.\n");
+        return EXIT_FAILURE;
+    }
+    opts.sim.num_threads = opts.num_threads;
+    if ((opts.num_workers > 0) && ((opts.record_path != NULL) || (opts.on_cycle != CYCLE_NONE))) {
+        fprintf(stderr, "Error: Worker processes cannot record generations or detect cycles.\n");
+        return EXIT_FAILURE;
+    }
+    if ((opts.results_path != NULL) && (opts.num_universes == 0)) {
+        fprintf(stderr, "Error: --results needs an --ensemble to run.\n");
+        return EXIT_FAILURE;
+    }
+    // An ensemble seeds its own boards and only reports what they settle
+    // into
+    if (opts.num_universes > 0) {
+        if ((opts.pattern_path != NULL) || (restore_path != NULL) || (replay_path != NULL) ||
+            (opts.checkpoint_path != NULL) || (opts.record_path != NULL) || (opts.census_path != NULL) ||
+            (opts.num_workers > 0) || (opts.report_generations > 0)) {
+            fprintf(stderr, "Error: An ensemble only runs random boards, and cannot load, save, record or split them.\n");
+            return EXIT_FAILURE;
+        }
+        return run_ensemble(&opts);
+    }
+    if (opts.seek_given && (replay_path == NULL)) {
+        fprintf(stderr, "Error: --seek needs a recording to --replay.\n");
+        return EXIT_FAILURE;
+    }
+    // A recording brings its own grid size, boundary and rule too, and
+    // replaces the simulation
+    if (replay_path != NULL) {
+        struct replay replay;
+        if (!replay_open(&replay, replay_path)) {
+            return EXIT_FAILURE;
+        }
+        opts.grid_width = replay.header->width;
+        opts.grid_height = replay.header->height;
+        opts.boundary = (enum boundary)replay.header->boundary;
+        opts.rule = replay.rule;
+        opts.replay = &replay;
+#ifdef HEADLESS
+        const int exit_status = run_replay_headless(&opts);
+#else
+        const int exit_status = opts.headless ? run_replay_headless(&opts) : run_replay_window(&opts);
 #endif
-    for (; i < NUM_PIXELS; i++) {
-        if (cellbuf1[i] & 0x00000001) {
-            cellbuf1[i] = LIVE_CELL;
-        } else {
-            cellbuf1[i] = DEAD_CELL;
+        replay_close(&replay);
+        return exit_status;
+    }
+    // A pattern runs with the rule it names unless --rule was given
+    if ((opts.pattern_path != NULL) && (restore_path == NULL)) {
+        struct rule pattern_rule;
+        bool found;
+        if (!pattern_read_rule(opts.pattern_path, &pattern_rule, &found)) {
+            return EXIT_FAILURE;
+        }
+        if (found && !opts.rule_given) {
+            opts.rule = pattern_rule;
+        } else if (found && ((pattern_rule.birth != opts.rule.birth) || (pattern_rule.survival != opts.rule.survival))) {
+            char named[RULE_STRING_SIZE];
+            char given[RULE_STRING_SIZE];
+            format_rule(&pattern_rule, named, sizeof(named));
+            format_rule(&opts.rule, given, sizeof(given));
+            fprintf(stderr, "Warning: %s names the rule %s, running it with %s instead.\n", opts.pattern_path, named, given);
+        }
+    }
+    // A checkpoint brings its own grid size, boundary and rule
+    struct checkpoint restore;
+    if (restore_path != NULL) {
+        if (!checkpoint_open(&restore, restore_path)) {
+            return EXIT_FAILURE;
+        }
+        opts.grid_width = restore.header->width;
+        opts.grid_height = restore.header->height;
+        opts.boundary = (enum boundary)restore.header->boundary;
+        opts.rule = restore.rule;
+        opts.restore = &restore;
+    }
+
+    int exit_status;
+    if ((opts.report_generations > 0) && (opts.num_workers > 0)) {
+        exit_status = print_domain_report(&opts);
+    } else if (opts.report_generations > 0) {
+        exit_status = print_scaling_report(&opts);
+    } else if (opts.num_workers > 0) {
+#ifdef HEADLESS
+        exit_status = run_domain_headless(&opts);
+#else
+        exit_status = opts.headless ? run_domain_headless(&opts) : run_domain_window(&opts);
+#endif
+    } else {
+#ifdef HEADLESS
+        exit_status = run_headless(&opts);
+#else
+        exit_status = opts.headless ? run_headless(&opts) : run_window(&opts);
+#endif
+    }
+    if (restore_path != NULL) {
+        checkpoint_close(&restore);
+    }
+    return exit_status;
+}
+
+#ifndef HEADLESS
+// State shared by the window and the simulation thread. The simulation
+// thread owns sim; only frames, the view of unbounded engines and quit
+// cross threads. The window moves the view and the simulation thread draws
+// the next frame from wherever it is then, and keeps it in shown.
+struct sim_thread {
+    pthread_t thread;
+    struct simulation* sim;
+    struct thread_pool* pool;
+    struct checkpoints* cps;
+    struct recording* rec;
+    struct census_series* series;
+    const struct options* opts;
+    struct frame_buffer* frames;
+    struct profile* profile;
+    _Atomic int64_t view_x;
+    _Atomic int64_t view_y;
+    atomic_uint zoom_log2;
+    struct viewport shown;
+    atomic_bool quit;
+};
+
+static struct viewport load_view(struct sim_thread* const st)
+{
+    const struct viewport view = {
+        .x = atomic_load(&st->view_x),
+        .y = atomic_load(&st->view_y),
+        .zoom_log2 = atomic_load(&st->zoom_log2)
+    };
+    return view;
+}
+
+static bool view_moved(struct sim_thread* const st)
+{
+    const struct viewport view = load_view(st);
+    return (view.x != st->shown.x) || (view.y != st->shown.y) || (view.zoom_log2 != st->shown.zoom_log2);
+}
+
+// Fills the back frame with the current generation. The bitgrid engine only
+// copies its packed cells, which the window expands as it draws them.
+static void publish_frame(struct sim_thread* const st)
+{
+    struct frame_buffer* const frames = st->frames;
+    struct frame* const frame = frame_buffer_back(frames);
+    const struct bitgrid* const bits = sim_bitgrid(st->sim);
+    if (bits != NULL) {
+        bitgrid_copy_view(&frame->bits, bits);
+    } else {
+        st->shown = load_view(st);
+        size_t pitch;
+        const uint32_t* const shown = sim_view(st->sim, frame->pixels, frames->width, frames->height, &st->shown, &pitch);
+        if (shown != frame->pixels) {
+            for (size_t y = 0; y < frames->height; y++) {
+                memcpy(frame->pixels + (y * frames->width),
+                       (const uint8_t*)shown + (y * pitch),
+                       frames->width * sizeof(uint32_t));
+            }
         }
     }
+    struct tile_map* const tiles = sim_tiles(st->sim);
+    if (tiles != NULL) {
+        memcpy(frame->dirty, tiles->dirty, frames->num_tiles);
+        tile_map_clear_dirty(tiles);
+    } else {
+        memset(frame->dirty, 1, frames->num_tiles);
+    }
+    frame->generation = st->sim->generation;
+    frame_buffer_publish(frames);
+}
+
+// Sums up the time spent drawing the frame, as opposed to locking and
+// uploading the texture
+struct front_frame {
+    const struct frame_buffer* frames;
+    const struct frame* frame;
+    int64_t draw_ns;
+};
+
+static void draw_front_frame(void* const ctx, uint32_t* const pixels, const size_t pitch, const size_t x, const size_t y, const size_t width, const size_t height)
+{
+    struct front_frame* const front = ctx;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    frame_to_argb_rect(front->frames, front->frame, pixels, pitch, x, y, width, height);
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    front->draw_ns += get_time_diff_ns(&start, &stop);
+}
+
+// Steps as fast as possible, or at opts->rate generations per second, and
+// publishes a frame whenever the window has picked up the last one. Once a
+// step fails, or the grid is found to be in a cycle and opts->on_cycle is
+// stop, it only publishes the generation it stopped at, and again whenever
+// the view moves.
+static void* sim_thread_main(void* const arg)
+{
+    struct sim_thread* const st = arg;
+    const int64_t ns_per_generation = (st->opts->rate > 0) ? (int64_t)(NS_PER_S / st->opts->rate) : 0;
+    struct cycle_detector cycles;
+    cycle_detector_reset(&cycles);
+    size_t period = 0;
+    bool stopped = false;
+    bool published = false;
+    publish_frame(st);
+    while (!atomic_load(&st->quit)) {
+        if (stopped) {
+            if ((!published || view_moved(st)) && frame_buffer_consumed(st->frames)) {
+                publish_frame(st);
+                published = true;
+            }
+            const struct timespec wait_time = {
+                .tv_sec = 0,
+                .tv_nsec = NS_PER_FRAME_30FPS
+            };
+            nanosleep(&wait_time, NULL);
+            continue;
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        struct timespec lap = start;
+        const uint64_t generation = st->sim->generation;
+        if (!sim_step(st->sim, st->pool)) {
+            stopped = true;
+            published = false;
+            continue;
+        }
+        profile_lap(st->profile, PHASE_STEP, &lap);
+        checkpoints_update(st->cps, st->opts, st->sim);
+        recording_update(st->rec, st->sim);
+        census_series_update(st->series, st->sim);
+        if ((st->opts->on_cycle != CYCLE_NONE) && (period == 0)) {
+            period = cycle_detector_push(&cycles, st->sim->hash);
+            if (period > 0) {
+                printf("Cycle:       period %zu found at generation %" PRIu64 "\n", period, st->sim->generation);
+                stopped = st->opts->on_cycle == CYCLE_STOP;
+            }
+        }
+        if (frame_buffer_consumed(st->frames)) {
+            clock_gettime(CLOCK_MONOTONIC, &lap);
+            publish_frame(st);
+            profile_lap(st->profile, PHASE_PUBLISH, &lap);
+        }
+        if (ns_per_generation > 0) {
+            struct timespec stop;
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            const int64_t step_ns = ns_per_generation * (int64_t)(st->sim->generation - generation);
+            const int64_t wait_time_ns = step_ns - get_time_diff_ns(&start, &stop);
+            if (wait_time_ns > 0) {
+                struct timespec wait_time = {
+                    .tv_sec = wait_time_ns / NS_PER_S,
+                    .tv_nsec = wait_time_ns % NS_PER_S
+                };
+                nanosleep(&wait_time, NULL);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Pans the view of an unbounded engine by an eighth of the window with the
+// arrow keys, and zooms the plane engine in and out around the middle of
+// the window with + and -, or with the mouse wheel, turned by dy
+static void move_view(struct sim_thread* const st, const SDL_Keycode key, const int dy, const size_t view_width, const size_t view_height)
+{
+    const unsigned int zoom_log2 = atomic_load(&st->zoom_log2);
+    const int64_t step_x = (int64_t)(((view_width / 8) + 1) << zoom_log2);
+    const int64_t step_y = (int64_t)(((view_height / 8) + 1) << zoom_log2);
+    int64_t x = atomic_load(&st->view_x);
+    int64_t y = atomic_load(&st->view_y);
+    unsigned int new_zoom_log2 = zoom_log2;
+    switch (key) {
+    case SDLK_LEFT:
+        x -= step_x;
+        break;
+    case SDLK_RIGHT:
+        x += step_x;
+        break;
+    case SDLK_UP:
+        y -= step_y;
+        break;
+    case SDLK_DOWN:
+        y += step_y;
+        break;
+    case SDLK_MINUS:
+    case SDLK_KP_MINUS:
+        new_zoom_log2++;
+        break;
+    case SDLK_PLUS:
+    case SDLK_EQUALS:
+    case SDLK_KP_PLUS:
+        new_zoom_log2--;
+        break;
+    default:
+        new_zoom_log2 = (unsigned int)((int)new_zoom_log2 - dy);
+        break;
+    }
+    if ((new_zoom_log2 != zoom_log2) && ((st->sim->engine != ENGINE_PLANE) || (new_zoom_log2 > PLANE_MAX_ZOOM_LOG2))) {
+        return;
+    }
+    // The cell in the middle of the window stays there
+    const int64_t half_width = (int64_t)(view_width / 2);
+    const int64_t half_height = (int64_t)(view_height / 2);
+    x += (half_width << zoom_log2) - (half_width << new_zoom_log2);
+    y += (half_height << zoom_log2) - (half_height << new_zoom_log2);
+    atomic_store(&st->view_x, x);
+    atomic_store(&st->view_y, y);
+    atomic_store(&st->zoom_log2, new_zoom_log2);
+}
+
+static int run_window(const struct options* const opts)
+{
+    const struct grid g = grid_init(opts->grid_width, opts->grid_height, opts->boundary, &opts->rule);
+    // Only the top left of a grid larger than the window is shown. The
+    // unbounded engines fill the window, which can be moved around the plane.
+    const bool unbounded = engine_is_unbounded(opts->sim.engine);
+    const size_t view_width = (!unbounded && (g.width < opts->window_width)) ? g.width : opts->window_width;
+    const size_t view_height = (!unbounded && (g.height < opts->window_height)) ? g.height : opts->window_height;
+    const size_t tiles_x = (((g.width > view_width) ? g.width : view_width) + TILE_SIZE - 1) / TILE_SIZE;
+    const size_t tiles_y = (((g.height > view_height) ? g.height : view_height) + TILE_SIZE - 1) / TILE_SIZE;
+
+    struct thread_pool pool;
+    if (!pool_create(&pool, opts->num_threads)) {
+        return EXIT_FAILURE;
+    }
+    struct simulation sim;
+    if (!sim_create(&sim, &g, &opts->sim)) {
+        pool_destroy(&pool);
+        return EXIT_FAILURE;
+    }
+    struct frame_buffer frames;
+    if (!frame_buffer_create(&frames, view_width, view_height, tiles_x * tiles_y, sim_bitgrid(&sim) != NULL)) {
+        sim_destroy(&sim);
+        pool_destroy(&pool);
+        return EXIT_FAILURE;
+    }
+    struct sdl_graphics gfx = init_graphics(
+        "Conway's Game of Life",
+        (int)opts->window_width,
+        (int)opts->window_height,
+        (int)view_width,
+        (int)view_height
+    );
+    int exit_status = EXIT_FAILURE;
+
+    char rule[RULE_STRING_SIZE];
+    format_rule(&g.rule, rule, sizeof(rule));
+    printf("Using the %s engine with the rule %s\n", sim_engine_name(&sim), rule);
+    if (!seed_sim(&sim, &pool, opts)) {
+        goto free_buffers;
+    }
+    struct profile profile;
+    if (!profile_create(&profile)) {
+        goto free_buffers;
+    }
+    struct checkpoints cps;
+    if (!checkpoints_start(&cps, opts, &sim)) {
+        goto free_profile;
+    }
+    struct recording rec;
+    if (!recording_start(&rec, opts, &sim)) {
+        checkpoints_finish(&cps, &sim);
+        goto free_profile;
+    }
+    struct census_series series;
+    if (!census_series_start(&series, opts, &sim)) {
+        checkpoints_finish(&cps, &sim);
+        recording_finish(&rec);
+        goto free_profile;
+    }
+
+    struct sim_thread st = {
+        .sim = &sim,
+        .pool = &pool,
+        .cps = &cps,
+        .rec = &rec,
+        .series = &series,
+        .opts = opts,
+        .frames = &frames,
+        .profile = &profile
+    };
+    atomic_init(&st.view_x, 0);
+    atomic_init(&st.view_y, 0);
+    atomic_init(&st.zoom_log2, 0);
+    atomic_init(&st.quit, false);
+    const int err = pthread_create(&st.thread, NULL, sim_thread_main, &st);
+    if (err != 0) {
+        fprintf(stderr, "Error when creating the simulation thread: %s\n", strerror(err));
+        checkpoints_finish(&cps, &sim);
+        recording_finish(&rec);
+        census_series_finish(&series);
+        goto free_profile;
+    }
+
+    // The title shows how many generations each frame advanced, on average
+    // over the last second, and the overlay is refreshed as often
+    uint64_t last_generation = sim.generation;
+    uint64_t title_generation = last_generation;
+    size_t title_frames = 0;
+    struct timespec title_time;
+    clock_gettime(CLOCK_MONOTONIC, &title_time);
+    struct timespec last_dump = title_time;
+    struct overlay_bar bars[NUM_PHASES] = {{0.0f, 0.0f}};
 
     bool quit = false;
     while (!quit) {
         struct timespec start;
         clock_gettime(CLOCK_MONOTONIC, &start);
+        struct timespec lap = start;
 
         // UPDATE SCREEN
-#if defined(USE_SIMD) && defined(__ARM_NEON__)
-        update_cells_neon(cellbuf1, neighbor_counts);
-        render_graphics(&gfx, cellbuf1);
-#else
-        static bool draw_from_cellbuf1 = true;
-        if (draw_from_cellbuf1) {
-            render_graphics(&gfx, cellbuf1);
-            update_cells(cellbuf1, cellbuf2);
-        } else {
-            render_graphics(&gfx, cellbuf2);
-            update_cells(cellbuf2, cellbuf1);
+        const struct frame* const frame = frame_buffer_acquire(&frames);
+        if (frame != NULL) {
+            struct front_frame front = {&frames, frame, 0};
+            update_graphics_rects(&gfx, frame->dirty, tiles_x, draw_front_frame, &front);
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            profile_record(&profile, PHASE_EXPAND, front.draw_ns);
+            profile_record(&profile, PHASE_UPLOAD, get_time_diff_ns(&lap, &now) - front.draw_ns);
+            lap = now;
+            present_graphics(&gfx, bars, opts->overlay ? NUM_PHASES : 0);
+            profile_lap(&profile, PHASE_PRESENT, &lap);
+            last_generation = frame->generation;
+            title_frames++;
         }
-        draw_from_cellbuf1 = !draw_from_cellbuf1;
-#endif
+        if ((get_time_diff_ns(&title_time, &start) >= NS_PER_S) && (title_frames > 0)) {
+            char title[128];
+            snprintf(title, sizeof(title), "Conway's Game of Life - generation %" PRIu64 ", %.1f generations/frame",
+                     last_generation, (double)(last_generation - title_generation) / (double)title_frames);
+            set_graphics_title(&gfx, title);
+            title_generation = last_generation;
+            title_frames = 0;
+            title_time = start;
+            // Bars are drawn relative to the frame budget
+            for (int p = 0; opts->overlay && (p < NUM_PHASES); p++) {
+                struct phase_summary summary;
+                profile_summarize(&profile, (enum phase)p, &summary);
+                bars[p].length = (float)summary.p50_ns / (float)NS_PER_FRAME_30FPS;
+                bars[p].mark = (float)summary.p99_ns / (float)NS_PER_FRAME_30FPS;
+            }
+        }
+        profile_update(&profile, opts, &last_dump, &start);
 
+        clock_gettime(CLOCK_MONOTONIC, &lap);
         SDL_Event event;
         if (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) {
@@ -115,15 +1243,18 @@ int main(void)
                     quit = true;
                     break;
                 default:
+                    if (unbounded) {
+                        move_view(&st, event.key.keysym.sym, 0, view_width, view_height);
+                    }
                     break;
                 }
+            } else if ((event.type == SDL_MOUSEWHEEL) && unbounded && (event.wheel.y != 0)) {
+                move_view(&st, SDLK_UNKNOWN, (event.wheel.y > 0) ? 1 : -1, view_width, view_height);
             }
         }
+        profile_lap(&profile, PHASE_EVENTS, &lap);
 
-        struct timespec stop;
-        clock_gettime(CLOCK_MONOTONIC, &stop);
-        const int64_t frame_time_ns = get_time_diff_ns(&start, &stop);
-        //printf("Frame time: %" PRIi64 " ns\n", frame_time_ns);
+        const int64_t frame_time_ns = get_time_diff_ns(&start, &lap);
         const int64_t wait_time_ns = NS_PER_FRAME_30FPS - frame_time_ns;
         if (wait_time_ns > 0) {
             struct timespec wait_time = {
@@ -132,339 +1263,680 @@ int main(void)
             };
             nanosleep(&wait_time, NULL);
         }
+        profile_lap(&profile, PHASE_SLEEP, &lap);
+        profile_record(&profile, PHASE_FRAME, get_time_diff_ns(&start, &lap));
     }
-    
-    free(cellbuf1);
-#ifndef USE_SIMD
-    free(cellbuf2);
-#else
-    free(neighbor_counts);
-#endif
+    atomic_store(&st.quit, true);
+    pthread_join(st.thread, NULL);
+    checkpoints_finish(&cps, &sim);
+    recording_finish(&rec);
+    census_series_finish(&series);
+    profile_finish(&profile, opts);
+    exit_status = EXIT_SUCCESS;
+
+free_profile:
+    profile_destroy(&profile);
+free_buffers:
     end_graphics(&gfx);
-    return EXIT_SUCCESS;
+    frame_buffer_destroy(&frames);
+    sim_destroy(&sim);
+    pool_destroy(&pool);
+    return exit_status;
 }
 
-void update_cells(uint32_t prev[const static NUM_PIXELS], uint32_t next[const static NUM_PIXELS])
+// Expands a bitgrid straight into the texture
+static void draw_bitgrid(void* const ctx, uint32_t* const pixels, const size_t pitch, const size_t x, const size_t y, const size_t width, const size_t height)
 {
-    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        const bool prev_row_exists = y > 0;
-        const bool next_row_exists = y < (SCREEN_HEIGHT - 1);
-        for (size_t x = 0; x < SCREEN_WIDTH; x++) {
-            const bool prev_col_exists = x > 0;
-            const bool next_col_exists = x < (SCREEN_WIDTH - 1);
-            const size_t i = row + x;
-            uint8_t num_neighbors = (prev_col_exists && (prev[i-1] == LIVE_CELL))
-                                  + (next_col_exists && (prev[i+1] == LIVE_CELL));
-            if (prev_row_exists) {
-                const size_t i_above = i - SCREEN_WIDTH;
-                num_neighbors += (prev_col_exists && (prev[i_above-1] == LIVE_CELL))
-                               + (prev[i_above] == LIVE_CELL)
-                               + (next_col_exists && (prev[i_above+1] == LIVE_CELL));
-            }
-            if (next_row_exists) {
-                const size_t i_below = i + SCREEN_WIDTH;
-                num_neighbors += (prev_col_exists && (prev[i_below-1] == LIVE_CELL))
-                               + (prev[i_below] == LIVE_CELL)
-                               + (next_col_exists && (prev[i_below+1] == LIVE_CELL));
+    bitgrid_to_argb_rect(ctx, pixels, x, y, width, height, pitch / sizeof(uint32_t));
+}
+
+// Plays the recording one generation per frame, or at opts->rate
+// generations per second. Space pauses, the arrow keys seek to the keyframe
+// before or after, and Home and End to the first and last generations.
+static int run_replay_window(const struct options* const opts)
+{
+    struct replay* const rp = opts->replay;
+    const size_t view_width = (opts->grid_width < opts->window_width) ? opts->grid_width : opts->window_width;
+    const size_t view_height = (opts->grid_height < opts->window_height) ? opts->grid_height : opts->window_height;
+    struct bitgrid grid = bitgrid_create(opts->grid_width, opts->grid_height, opts->boundary, &opts->rule);
+    const size_t tiles_x = grid.words_per_row;
+    const size_t tiles_y = (grid.height + TILE_SIZE - 1) / TILE_SIZE;
+    uint8_t* const dirty = calloc(tiles_x * tiles_y, 1);
+    if ((grid.words == NULL) || (dirty == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the replay.\n");
+        bitgrid_destroy(&grid);
+        free(dirty);
+        return EXIT_FAILURE;
+    }
+    struct sdl_graphics gfx = init_graphics(
+        "Conway's Game of Life",
+        (int)opts->window_width,
+        (int)opts->window_height,
+        (int)view_width,
+        (int)view_height
+    );
+    int exit_status = EXIT_FAILURE;
+    const uint64_t first_generation = rp->keyframes[0].generation;
+    if (!replay_seek(rp, &grid, opts->seek_given ? opts->seek : first_generation, dirty)) {
+        goto free_buffers;
+    }
+    const double gens_per_frame = (opts->rate > 0) ? opts->rate * NS_PER_FRAME_30FPS / NS_PER_S : 1.0;
+    double owed = 0.0;
+    bool paused = false;
+    struct timespec title_time = {0, 0};
+
+    bool quit = false;
+    while (!quit) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        update_graphics_rects(&gfx, dirty, tiles_x, draw_bitgrid, &grid);
+        present_graphics(&gfx, NULL, 0);
+        memset(dirty, 0, tiles_x * tiles_y);
+        if (get_time_diff_ns(&title_time, &start) >= NS_PER_S) {
+            char title[128];
+            snprintf(title, sizeof(title), "Conway's Game of Life - replay, generation %" PRIu64 " of %" PRIu64 "%s",
+                     rp->generation, rp->last_generation, paused ? " (paused)" : "");
+            set_graphics_title(&gfx, title);
+            title_time = start;
+        }
+
+        if (!paused) {
+            for (owed += gens_per_frame; owed >= 1.0; owed -= 1.0) {
+                if (!replay_next(rp, &grid, dirty)) {
+                    paused = true;
+                    owed = 0.0;
+                    break;
+                }
             }
-            if (cell_is_alive(prev[i], num_neighbors)) {
-                next[i] = LIVE_CELL;
-            } else {
-                next[i] = DEAD_CELL;
+        }
+
+        uint64_t target = rp->generation;
+        SDL_Event event;
+        if (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                quit = true;
+            } else if (event.type == SDL_KEYDOWN) {
+                switch (event.key.keysym.sym) {
+                case SDLK_RETURN:
+                case SDLK_ESCAPE:
+                    quit = true;
+                    break;
+                case SDLK_SPACE:
+                    paused = !paused;
+                    break;
+                case SDLK_LEFT:
+                    target = replay_keyframe_before(rp, rp->generation);
+                    break;
+                case SDLK_RIGHT:
+                    target = replay_keyframe_after(rp, rp->generation);
+                    break;
+                case SDLK_HOME:
+                    target = first_generation;
+                    break;
+                case SDLK_END:
+                    target = rp->last_generation;
+                    break;
+                default:
+                    break;
+                }
+                title_time.tv_sec = 0;
             }
         }
+        if ((target != rp->generation) && !replay_seek(rp, &grid, target, dirty)) {
+            goto free_buffers;
+        }
+
+        struct timespec stop;
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        const int64_t wait_time_ns = NS_PER_FRAME_30FPS - get_time_diff_ns(&start, &stop);
+        if (wait_time_ns > 0) {
+            struct timespec wait_time = {
+                .tv_sec = 0,
+                .tv_nsec = wait_time_ns
+            };
+            nanosleep(&wait_time, NULL);
+        }
     }
+    exit_status = EXIT_SUCCESS;
+
+free_buffers:
+    end_graphics(&gfx);
+    free(dirty);
+    bitgrid_destroy(&grid);
+    return exit_status;
 }
 
-inline bool cell_is_alive(const uint32_t cell, const uint8_t num_neighbors)
+// Steps the workers a batch of generations per frame, as many as fit in a
+// frame or opts->rate generations per second, and gathers the generation
+// they reached to show it
+static int run_domain_window(const struct options* const opts)
 {
-    //return (cell && ((num_neighbors == 2) || (num_neighbors == 3))) || (!cell && (num_neighbors == 3));
-    return (num_neighbors == 3) || ((cell == LIVE_CELL) && (num_neighbors == 2));
+    const struct grid g = grid_init(opts->grid_width, opts->grid_height, opts->boundary, &opts->rule);
+    const size_t view_width = (g.width < opts->window_width) ? g.width : opts->window_width;
+    const size_t view_height = (g.height < opts->window_height) ? g.height : opts->window_height;
+    const size_t tiles_x = (g.width + TILE_SIZE - 1) / TILE_SIZE;
+    const size_t tiles_y = (g.height + TILE_SIZE - 1) / TILE_SIZE;
+    uint8_t* const dirty = malloc(tiles_x * tiles_y);
+    if (dirty == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for the window.\n");
+        return EXIT_FAILURE;
+    }
+    memset(dirty, 1, tiles_x * tiles_y);
+    struct domain d;
+    if (!start_domain(&d, &g, opts)) {
+        free(dirty);
+        return EXIT_FAILURE;
+    }
+    struct sdl_graphics gfx = init_graphics(
+        "Conway's Game of Life",
+        (int)opts->window_width,
+        (int)opts->window_height,
+        (int)view_width,
+        (int)view_height
+    );
+    int exit_status = EXIT_FAILURE;
+    const double rate_per_frame = opts->rate * NS_PER_FRAME_30FPS / NS_PER_S;
+    double owed = 0.0;
+    uint64_t batch = 1;
+    uint64_t title_generation = d.generation;
+    size_t title_frames = 0;
+    struct timespec title_time;
+    clock_gettime(CLOCK_MONOTONIC, &title_time);
+
+    bool quit = false;
+    while (!quit) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint64_t generations = batch;
+        if (opts->rate > 0) {
+            owed += rate_per_frame;
+            generations = (uint64_t)owed;
+            owed -= (double)generations;
+        }
+        if ((generations > 0) && !domain_step(&d, generations)) {
+            goto stop_domain;
+        }
+        struct timespec stepped;
+        clock_gettime(CLOCK_MONOTONIC, &stepped);
+        // Batches grow while they take less than half a frame
+        const int64_t step_ns = get_time_diff_ns(&start, &stepped);
+        if ((opts->rate <= 0) && (step_ns * 2 < NS_PER_FRAME_30FPS)) {
+            batch *= 2;
+        } else if ((opts->rate <= 0) && (step_ns > NS_PER_FRAME_30FPS) && (batch > 1)) {
+            batch /= 2;
+        }
+        if (!domain_gather(&d)) {
+            goto stop_domain;
+        }
+        update_graphics_rects(&gfx, dirty, tiles_x, draw_bitgrid, &d.frame);
+        present_graphics(&gfx, NULL, 0);
+        title_frames++;
+        if (get_time_diff_ns(&title_time, &start) >= NS_PER_S) {
+            char title[128];
+            snprintf(title, sizeof(title), "Conway's Game of Life - generation %" PRIu64 ", %.1f generations/frame, %zu workers",
+                     d.generation, (double)(d.generation - title_generation) / (double)title_frames, d.num_workers);
+            set_graphics_title(&gfx, title);
+            title_generation = d.generation;
+            title_frames = 0;
+            title_time = start;
+        }
+
+        SDL_Event event;
+        if (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                quit = true;
+            } else if (event.type == SDL_KEYDOWN) {
+                switch (event.key.keysym.sym) {
+                case SDLK_RETURN:
+                case SDLK_SPACE:
+                case SDLK_ESCAPE:
+                    quit = true;
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+        struct timespec stop;
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        const int64_t wait_time_ns = NS_PER_FRAME_30FPS - get_time_diff_ns(&start, &stop);
+        if (wait_time_ns > 0) {
+            struct timespec wait_time = {
+                .tv_sec = 0,
+                .tv_nsec = wait_time_ns
+            };
+            nanosleep(&wait_time, NULL);
+        }
+    }
+    exit_status = EXIT_SUCCESS;
+
+stop_domain:
+    end_graphics(&gfx);
+    domain_stop(&d);
+    free(dirty);
+    return exit_status;
 }
+#endif
 
-#if 0
-void update_cells_alt(
-    uint32_t cells[const static NUM_PIXELS],
-    uint32_t neighbor_counts[const static NUM_PIXELS])
+// Steps as fast as possible with no window and no frame cap
+static int run_headless(const struct options* const opts)
 {
-    // Up left
-    for (size_t y = 0; y < SCREEN_HEIGHT - 1; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 0; x < SCREEN_WIDTH - 1; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i + SCREEN_WIDTH + 1] = (cells[i] == LIVE_CELL);
-        }
+    const struct grid g = grid_init(opts->grid_width, opts->grid_height, opts->boundary, &opts->rule);
+    struct thread_pool pool;
+    if (!pool_create(&pool, opts->num_threads)) {
+        return EXIT_FAILURE;
+    }
+    struct simulation sim;
+    if (!sim_create(&sim, &g, &opts->sim)) {
+        pool_destroy(&pool);
+        return EXIT_FAILURE;
+    }
+    int exit_status = EXIT_FAILURE;
+    // Stepping is only timed generation by generation when asked to
+    struct profile profile = {0};
+    if (!seed_sim(&sim, &pool, opts)) {
+        goto free_sim;
+    }
+    if ((opts->profile_path != NULL) && !profile_create(&profile)) {
+        goto free_sim;
+    }
+    struct checkpoints cps;
+    if (!checkpoints_start(&cps, opts, &sim)) {
+        goto free_sim;
+    }
+    struct recording rec;
+    if (!recording_start(&rec, opts, &sim)) {
+        checkpoints_finish(&cps, &sim);
+        goto free_sim;
+    }
+    struct census_series series;
+    if (!census_series_start(&series, opts, &sim)) {
+        checkpoints_finish(&cps, &sim);
+        recording_finish(&rec);
+        goto free_sim;
     }
 
-    // Up
-    for (size_t y = 0; y < SCREEN_HEIGHT - 1; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 0; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i + SCREEN_WIDTH] += (cells[i] == LIVE_CELL);
+    // A hashlife step or a block of generations can advance more than one
+    // generation, so the run may overshoot. Generations jumped over in a
+    // cycle are not counted in the rate.
+    const uint64_t first_generation = sim.generation;
+    const uint64_t last_generation = first_generation + opts->generations;
+    const struct tile_map* const tiles = sim_tiles(&sim);
+    size_t total_active_tiles = 0;
+    struct cycle_detector cycles;
+    cycle_detector_reset(&cycles);
+    size_t period = 0;
+    uint64_t jumped = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct timespec lap = start;
+    struct timespec last_dump = start;
+    bool failed = false;
+    while (sim.generation < last_generation) {
+        if (!sim_step(&sim, &pool)) {
+            failed = true;
+            break;
+        }
+        if (profile.phases != NULL) {
+            profile_lap(&profile, PHASE_STEP, &lap);
+            profile_update(&profile, opts, &last_dump, &lap);
+        }
+        checkpoints_update(&cps, opts, &sim);
+        recording_update(&rec, &sim);
+        census_series_update(&series, &sim);
+        if (tiles != NULL) {
+            total_active_tiles += tiles->num_active;
+        }
+        if ((opts->on_cycle != CYCLE_NONE) && (period == 0)) {
+            period = cycle_detector_push(&cycles, sim.hash);
+            if (period > 0) {
+                printf("Cycle:       period %zu found at generation %" PRIu64 "\n", period, sim.generation);
+                if (opts->on_cycle == CYCLE_STOP) {
+                    break;
+                }
+                if (opts->on_cycle == CYCLE_JUMP) {
+                    // Every period generations bring the grid back to where
+                    // it is now, so only the remainder has to be stepped
+                    jumped = ((last_generation - sim.generation) / period) * period;
+                    sim.generation += jumped;
+                    printf("Cycle:       jumped %" PRIu64 " generations to %" PRIu64 "\n", jumped, sim.generation);
+                }
+            }
         }
     }
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
 
-    // Up right
-    for (size_t y = 0; y < SCREEN_HEIGHT - 1; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 1; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i + SCREEN_WIDTH - 1] += (cells[i] == LIVE_CELL);
-        }
+    const uint64_t generations = sim.generation - first_generation - jumped;
+    const int64_t elapsed_ns = get_time_diff_ns(&start, &stop);
+    const double gens_per_s = (double)generations * NS_PER_S / (double)elapsed_ns;
+    printf("Engine:      %s, %zu thread(s)\n", sim_engine_name(&sim), pool.num_threads);
+    if (opts->sim.block_generations > 0) {
+        printf("Blocks:      %zu generations per pass, %zux%zu cell tiles\n",
+               opts->sim.block_generations, opts->sim.block_size, opts->sim.block_size);
+    }
+    char rule[RULE_STRING_SIZE];
+    format_rule(&g.rule, rule, sizeof(rule));
+    printf("Grid:        %zux%zu, %s\n", g.width, g.height, rule);
+    printf("Generations: %" PRIu64 " in %.3f s\n", generations, (double)elapsed_ns / NS_PER_S);
+    printf("Rate:        %.1f generations/s, %.3e cells/s\n", gens_per_s, gens_per_s * (double)(g.width * g.height));
+    if (tiles != NULL) {
+        printf("Tiles:       %.1f of %zu active per generation\n",
+               (double)total_active_tiles / (double)generations,
+               tile_map_num_tiles(tiles));
+    }
+    if (sim.engine == ENGINE_PLANE) {
+        const struct plane* const plane = &sim.plane;
+        printf("Plane:       %" PRIu64 " live cells in %zu tiles, %zu tiles pooled, %" PRIu64 " created and %" PRIu64 " recycled\n",
+               plane_population(plane), plane->num_tiles, plane->num_blocks * PLANE_BLOCK_TILES, plane->num_created, plane->num_recycled);
     }
+    print_census(&sim);
+    checkpoints_finish(&cps, &sim);
+    recording_finish(&rec);
+    census_series_finish(&series);
+    profile_finish(&profile, opts);
+    exit_status = failed ? EXIT_FAILURE : EXIT_SUCCESS;
 
-    // Left
-    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 0; x < SCREEN_WIDTH - 1; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i + 1] += (cells[i] == LIVE_CELL);
-        }
+free_sim:
+    profile_destroy(&profile);
+    sim_destroy(&sim);
+    pool_destroy(&pool);
+    return exit_status;
+}
+
+// Decodes the generation to seek to, or every generation in turn, and
+// reports how long it took. The generation reached is written to
+// opts->checkpoint_path if there is one.
+static int run_replay_headless(const struct options* const opts)
+{
+    struct replay* const rp = opts->replay;
+    struct bitgrid grid = bitgrid_create(opts->grid_width, opts->grid_height, opts->boundary, &opts->rule);
+    if (grid.words == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for the replay.\n");
+        return EXIT_FAILURE;
     }
+    int exit_status = EXIT_FAILURE;
+    char rule[RULE_STRING_SIZE];
+    format_rule(&opts->rule, rule, sizeof(rule));
+    printf("Recording:   %zux%zu, %s, generations %" PRIu64 " to %" PRIu64 ", %zu keyframes\n",
+           grid.width, grid.height, rule, rp->keyframes[0].generation, rp->last_generation, rp->num_keyframes);
 
-    // Right
-    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 1; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i - 1] += (cells[i] == LIVE_CELL);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t generations = 0;
+    if (opts->seek_given) {
+        if (!replay_seek(rp, &grid, opts->seek, NULL)) {
+            goto free_grid;
+        }
+    } else {
+        while (replay_next(rp, &grid, NULL)) {
+            generations++;
         }
+        if (!rp->positioned) {
+            goto free_grid;
+        }
+    }
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    const int64_t elapsed_ns = get_time_diff_ns(&start, &stop);
+    if (opts->seek_given) {
+        printf("Seek:        generation %" PRIu64 " in %.3f ms\n", rp->generation, (double)elapsed_ns / 1e6);
+    } else {
+        printf("Replay:      %" PRIu64 " generations in %.3f s, %.1f generations/s\n",
+               generations, (double)elapsed_ns / NS_PER_S, (double)generations * NS_PER_S / (double)elapsed_ns);
     }
 
-    // Down left
-    for (size_t y = 1; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 0; x < SCREEN_WIDTH - 1; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i - SCREEN_WIDTH + 1] += (cells[i] == LIVE_CELL);
-        }
+    if ((opts->checkpoint_path == NULL) || write_checkpoint(opts->checkpoint_path, &grid, rp->generation)) {
+        exit_status = EXIT_SUCCESS;
     }
 
-    // Down
-    for (size_t y = 1; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 0; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i - SCREEN_WIDTH] += (cells[i] == LIVE_CELL);
-        }
+free_grid:
+    bitgrid_destroy(&grid);
+    return exit_status;
+}
+
+// Steps opts->generations generations on the workers with one command, so
+// that they only ever wait for each other's halo rows
+static int run_domain_headless(const struct options* const opts)
+{
+    const struct grid g = grid_init(opts->grid_width, opts->grid_height, opts->boundary, &opts->rule);
+    struct domain d;
+    if (!start_domain(&d, &g, opts)) {
+        return EXIT_FAILURE;
+    }
+    int exit_status = EXIT_FAILURE;
+    const uint64_t first_generation = d.generation;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!domain_step(&d, opts->generations)) {
+        goto stop_domain;
     }
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
 
-    // Down right
-    for (size_t y = 1; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 1; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i - SCREEN_WIDTH - 1] += (cells[i] == LIVE_CELL);
+    const uint64_t generations = d.generation - first_generation;
+    const int64_t elapsed_ns = get_time_diff_ns(&start, &stop);
+    const double gens_per_s = (double)generations * NS_PER_S / (double)elapsed_ns;
+    const struct cell_kernel* const kernel = (opts->sim.kernel != NULL) ? opts->sim.kernel : select_cell_kernel();
+    printf("Engine:      %s, %zu worker(s) over %s, %zu thread(s) each\n",
+           kernel->name, d.num_workers, transport_name(d.transport), threads_per_worker(opts));
+    char rule[RULE_STRING_SIZE];
+    format_rule(&g.rule, rule, sizeof(rule));
+    printf("Grid:        %zux%zu, %s\n", g.width, g.height, rule);
+    printf("Generations: %" PRIu64 " in %.3f s\n", generations, (double)elapsed_ns / NS_PER_S);
+    printf("Rate:        %.1f generations/s, %.3e cells/s\n", gens_per_s, gens_per_s * (double)(g.width * g.height));
+    printf("Halos:       slowest worker waited %.1f%% of the time\n", 100.0 * (double)d.wait_ns / (double)elapsed_ns);
+    if (opts->checkpoint_path != NULL) {
+        if (!domain_gather(&d) || !write_checkpoint(opts->checkpoint_path, &d.frame, d.generation)) {
+            goto stop_domain;
         }
     }
+    exit_status = EXIT_SUCCESS;
+
+stop_domain:
+    domain_stop(&d);
+    return exit_status;
+}
+
+// Times the same generations on 1 to opts->num_workers workers with one
+// thread each: the same grid split ever finer for strong scaling, and a
+// grid that grows by opts->grid_height rows per worker for weak scaling
+static int print_domain_report(const struct options* const opts)
+{
+    struct board_seed seed = opts->seed;
+    if (!opts->seed_given && !random_seed(&seed.seed)) {
+        return EXIT_FAILURE;
+    }
+    const struct cell_kernel* const kernel = (opts->sim.kernel != NULL) ? opts->sim.kernel : select_cell_kernel();
+    const size_t generations = opts->report_generations;
+    printf("Kernel: %s, %zu generations, 1 thread per worker over %s, seed %" PRIu64 "\n",
+           kernel->name, generations, transport_name(opts->transport), seed.seed);
+    for (int weak = 0; weak <= 1; weak++) {
+        if (weak) {
+            printf("Weak scaling, %zux%zu cells per worker:\n", opts->grid_width, opts->grid_height);
+        } else {
+            printf("Strong scaling, %zux%zu cells:\n", opts->grid_width, opts->grid_height);
+        }
+        printf("%8s %12s %14s %12s %11s %9s\n", "workers", "time (ms)", "gens/s", "cells/s", "efficiency", "waiting");
+        double base_ns = 0.0;
+        for (size_t num_workers = 1; num_workers <= opts->num_workers; num_workers++) {
+            const size_t height = weak ? opts->grid_height * num_workers : opts->grid_height;
+            const struct grid g = grid_init(opts->grid_width, height, opts->boundary, &opts->rule);
+            struct bitgrid start = bitgrid_create(g.width, g.height, g.boundary, &g.rule);
+            struct thread_pool pool;
+            if ((start.words == NULL) || !pool_create(&pool, opts->num_threads)) {
+                fprintf(stderr, "Error: Failed to allocate memory for the start grid.\n");
+                bitgrid_destroy(&start);
+                return EXIT_FAILURE;
+            }
+            seed_bitgrid(&pool, &seed, &start);
+            pool_destroy(&pool);
+            struct domain d;
+            const bool started = domain_start(&d, &g, kernel, num_workers, 1, opts->transport, &start, 0);
+            bitgrid_destroy(&start);
+            if (!started) {
+                return EXIT_FAILURE;
+            }
+            struct timespec t0;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            const bool stepped = domain_step(&d, generations);
+            struct timespec t1;
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            const double wait_ns = (double)d.wait_ns;
+            domain_stop(&d);
+            if (!stepped) {
+                return EXIT_FAILURE;
+            }
 
-    // Update cells
-    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        for (size_t x = 0; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            const uint32_t num_neighbors = neighbor_counts[i];
-            if ((num_neighbors == 3) || ((cells[i] == LIVE_CELL) && (num_neighbors == 2))) {
-                cells[i] = LIVE_CELL;
-            } else {
-                cells[i] = DEAD_CELL;
+            // Perfect strong scaling divides the time by the workers, and
+            // perfect weak scaling keeps it the same
+            const double elapsed_ns = (double)get_time_diff_ns(&t0, &t1);
+            if (num_workers == 1) {
+                base_ns = elapsed_ns;
             }
+            const double efficiency = weak ? base_ns / elapsed_ns : base_ns / (elapsed_ns * (double)num_workers);
+            const double gens_per_s = (double)generations * NS_PER_S / elapsed_ns;
+            printf("%8zu %12.2f %14.1f %12.3e %10.1f%% %8.1f%%\n",
+                   num_workers,
+                   elapsed_ns / 1e6,
+                   gens_per_s,
+                   gens_per_s * (double)(g.width * g.height),
+                   100.0 * efficiency,
+                   100.0 * wait_ns / elapsed_ns);
         }
     }
+    return EXIT_SUCCESS;
 }
-#endif
 
-#ifdef __ARM_NEON__
-void update_cells_neon(
-    uint32_t cells[const static NUM_PIXELS],
-    uint32_t neighbor_counts[const static NUM_PIXELS])
-{
-    const uint32x4_t live_vec = vdupq_n_u32(LIVE_CELL);
-    const uint32x4_t one_vec = vdupq_n_u32(1);
-
-    // Up left
-    for (size_t y = 0; y < SCREEN_HEIGHT - 1; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 0;
-        for (; (x + 4) <= SCREEN_WIDTH - 1; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            vst1q_u32(neighbor_counts + i + SCREEN_WIDTH + 1, vandq_u32(is_alive_vec, one_vec));
-        }
-        for (; x < SCREEN_WIDTH - 1; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i + SCREEN_WIDTH + 1] = (cells[i] == LIVE_CELL);
-        }
-    }
-
-    // Up
-    for (size_t y = 0; y < SCREEN_HEIGHT - 1; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 0;
-        for (; (x + 4) <= SCREEN_WIDTH; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            const uint32x4_t inc_vec = vandq_u32(is_alive_vec, one_vec);
-            const size_t i_down = i + SCREEN_WIDTH;
-            const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i_down);
-            vst1q_u32(neighbor_counts + i_down, vaddq_u32(num_neighbors_vec, inc_vec));
-        }
-        for (; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i + SCREEN_WIDTH] += (cells[i] == LIVE_CELL);
-        }
-    }
-
-    // Up right
-    for (size_t y = 0; y < SCREEN_HEIGHT - 1; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 1;
-        for (; (x + 4) <= SCREEN_WIDTH; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            const uint32x4_t inc_vec = vandq_u32(is_alive_vec, one_vec);
-            const size_t i_down_left = i + SCREEN_WIDTH - 1;
-            const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i_down_left);
-            vst1q_u32(neighbor_counts + i_down_left, vaddq_u32(num_neighbors_vec, inc_vec));
-        }
-        for (; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i + SCREEN_WIDTH - 1] += (cells[i] == LIVE_CELL);
-        }
-    }
-
-    // Left
-    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 0;
-        for (; (x + 4) <= SCREEN_WIDTH - 1; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            const uint32x4_t inc_vec = vandq_u32(is_alive_vec, one_vec);
-            const size_t i_right = i + 1;
-            const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i_right);
-            vst1q_u32(neighbor_counts + i_right, vaddq_u32(num_neighbors_vec, inc_vec));
-        }
-        for (; x < SCREEN_WIDTH - 1; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i + 1] += (cells[i] == LIVE_CELL);
-        }
-    }
-
-    // Right
-    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 1;
-        for (; (x + 4) <= SCREEN_WIDTH; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            const uint32x4_t inc_vec = vandq_u32(is_alive_vec, one_vec);
-            const size_t i_left = i - 1;
-            const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i_left);
-            vst1q_u32(neighbor_counts + i_left, vaddq_u32(num_neighbors_vec, inc_vec));
-        }
-        for (; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i - 1] += (cells[i] == LIVE_CELL);
-        }
-    }
-
-    // Down left
-    for (size_t y = 1; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 0;
-        for (; (x + 4) <= SCREEN_WIDTH - 1; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            const uint32x4_t inc_vec = vandq_u32(is_alive_vec, one_vec);
-            const size_t i_up_right = i - SCREEN_WIDTH + 1;
-            const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i_up_right);
-            vst1q_u32(neighbor_counts + i_up_right, vaddq_u32(num_neighbors_vec, inc_vec));
-        }
-        for (; x < SCREEN_WIDTH - 1; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i - SCREEN_WIDTH + 1] += (cells[i] == LIVE_CELL);
-        }
-    }
-
-    // Down
-    for (size_t y = 1; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 0;
-        for (; (x + 4) <= SCREEN_WIDTH; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            const uint32x4_t inc_vec = vandq_u32(is_alive_vec, one_vec);
-            const size_t i_up = i - SCREEN_WIDTH;
-            const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i_up);
-            vst1q_u32(neighbor_counts + i_up, vaddq_u32(num_neighbors_vec, inc_vec));
-        }
-        for (; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i - SCREEN_WIDTH] += (cells[i] == LIVE_CELL);
-        }
-    }
-
-    // Down right
-    for (size_t y = 1; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 1;
-        for (; (x + 4) <= SCREEN_WIDTH; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            const uint32x4_t inc_vec = vandq_u32(is_alive_vec, one_vec);
-            const size_t i_up_left = i - SCREEN_WIDTH - 1;
-            const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i_up_left);
-            vst1q_u32(neighbor_counts + i_up_left, vaddq_u32(num_neighbors_vec, inc_vec));
-        }
-        for (; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            neighbor_counts[i - SCREEN_WIDTH - 1] += (cells[i] == LIVE_CELL);
-        }
-    }
-
-    // Update cells
-    const uint32x4_t three_vec = vdupq_n_u32(3);
-    const uint32x4_t two_vec = vdupq_n_u32(2);
-    const uint32x4_t dead_vec = vdupq_n_u32(DEAD_CELL);
-    for (size_t y = 0; y < SCREEN_HEIGHT; y++) {
-        const size_t row = y * SCREEN_WIDTH;
-        size_t x = 0;
-        for (; (x + 4) <= SCREEN_WIDTH; x += 4) {
-            const size_t i = row + x;
-            const uint32x4_t num_neighbors_vec = vld1q_u32(neighbor_counts + i);
-            const uint32x4_t has_three_neighbors_vec = vceqq_u32(num_neighbors_vec, three_vec);
-            const uint32x4_t has_two_neighbors_vec = vceqq_u32(num_neighbors_vec, two_vec);
-            const uint32x4_t cell_vec = vld1q_u32(cells + i);
-            const uint32x4_t is_alive_vec = vceqq_u32(cell_vec, live_vec);
-            const uint32x4_t should_live_vec = vorrq_u32(has_three_neighbors_vec, vandq_u32(is_alive_vec, has_two_neighbors_vec));
-            const uint32x4_t should_die_vec = vmvnq_u32(should_live_vec);
-            const uint32x4_t new_cell_vec = vorrq_u32(
-                vandq_u32(should_die_vec, dead_vec),
-                vandq_u32(should_live_vec, live_vec)
-            );
-            vst1q_u32(cells + i, new_cell_vec);
-        }
-        for (; x < SCREEN_WIDTH; x++) {
-            const size_t i = row + x;
-            const uint32_t num_neighbors = neighbor_counts[i];
-            if ((num_neighbors == 3) || ((cells[i] == LIVE_CELL) && (num_neighbors == 2))) {
-                cells[i] = LIVE_CELL;
-            } else {
-                cells[i] = DEAD_CELL;
-            }
+// Steps the same random board on 1 to num_threads threads
+static int print_scaling_report(const struct options* const opts)
+{
+    if (opts->sim.engine == ENGINE_HASHLIFE) {
+        fprintf(stderr, "Error: The hashlife engine runs on one thread.\n");
+        return EXIT_FAILURE;
+    }
+    const struct grid g = grid_init(opts->grid_width, opts->grid_height, opts->boundary, &opts->rule);
+    const size_t generations = opts->report_generations;
+    struct simulation start;
+    struct simulation sim;
+    if (!sim_create(&start, &g, &opts->sim)) {
+        return EXIT_FAILURE;
+    }
+    if (!sim_create(&sim, &g, &opts->sim)) {
+        sim_destroy(&start);
+        return EXIT_FAILURE;
+    }
+    int exit_status = EXIT_FAILURE;
+    struct thread_pool seed_pool;
+    if (!pool_create(&seed_pool, opts->num_threads)) {
+        goto free_sims;
+    }
+    const bool seeded = seed_sim(&start, &seed_pool, opts);
+    pool_destroy(&seed_pool);
+    if (!seeded) {
+        goto free_sims;
+    }
+    printf("Engine: %s, %zux%zu cells, %zu generations\n", sim_engine_name(&sim), g.width, g.height, generations);
+
+    printf("%8s %12s %14s %9s %11s\n", "threads", "time (ms)", "gens/s", "speedup", "efficiency");
+    double base_ns = 0.0;
+    for (size_t num_threads = 1; num_threads <= opts->num_threads; num_threads++) {
+        struct thread_pool pool;
+        if (!pool_create(&pool, num_threads)) {
+            goto free_sims;
         }
+        sim_copy(&sim, &start);
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        bool stepped_all = true;
+        while (stepped_all && (sim.generation < start.generation + generations)) {
+            stepped_all = sim_step(&sim, &pool);
+        }
+        struct timespec t1;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        pool_destroy(&pool);
+        if (!stepped_all) {
+            goto free_sims;
+        }
+
+        const uint64_t stepped = sim.generation - start.generation;
+        const double elapsed_ns = (double)get_time_diff_ns(&t0, &t1);
+        if (num_threads == 1) {
+            base_ns = elapsed_ns;
+        }
+        const double speedup = base_ns / elapsed_ns;
+        printf("%8zu %12.2f %14.1f %8.2fx %10.1f%%\n",
+               num_threads,
+               elapsed_ns / 1e6,
+               (double)stepped * NS_PER_S / elapsed_ns,
+               speedup,
+               100.0 * speedup / (double)num_threads);
     }
+    exit_status = EXIT_SUCCESS;
+
+free_sims:
+    sim_destroy(&start);
+    sim_destroy(&sim);
+    return exit_status;
 }
-#endif
 
+// Runs opts->num_universes boards of the grid size, seeded from opts->seed
+// on, and reports how many settled into what
+static int run_ensemble(const struct options* const opts)
+{
+    struct ensemble_config config = {
+        .width = opts->grid_width,
+        .height = opts->grid_height,
+        .boundary = opts->boundary,
+        .rule = opts->rule,
+        .first_seed = opts->seed.seed,
+        .density = opts->seed.density,
+        .num_universes = opts->num_universes,
+        .max_generations = opts->generations
+    };
+    if (!opts->seed_given && !random_seed(&config.first_seed)) {
+        return EXIT_FAILURE;
+    }
+    FILE* out = NULL;
+    if (opts->results_path != NULL) {
+        out = fopen(opts->results_path, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Error when opening %s: %s\n", opts->results_path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    struct thread_pool pool;
+    if (!pool_create(&pool, opts->num_threads)) {
+        if (out != NULL) {
+            fclose(out);
+        }
+        return EXIT_FAILURE;
+    }
+    struct ensemble_stats stats;
+    const bool ok = ensemble_run(&pool, &config, out, &stats);
+    const size_t num_threads = pool.num_threads;
+    pool_destroy(&pool);
+    if ((out != NULL) && (fclose(out) != 0)) {
+        fprintf(stderr, "Error when writing %s: %s\n", opts->results_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (!ok) {
+        return EXIT_FAILURE;
+    }
+
+    const double seconds = (double)stats.elapsed_ns / NS_PER_S;
+    char rule[RULE_STRING_SIZE];
+    format_rule(&config.rule, rule, sizeof(rule));
+    printf("Engine:      ensemble, %d universes per batch, %zu thread(s)\n", ENSEMBLE_LANES, num_threads);
+    printf("Grid:        %zux%zu, %s, %s\n", config.width, config.height, (config.boundary == BOUNDARY_TORUS) ? "torus" : "dead", rule);
+    printf("Seeds:       %" PRIu64 " to %" PRIu64 " at density %.3f\n",
+           config.first_seed, config.first_seed + config.num_universes - 1, config.density);
+    printf("Universes:   %" PRIu64 " in %.3f s, %" PRIu64 " stolen\n", config.num_universes, seconds, stats.num_stolen);
+    printf("Settled:     %" PRIu64 " died, %" PRIu64 " still, %" PRIu64 " oscillating, %" PRIu64 " unsettled after %" PRIu64 " generations\n",
+           stats.num_dead, stats.num_still, stats.num_oscillating, stats.num_unsettled, config.max_generations);
+    printf("Rate:        %.1f universes/s, %.3e cells/s\n",
+           (double)config.num_universes / seconds, (double)stats.cell_generations / seconds);
+    return EXIT_SUCCESS;
+}
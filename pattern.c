@@ -0,0 +1,551 @@
+#include "pattern.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Larger run lengths and coordinates are rejected rather than overflowing
+#define MAX_PATTERN_COORD (INT64_C(1) << 62)
+
+// Macrocell leaves are 8x8 squares, and the deepest level keeps every
+// coordinate below MAX_PATTERN_COORD
+#define MACROCELL_LEAF_LEVEL 3
+#define MACROCELL_MAX_LEVEL  61
+
+struct parser {
+    const char* pos;
+    const char* end;
+    const char* path;
+    size_t line;
+    const struct pattern_sink* sink;
+    int64_t offset_x;
+    int64_t offset_y;
+    uint64_t num_live;
+};
+
+static void parse_error(const struct parser* const p, const char* const message)
+{
+    fprintf(stderr, "Error in %s, line %zu: %s\n", p->path, p->line, message);
+}
+
+// Clips a run of live cells that starts at (x, y) in pattern coordinates
+static void emit_run(struct parser* const p, const int64_t x, const int64_t y, const int64_t length)
+{
+    const int64_t grid_y = y + p->offset_y;
+    if ((grid_y < 0) || (grid_y >= (int64_t)p->sink->height)) {
+        return;
+    }
+    // x, length and the offset each stay below MAX_PATTERN_COORD, but their
+    // sum need not fit, so the run is clipped to the grid before it is
+    // added. The room left in the row is at most width + 2^63, which fits
+    // unsigned even when x_start is far left of the grid.
+    const int64_t width = (int64_t)p->sink->width;
+    int64_t x_start = x + p->offset_x;
+    if (x_start >= width) {
+        return;
+    }
+    const bool ends_inside = (uint64_t)length < (uint64_t)width - (uint64_t)x_start;
+    const int64_t x_end = ends_inside ? x_start + length : width;
+    if (x_start < 0) {
+        x_start = 0;
+    }
+    if (x_start >= x_end) {
+        return;
+    }
+    p->sink->set_run(p->sink->ctx, (size_t)x_start, (size_t)grid_y, (size_t)(x_end - x_start));
+    p->num_live += (uint64_t)(x_end - x_start);
+}
+
+static void skip_line(struct parser* const p)
+{
+    const char* const newline = memchr(p->pos, '\n', (size_t)(p->end - p->pos));
+    p->pos = (newline == NULL) ? p->end : newline + 1;
+    p->line++;
+}
+
+static void skip_blanks(struct parser* const p)
+{
+    while ((p->pos < p->end) && ((*p->pos == ' ') || (*p->pos == '\t') || (*p->pos == '\r'))) {
+        p->pos++;
+    }
+}
+
+static bool parse_int(struct parser* const p, int64_t* const value)
+{
+    skip_blanks(p);
+    bool negative = false;
+    if ((p->pos < p->end) && ((*p->pos == '-') || (*p->pos == '+'))) {
+        negative = *p->pos == '-';
+        p->pos++;
+    }
+    if ((p->pos == p->end) || (*p->pos < '0') || (*p->pos > '9')) {
+        parse_error(p, "Expected a number");
+        return false;
+    }
+    int64_t parsed = 0;
+    while ((p->pos < p->end) && (*p->pos >= '0') && (*p->pos <= '9')) {
+        parsed = (parsed * 10) + (*p->pos - '0');
+        if (parsed >= MAX_PATTERN_COORD) {
+            parse_error(p, "Number out of range");
+            return false;
+        }
+        p->pos++;
+    }
+    *value = negative ? -parsed : parsed;
+    return true;
+}
+
+// Runs of cells are "<count><tag>", where the count defaults to 1 and the
+// tag is b for dead cells, o for live cells and $ for the end of a row. The
+// pattern ends with !. Other letters are states of multi-state rules and are
+// loaded as live cells.
+static bool parse_rle(struct parser* const p)
+{
+    // Comments and the "x = W, y = H, rule = R" header come first
+    while (p->pos < p->end) {
+        skip_blanks(p);
+        if ((p->pos < p->end) && ((*p->pos == '#') || (*p->pos == 'x') || (*p->pos == '\n'))) {
+            const bool is_header = *p->pos == 'x';
+            skip_line(p);
+            if (is_header) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    int64_t x = 0;
+    int64_t y = 0;
+    int64_t count = 0;
+    while (p->pos < p->end) {
+        const char c = *p->pos++;
+        if ((c >= '0') && (c <= '9')) {
+            count = (count * 10) + (c - '0');
+            if (count >= MAX_PATTERN_COORD) {
+                parse_error(p, "Run length out of range");
+                return false;
+            }
+            continue;
+        }
+        if ((c == ' ') || (c == '\t') || (c == '\r')) {
+            continue;
+        }
+        if (c == '\n') {
+            p->line++;
+            continue;
+        }
+        const int64_t n = (count == 0) ? 1 : count;
+        count = 0;
+        if (c == '!') {
+            return true;
+        } else if (c == '$') {
+            y += n;
+            x = 0;
+        } else if ((c == 'b') || (c == '.')) {
+            x += n;
+        } else if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'))) {
+            emit_run(p, x, y, n);
+            x += n;
+        } else {
+            parse_error(p, "Unexpected character");
+            return false;
+        }
+        if ((x >= MAX_PATTERN_COORD) || (y >= MAX_PATTERN_COORD)) {
+            parse_error(p, "Pattern too large");
+            return false;
+        }
+    }
+    // Tolerate a missing '!'
+    return true;
+}
+
+// One "x y" pair of coordinates per live cell
+static bool parse_life_106(struct parser* const p)
+{
+    while (p->pos < p->end) {
+        skip_blanks(p);
+        if (p->pos == p->end) {
+            break;
+        }
+        if ((*p->pos == '#') || (*p->pos == '\n')) {
+            skip_line(p);
+            continue;
+        }
+        int64_t x, y;
+        if (!parse_int(p, &x) || !parse_int(p, &y)) {
+            return false;
+        }
+        emit_run(p, x, y, 1);
+        skip_line(p);
+    }
+    return true;
+}
+
+// Node 0 is the empty node of any level. Leaves hold 8x8 cells, one byte per
+// row with the least significant bit leftmost.
+struct macrocell_node {
+    uint8_t level;
+    union {
+        uint64_t rows;
+        uint32_t children[4];
+    };
+};
+
+static void paint_macrocell(
+    struct parser* const p,
+    const struct macrocell_node* const nodes,
+    const uint32_t index,
+    const int64_t x0,
+    const int64_t y0)
+{
+    if (index == 0) {
+        return;
+    }
+    const struct macrocell_node* const node = &nodes[index];
+    const int64_t size = INT64_C(1) << node->level;
+    // Skip nodes that are entirely outside the sink
+    if ((x0 + p->offset_x >= (int64_t)p->sink->width) || (x0 + size + p->offset_x <= 0)
+        || (y0 + p->offset_y >= (int64_t)p->sink->height) || (y0 + size + p->offset_y <= 0)) {
+        return;
+    }
+    if (node->level == MACROCELL_LEAF_LEVEL) {
+        for (int64_t y = 0; y < 8; y++) {
+            const unsigned int row = (unsigned int)(node->rows >> (y * 8)) & 0xFF;
+            int64_t x = 0;
+            while (x < 8) {
+                if (!((row >> x) & 1)) {
+                    x++;
+                    continue;
+                }
+                const int64_t start = x;
+                while ((x < 8) && ((row >> x) & 1)) {
+                    x++;
+                }
+                emit_run(p, x0 + start, y0 + y, x - start);
+            }
+        }
+        return;
+    }
+    const int64_t half = size / 2;
+    paint_macrocell(p, nodes, node->children[0], x0, y0);
+    paint_macrocell(p, nodes, node->children[1], x0 + half, y0);
+    paint_macrocell(p, nodes, node->children[2], x0, y0 + half);
+    paint_macrocell(p, nodes, node->children[3], x0 + half, y0 + half);
+}
+
+// Every line after the "[M2]" header defines the next node, numbered from
+// 1: either an 8x8 leaf of '.', '*' and '$', or "level nw ne sw se". The
+// nodes have to be kept until the last one, the root, is read, so they are
+// painted into the sink at the end.
+static bool parse_macrocell(struct parser* const p)
+{
+    size_t capacity = 1 << 16;
+    size_t num_nodes = 1;
+    struct macrocell_node* nodes = malloc(capacity * sizeof(struct macrocell_node));
+    if (nodes == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for macrocell nodes.\n");
+        return false;
+    }
+    nodes[0].level = 0;
+    nodes[0].rows = 0;
+    skip_line(p);
+
+    bool ok = true;
+    while (ok && (p->pos < p->end)) {
+        skip_blanks(p);
+        if (p->pos == p->end) {
+            break;
+        }
+        if ((*p->pos == '#') || (*p->pos == '\n')) {
+            skip_line(p);
+            continue;
+        }
+        if (num_nodes == capacity) {
+            if (capacity > UINT32_MAX / 2) {
+                parse_error(p, "Too many nodes");
+                ok = false;
+                break;
+            }
+            capacity *= 2;
+            struct macrocell_node* const grown = realloc(nodes, capacity * sizeof(struct macrocell_node));
+            if (grown == NULL) {
+                fprintf(stderr, "Error: Failed to allocate memory for macrocell nodes.\n");
+                ok = false;
+                break;
+            }
+            nodes = grown;
+        }
+        struct macrocell_node* const node = &nodes[num_nodes];
+        const char c = *p->pos;
+        if ((c == '.') || (c == '*') || (c == '$')) {
+            node->level = MACROCELL_LEAF_LEVEL;
+            node->rows = 0;
+            unsigned int x = 0;
+            unsigned int y = 0;
+            while ((p->pos < p->end) && (*p->pos != '\n')) {
+                const char cell = *p->pos++;
+                if (cell == '$') {
+                    x = 0;
+                    y++;
+                } else if ((cell == '.') || (cell == '*')) {
+                    if ((x >= 8) || (y >= 8)) {
+                        parse_error(p, "Leaf larger than 8x8");
+                        ok = false;
+                        break;
+                    }
+                    node->rows |= (uint64_t)(cell == '*') << ((y * 8) + x);
+                    x++;
+                } else if ((cell != ' ') && (cell != '\t') && (cell != '\r')) {
+                    parse_error(p, "Unexpected character");
+                    ok = false;
+                    break;
+                }
+            }
+        } else {
+            int64_t level;
+            int64_t children[4];
+            ok = parse_int(p, &level);
+            for (size_t i = 0; ok && (i < 4); i++) {
+                ok = parse_int(p, &children[i]);
+            }
+            if (!ok) {
+                break;
+            }
+            if ((level <= MACROCELL_LEAF_LEVEL) || (level > MACROCELL_MAX_LEVEL)) {
+                parse_error(p, "Unsupported node level (only two-state patterns are supported)");
+                ok = false;
+                break;
+            }
+            node->level = (uint8_t)level;
+            for (size_t i = 0; i < 4; i++) {
+                if ((children[i] < 0) || ((size_t)children[i] >= num_nodes)
+                    || ((children[i] != 0) && (nodes[children[i]].level + 1 != level))) {
+                    parse_error(p, "Invalid child node");
+                    ok = false;
+                    break;
+                }
+                node->children[i] = (uint32_t)children[i];
+            }
+        }
+        if (ok) {
+            num_nodes++;
+            skip_line(p);
+        }
+    }
+    if (ok && (num_nodes > 1)) {
+        paint_macrocell(p, nodes, (uint32_t)(num_nodes - 1), 0, 0);
+    }
+    free(nodes);
+    return ok;
+}
+
+static enum pattern_format detect_format(const char* const data, const size_t size)
+{
+    static const char macrocell_magic[] = "[M2]";
+    static const char life_106_magic[] = "#Life 1.06";
+    if ((size >= sizeof(macrocell_magic) - 1) && (memcmp(data, macrocell_magic, sizeof(macrocell_magic) - 1) == 0)) {
+        return PATTERN_MACROCELL;
+    }
+    if ((size >= sizeof(life_106_magic) - 1) && (memcmp(data, life_106_magic, sizeof(life_106_magic) - 1) == 0)) {
+        return PATTERN_LIFE_106;
+    }
+    return PATTERN_RLE;
+}
+
+// Maps the file and parses it in a single pass straight into the sink. The
+// top left of an RLE or macrocell pattern and the origin of a Life 1.06
+// pattern land on (offset_x, offset_y).
+bool pattern_load(
+    const char* const path,
+    const struct pattern_sink* const sink,
+    const int64_t offset_x,
+    const int64_t offset_y,
+    struct pattern_stats* const stats)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Error when opening %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "Error when reading %s: %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    const size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        fprintf(stderr, "Error: %s is empty\n", path);
+        close(fd);
+        return false;
+    }
+    const char* const data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error when mapping %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    posix_madvise((void*)data, size, POSIX_MADV_SEQUENTIAL);
+
+    struct parser p = {
+        .pos = data,
+        .end = data + size,
+        .path = path,
+        .line = 1,
+        .sink = sink,
+        .offset_x = offset_x,
+        .offset_y = offset_y,
+        .num_live = 0
+    };
+    const enum pattern_format format = detect_format(data, size);
+    bool ok = false;
+    switch (format) {
+    case PATTERN_RLE:
+        ok = parse_rle(&p);
+        break;
+    case PATTERN_LIFE_106:
+        ok = parse_life_106(&p);
+        break;
+    case PATTERN_MACROCELL:
+        ok = parse_macrocell(&p);
+        break;
+    }
+    munmap((void*)data, size);
+
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    stats->format = format;
+    stats->num_bytes = size;
+    stats->num_live = p.num_live;
+    stats->elapsed_ns = get_time_diff_ns(&start, &stop);
+    return ok;
+}
+
+// Rules are written in B/S notation or as S/B digits, such as 23/36, and
+// may end in a colon and the size of a bounded grid, which is ignored
+static bool parse_pattern_rule(const char* const path, const size_t line, const char* text, struct rule* const rule)
+{
+    while ((*text == ' ') || (*text == '\t')) {
+        text++;
+    }
+    char name[RULE_STRING_SIZE];
+    size_t len = 0;
+    while ((text[len] != '\0') && (strchr(" \t\r\n,:", text[len]) == NULL) && (len < sizeof(name) - 1)) {
+        name[len] = (char)tolower((unsigned char)text[len]);
+        len++;
+    }
+    name[len] = '\0';
+    char* const slash = strchr(name, '/');
+    bool ok;
+    if ((slash != NULL) && ((name[0] == '/') || isdigit((unsigned char)name[0]))) {
+        char swapped[RULE_STRING_SIZE + 3];
+        *slash = '\0';
+        snprintf(swapped, sizeof(swapped), "B%s/S%s", slash + 1, name);
+        *slash = '/';
+        ok = parse_rule(swapped, rule);
+    } else {
+        ok = parse_rule(name, rule);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error in %s, line %zu: Unsupported rule: %s\n", path, line, name);
+    }
+    return ok;
+}
+
+// Only reads the lines before the cells: the comments and the header of an
+// RLE file, where "rule = R" names the rule, or the comments after the
+// "[M2]" line of a macrocell file, where "#R R" does. Life 1.06 files never
+// name a rule.
+bool pattern_read_rule(const char* const path, struct rule* const rule, bool* const found)
+{
+    *found = false;
+    FILE* const file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error when opening %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char* text = NULL;
+    size_t capacity = 0;
+    size_t line = 0;
+    bool ok = true;
+    bool macrocell = false;
+    while (ok && (getline(&text, &capacity, file) != -1)) {
+        line++;
+        const char* s = text;
+        while ((*s == ' ') || (*s == '\t')) {
+            s++;
+        }
+        if ((line == 1) && (strncmp(s, "[M2]", 4) == 0)) {
+            macrocell = true;
+        } else if ((line == 1) && (strncmp(s, "#Life 1.06", 10) == 0)) {
+            break;
+        } else if (macrocell && (strncmp(s, "#R", 2) == 0)) {
+            ok = parse_pattern_rule(path, line, s + 2, rule);
+            *found = ok;
+            break;
+        } else if (!macrocell && (*s == 'x')) {
+            const char* const field = strstr(s, "rule");
+            const char* const equals = (field == NULL) ? NULL : strchr(field, '=');
+            if (equals != NULL) {
+                ok = parse_pattern_rule(path, line, equals + 1, rule);
+                *found = ok;
+            }
+            break;
+        } else if ((*s != '#') && (*s != '\n') && (*s != '\r') && (*s != '\0')) {
+            break;
+        }
+    }
+    if (ferror(file)) {
+        fprintf(stderr, "Error when reading %s: %s\n", path, strerror(errno));
+        ok = false;
+    }
+    free(text);
+    fclose(file);
+    return ok;
+}
+
+const char* pattern_format_name(const enum pattern_format format)
+{
+    switch (format) {
+    case PATTERN_RLE:
+        return "RLE";
+    case PATTERN_LIFE_106:
+        return "Life 1.06";
+    case PATTERN_MACROCELL:
+        return "macrocell";
+    }
+    return "unknown";
+}
+
+// Parses "X,Y", where either may be negative
+bool parse_offset(const char* const str, int64_t* const x, int64_t* const y)
+{
+    char* end;
+    errno = 0;
+    const long long parsed_x = strtoll(str, &end, 10);
+    if ((errno != 0) || (end == str) || (*end != ',')) {
+        return false;
+    }
+    const char* const y_str = end + 1;
+    const long long parsed_y = strtoll(y_str, &end, 10);
+    if ((errno != 0) || (end == y_str) || (*end != '\0')) {
+        return false;
+    }
+    if ((llabs(parsed_x) >= MAX_PATTERN_COORD) || (llabs(parsed_y) >= MAX_PATTERN_COORD)) {
+        return false;
+    }
+    *x = parsed_x;
+    *y = parsed_y;
+    return true;
+}
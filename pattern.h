@@ -0,0 +1,37 @@
+#ifndef pattern_h
+#define pattern_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "rule.h"
+
+enum pattern_format {
+    PATTERN_RLE,
+    PATTERN_LIFE_106,
+    PATTERN_MACROCELL
+};
+
+// Where the cells of a pattern go. Runs of live cells are clipped to the
+// width and height of the sink before set_run sees them, and the sink must
+// start out with every cell dead.
+struct pattern_sink {
+    size_t width;
+    size_t height;
+    void (*set_run)(void* ctx, const size_t x, const size_t y, const size_t length);
+    void* ctx;
+};
+
+struct pattern_stats {
+    enum pattern_format format;
+    size_t num_bytes;
+    uint64_t num_live;
+    int64_t elapsed_ns;
+};
+
+bool pattern_load(const char* const path, const struct pattern_sink* const sink, const int64_t offset_x, const int64_t offset_y, struct pattern_stats* const stats);
+bool pattern_read_rule(const char* const path, struct rule* const rule, bool* const found);
+const char* pattern_format_name(const enum pattern_format format);
+bool parse_offset(const char* const str, int64_t* const x, int64_t* const y);
+
+#endif
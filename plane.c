@@ -0,0 +1,667 @@
+#include "plane.h"
+#include "cells.h"
+#include "hash.h"
+#include "planes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct plane_block {
+    struct plane_block* next;
+    struct plane_tile tiles[PLANE_BLOCK_TILES];
+};
+
+static const int64_t direction_dx[PLANE_NUM_DIRECTIONS] = {0, 1, 1, 1, 0, -1, -1, -1};
+static const int64_t direction_dy[PLANE_NUM_DIRECTIONS] = {-1, -1, 0, 1, 1, 1, 0, -1};
+
+// Where each level of the density pyramid starts, from PLANE_DENSITY_LEVEL
+static const size_t density_offset[] = {0, 64, 80, 84};
+
+// The rows of a missing neighbor
+static const uint64_t dead_rows[TILE_SIZE];
+
+static inline enum plane_direction opposite(const enum plane_direction d)
+{
+    return (enum plane_direction)((d + (PLANE_NUM_DIRECTIONS / 2)) % PLANE_NUM_DIRECTIONS);
+}
+
+static inline size_t hash_coords(const int64_t tx, const int64_t ty)
+{
+    uint64_t h = (uint64_t)tx * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)ty * 0xC2B2AE3D27D4EB4Full;
+    return (size_t)(h ^ (h >> 29));
+}
+
+// Words are hashed by where they are on the plane rather than in a grid
+static inline size_t word_index(const struct plane_tile* const t, const size_t y)
+{
+    const uint64_t row = (uint64_t)(t->ty * TILE_SIZE) + y;
+    return (size_t)((row << 32) ^ (uint64_t)t->tx);
+}
+
+// Floors v to a multiple of size, which is a power of two
+static inline int64_t floor_multiple(const int64_t v, const int64_t size)
+{
+    return v - (((v % size) + size) % size);
+}
+
+// Sets the census of a tile from its population and columns, the
+// population of the generation before, the cells that flipped since and a
+// mask of the live rows. As in the bitgrid engine, the census is summed in
+// registers and boxed once per tile; births and deaths follow from the flips
+// and the change in population. The box is counted from CENSUS_ORIGIN.
+static void count_tile(struct plane_tile* const t, const uint32_t before, const uint64_t flips, const uint64_t rows_live)
+{
+    struct census* const c = &t->census;
+    census_clear(c);
+    c->population = t->population;
+    c->births = (flips + t->population - before) / 2;
+    c->deaths = (flips + before - t->population) / 2;
+    if (t->population == 0) {
+        return;
+    }
+    const uint64_t x = CENSUS_ORIGIN + ((uint64_t)t->tx * TILE_SIZE);
+    const uint64_t y = CENSUS_ORIGIN + ((uint64_t)t->ty * TILE_SIZE);
+    c->x_min = x + (uint64_t)__builtin_ctzll(t->columns);
+    c->x_end = x + TILE_SIZE - (uint64_t)__builtin_clzll(t->columns);
+    c->y_min = y + (uint64_t)__builtin_ctzll(rows_live);
+    c->y_end = y + TILE_SIZE - (uint64_t)__builtin_clzll(rows_live);
+}
+
+// Takes CENSUS_ORIGIN off the box of the census of the tiles
+static void set_census(struct plane* const plane, const struct census* const c)
+{
+    plane->census = *c;
+    plane->census.x_min -= CENSUS_ORIGIN;
+    plane->census.y_min -= CENSUS_ORIGIN;
+    plane->census.x_end -= CENSUS_ORIGIN;
+    plane->census.y_end -= CENSUS_ORIGIN;
+}
+
+static struct plane_tile* find_tile(const struct plane* const plane, const int64_t tx, const int64_t ty)
+{
+    const size_t b = hash_coords(tx, ty) & (plane->num_buckets - 1);
+    for (struct plane_tile* t = plane->buckets[b]; t != NULL; t = t->next) {
+        if ((t->tx == tx) && (t->ty == ty)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static void grow_buckets(struct plane* const plane)
+{
+    const size_t num_buckets = plane->num_buckets * 2;
+    struct plane_tile** const buckets = calloc(num_buckets, sizeof(struct plane_tile*));
+    if (buckets == NULL) {
+        // A longer chain is slower but still correct
+        return;
+    }
+    for (size_t i = 0; i < plane->num_buckets; i++) {
+        struct plane_tile* t = plane->buckets[i];
+        while (t != NULL) {
+            struct plane_tile* const next = t->next;
+            const size_t b = hash_coords(t->tx, t->ty) & (num_buckets - 1);
+            t->next = buckets[b];
+            buckets[b] = t;
+            t = next;
+        }
+    }
+    free(plane->buckets);
+    plane->buckets = buckets;
+    plane->num_buckets = num_buckets;
+}
+
+// The lists of tiles and of active tiles always have room for every tile
+static void grow_lists(struct plane* const plane)
+{
+    const size_t capacity = plane->capacity * 2;
+    struct plane_tile** const tiles = realloc(plane->tiles, capacity * sizeof(struct plane_tile*));
+    if (tiles != NULL) {
+        plane->tiles = tiles;
+    }
+    struct plane_tile** const active = realloc(plane->active, capacity * sizeof(struct plane_tile*));
+    if (active != NULL) {
+        plane->active = active;
+    }
+    if ((tiles == NULL) || (active == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the list of plane tiles.\n");
+        exit(EXIT_FAILURE);
+    }
+    plane->capacity = capacity;
+}
+
+static struct plane_tile* alloc_tile(struct plane* const plane)
+{
+    if (plane->free_list == NULL) {
+        struct plane_block* const block = malloc(sizeof(struct plane_block));
+        if (block == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for plane tiles.\n");
+            exit(EXIT_FAILURE);
+        }
+        block->next = plane->blocks;
+        plane->blocks = block;
+        plane->num_blocks++;
+        for (size_t i = 0; i < PLANE_BLOCK_TILES; i++) {
+            block->tiles[i].next = plane->free_list;
+            plane->free_list = &block->tiles[i];
+        }
+    }
+    struct plane_tile* const t = plane->free_list;
+    plane->free_list = t->next;
+    return t;
+}
+
+// Adds an empty tile and links it with its neighbors. It counts as changed,
+// so that it is stepped along with them.
+static struct plane_tile* create_tile(struct plane* const plane, const int64_t tx, const int64_t ty)
+{
+    if (plane->num_tiles == plane->capacity) {
+        grow_lists(plane);
+    }
+    struct plane_tile* const t = alloc_tile(plane);
+    memset(t->rows, 0, sizeof(t->rows));
+    t->tx = tx;
+    t->ty = ty;
+    t->hash = 0;
+    t->columns = 0;
+    census_clear(&t->census);
+    t->population = 0;
+    t->idle = 0;
+    t->current = 0;
+    t->changed = true;
+    t->active = false;
+    t->density_stale = true;
+    for (int d = 0; d < PLANE_NUM_DIRECTIONS; d++) {
+        struct plane_tile* const n = find_tile(plane, tx + direction_dx[d], ty + direction_dy[d]);
+        t->neighbors[d] = n;
+        if (n != NULL) {
+            n->neighbors[opposite((enum plane_direction)d)] = t;
+        }
+    }
+    const size_t b = hash_coords(tx, ty) & (plane->num_buckets - 1);
+    t->next = plane->buckets[b];
+    plane->buckets[b] = t;
+    t->index = plane->num_tiles;
+    plane->tiles[plane->num_tiles++] = t;
+    plane->num_created++;
+    if (plane->num_tiles > plane->num_buckets) {
+        grow_buckets(plane);
+    }
+    return t;
+}
+
+// Unlinks a tile from its neighbors and the table and puts it on the free
+// list. The last tile of the list takes its place.
+static void recycle_tile(struct plane* const plane, struct plane_tile* const t)
+{
+    for (int d = 0; d < PLANE_NUM_DIRECTIONS; d++) {
+        struct plane_tile* const n = t->neighbors[d];
+        if (n != NULL) {
+            n->neighbors[opposite((enum plane_direction)d)] = NULL;
+        }
+    }
+    struct plane_tile** link = &plane->buckets[hash_coords(t->tx, t->ty) & (plane->num_buckets - 1)];
+    while (*link != t) {
+        link = &(*link)->next;
+    }
+    *link = t->next;
+    struct plane_tile* const last = plane->tiles[--plane->num_tiles];
+    plane->tiles[t->index] = last;
+    last->index = t->index;
+    t->next = plane->free_list;
+    plane->free_list = t;
+    plane->num_recycled++;
+}
+
+// Whether the tile has live cells on its edge or corner towards d, which
+// could spread into the neighbor there
+static inline bool has_live_edge(const struct plane_tile* const t, const enum plane_direction d)
+{
+    const uint64_t top = t->rows[t->current][0];
+    const uint64_t bottom = t->rows[t->current][TILE_SIZE - 1];
+    switch (d) {
+    case PLANE_N:
+        return top != 0;
+    case PLANE_NE:
+        return (top >> 63) != 0;
+    case PLANE_E:
+        return (t->columns >> 63) != 0;
+    case PLANE_SE:
+        return (bottom >> 63) != 0;
+    case PLANE_S:
+        return bottom != 0;
+    case PLANE_SW:
+        return (bottom & 1) != 0;
+    case PLANE_W:
+        return (t->columns & 1) != 0;
+    case PLANE_NW:
+        return (top & 1) != 0;
+    case PLANE_NUM_DIRECTIONS:
+        break;
+    }
+    return false;
+}
+
+// Whether a neighbor has live cells that could spread into the tile
+static bool is_needed(const struct plane_tile* const t)
+{
+    for (int d = 0; d < PLANE_NUM_DIRECTIONS; d++) {
+        const struct plane_tile* const n = t->neighbors[d];
+        if ((n != NULL) && has_live_edge(n, opposite((enum plane_direction)d))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sets the population, columns, census and hash of a tile whose current
+// rows were filled in from outside, which were neither born nor died
+static void summarize_tile(struct plane_tile* const t)
+{
+    const uint64_t* const rows = t->rows[t->current];
+    t->columns = 0;
+    t->population = 0;
+    t->hash = 0;
+    uint64_t rows_live = 0;
+    for (size_t y = 0; y < TILE_SIZE; y++) {
+        t->columns |= rows[y];
+        t->population += (uint32_t)__builtin_popcountll(rows[y]);
+        rows_live |= (uint64_t)(rows[y] != 0) << y;
+        if (rows[y] != 0) {
+            t->hash += hash_word(rows[y], word_index(t, y));
+        }
+    }
+    count_tile(t, t->population, 0, rows_live);
+    t->density_stale = true;
+}
+
+bool plane_create(struct plane* const plane, const struct rule* const rule)
+{
+    memset(plane, 0, sizeof(*plane));
+    plane->rule = *rule;
+    plane->num_buckets = PLANE_INITIAL_BUCKETS;
+    plane->capacity = PLANE_BLOCK_TILES;
+    plane->buckets = calloc(plane->num_buckets, sizeof(struct plane_tile*));
+    plane->tiles = malloc(plane->capacity * sizeof(struct plane_tile*));
+    plane->active = malloc(plane->capacity * sizeof(struct plane_tile*));
+    if ((plane->buckets == NULL) || (plane->tiles == NULL) || (plane->active == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the plane.\n");
+        plane_destroy(plane);
+        return false;
+    }
+    return true;
+}
+
+void plane_destroy(struct plane* const plane)
+{
+    struct plane_block* block = plane->blocks;
+    while (block != NULL) {
+        struct plane_block* const next = block->next;
+        free(block);
+        block = next;
+    }
+    free(plane->buckets);
+    free(plane->tiles);
+    free(plane->active);
+    memset(plane, 0, sizeof(*plane));
+}
+
+// Recycles every tile, and starts counting created and recycled tiles over
+void plane_clear(struct plane* const plane)
+{
+    while (plane->num_tiles > 0) {
+        recycle_tile(plane, plane->tiles[plane->num_tiles - 1]);
+    }
+    plane->num_created = 0;
+    plane->num_recycled = 0;
+    plane->hash = 0;
+    census_clear(&plane->census);
+}
+
+// Replaces the plane with the cells of a grid, with its top left cell at
+// (0, 0). Only the tiles with live cells are created.
+void plane_load_bitgrid(struct plane* const plane, const struct bitgrid* const grid)
+{
+    plane_clear(plane);
+    const size_t n = grid->words_per_row;
+    struct census census;
+    census_clear(&census);
+    for (size_t y_start = 0; y_start < grid->height; y_start += TILE_SIZE) {
+        const size_t y_end = (y_start + TILE_SIZE < grid->height) ? y_start + TILE_SIZE : grid->height;
+        for (size_t tx = 0; tx < n; tx++) {
+            uint64_t any = 0;
+            for (size_t y = y_start; y < y_end; y++) {
+                any |= grid->words[(y * n) + tx];
+            }
+            if (any == 0) {
+                continue;
+            }
+            struct plane_tile* const t = create_tile(plane, (int64_t)tx, (int64_t)(y_start / TILE_SIZE));
+            for (size_t y = y_start; y < y_end; y++) {
+                t->rows[0][y - y_start] = grid->words[(y * n) + tx];
+            }
+            summarize_tile(t);
+            plane->hash += t->hash;
+            census_merge(&census, &t->census);
+        }
+    }
+    set_census(plane, &census);
+}
+
+// Replaces dst with the current generation of src. Every tile of dst is
+// stepped once, as its other rows do not match those of src.
+void plane_copy(struct plane* const dst, const struct plane* const src)
+{
+    plane_clear(dst);
+    for (size_t i = 0; i < src->num_tiles; i++) {
+        const struct plane_tile* const s = src->tiles[i];
+        struct plane_tile* const t = create_tile(dst, s->tx, s->ty);
+        memcpy(t->rows[0], s->rows[s->current], sizeof(t->rows[0]));
+        summarize_tile(t);
+    }
+    dst->hash = src->hash;
+    dst->census = src->census;
+}
+
+static inline const uint64_t* neighbor_rows(const struct plane_tile* const t, const enum plane_direction d)
+{
+    const struct plane_tile* const n = t->neighbors[d];
+    return (n != NULL) ? n->rows[n->current] : dead_rows;
+}
+
+// Writes the next generation of a tile to its other rows, from the current
+// rows of the tile and its neighbors, and sets what describes it. The hash
+// of empty words is masked off rather than branched around, as whether a
+// word is empty is as hard to guess as its cells, and the census counts the
+// cells each word flips.
+static inline __attribute__((always_inline)) void step_tile(
+    struct plane_tile* const t,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    // Rows -1 to TILE_SIZE of the tile and of the tiles left and right of it
+    uint64_t west[TILE_SIZE + 2];
+    uint64_t middle[TILE_SIZE + 2];
+    uint64_t east[TILE_SIZE + 2];
+    west[0] = neighbor_rows(t, PLANE_NW)[TILE_SIZE - 1];
+    middle[0] = neighbor_rows(t, PLANE_N)[TILE_SIZE - 1];
+    east[0] = neighbor_rows(t, PLANE_NE)[TILE_SIZE - 1];
+    memcpy(west + 1, neighbor_rows(t, PLANE_W), TILE_SIZE * sizeof(uint64_t));
+    memcpy(middle + 1, t->rows[t->current], TILE_SIZE * sizeof(uint64_t));
+    memcpy(east + 1, neighbor_rows(t, PLANE_E), TILE_SIZE * sizeof(uint64_t));
+    west[TILE_SIZE + 1] = neighbor_rows(t, PLANE_SW)[0];
+    middle[TILE_SIZE + 1] = neighbor_rows(t, PLANE_S)[0];
+    east[TILE_SIZE + 1] = neighbor_rows(t, PLANE_SE)[0];
+
+    uint64_t* const out = t->rows[1 - t->current];
+    uint64_t diff = 0;
+    uint64_t columns = 0;
+    uint64_t hash = 0;
+    uint32_t population = 0;
+    uint64_t flips = 0;
+    uint64_t rows_live = 0;
+    for (size_t y = 0; y < TILE_SIZE; y++) {
+        const uint64_t word = step_word_rule(
+            west[y], middle[y], east[y],
+            west[y + 1], middle[y + 1], east[y + 1],
+            west[y + 2], middle[y + 2], east[y + 2],
+            birth, survival
+        );
+        diff |= word ^ middle[y + 1];
+        columns |= word;
+        population += (uint32_t)__builtin_popcountll(word);
+        flips += (uint64_t)__builtin_popcountll(word ^ middle[y + 1]);
+        rows_live |= (uint64_t)(word != 0) << y;
+        hash += hash_word(word, word_index(t, y)) & -(uint64_t)(word != 0);
+        out[y] = word;
+    }
+    t->changed = diff != 0;
+    t->density_stale |= t->changed;
+    t->columns = columns;
+    const uint32_t before = t->population;
+    t->population = population;
+    t->hash = hash;
+    count_tile(t, before, flips, rows_live);
+}
+
+static inline __attribute__((always_inline)) void step_tiles(
+    const struct plane* const plane,
+    const size_t start,
+    const size_t end,
+    const unsigned int birth,
+    const unsigned int survival)
+{
+    for (size_t i = start; i < end; i++) {
+        step_tile(plane->active[i], birth, survival);
+    }
+}
+
+static void step_tile_range(void* const ctx, const size_t start, const size_t end)
+{
+    const struct plane* const plane = ctx;
+    RULE_DISPATCH_MASKS(&plane->rule, step_tiles, plane, start, end);
+}
+
+static inline void activate(struct plane* const plane, struct plane_tile* const t)
+{
+    if (!t->active) {
+        t->active = true;
+        plane->active[plane->num_active++] = t;
+    }
+}
+
+// Creates the tiles that live cells could spread into, steps the tiles that
+// changed and their neighbors, and recycles the tiles that stayed empty
+void plane_step(struct plane* const plane, struct thread_pool* const pool)
+{
+    // A tile next to a live edge is never recycled, so only the edges of
+    // tiles that changed can reach a missing neighbor
+    const size_t num_tiles = plane->num_tiles;
+    for (size_t i = 0; i < num_tiles; i++) {
+        struct plane_tile* const t = plane->tiles[i];
+        if (!t->changed || (t->population == 0)) {
+            continue;
+        }
+        for (int d = 0; d < PLANE_NUM_DIRECTIONS; d++) {
+            if ((t->neighbors[d] == NULL) && has_live_edge(t, (enum plane_direction)d)) {
+                create_tile(plane, t->tx + direction_dx[d], t->ty + direction_dy[d]);
+            }
+        }
+    }
+
+    plane->num_active = 0;
+    for (size_t i = 0; i < plane->num_tiles; i++) {
+        struct plane_tile* const t = plane->tiles[i];
+        if (!t->changed) {
+            continue;
+        }
+        activate(plane, t);
+        for (int d = 0; d < PLANE_NUM_DIRECTIONS; d++) {
+            if (t->neighbors[d] != NULL) {
+                activate(plane, t->neighbors[d]);
+            }
+        }
+    }
+    pool_run_rows(pool, step_tile_range, plane, plane->num_active, sizeof(struct plane_tile));
+
+    // Every tile reads its neighbors' current rows while it is stepped, so
+    // the stepped tiles only switch rows once all of them are done
+    for (size_t i = 0; i < plane->num_tiles; i++) {
+        struct plane_tile* const t = plane->tiles[i];
+        if (t->active) {
+            t->current ^= 1;
+            t->active = false;
+        } else {
+            t->changed = false;
+            t->census.births = 0;
+            t->census.deaths = 0;
+        }
+    }
+    // Going backwards, the tile that takes the place of a recycled one has
+    // already been seen
+    uint64_t hash = 0;
+    struct census census;
+    census_clear(&census);
+    for (size_t i = plane->num_tiles; i > 0; i--) {
+        struct plane_tile* const t = plane->tiles[i - 1];
+        if ((t->population == 0) && !t->changed && !is_needed(t)) {
+            if (++t->idle >= PLANE_IDLE_GENERATIONS) {
+                recycle_tile(plane, t);
+                continue;
+            }
+        } else {
+            t->idle = 0;
+        }
+        hash += t->hash;
+        census_merge(&census, &t->census);
+    }
+    plane->hash = hash;
+    set_census(plane, &census);
+}
+
+uint64_t plane_population(const struct plane* const plane)
+{
+    uint64_t population = 0;
+    for (size_t i = 0; i < plane->num_tiles; i++) {
+        population += plane->tiles[i]->population;
+    }
+    return population;
+}
+
+// Live cells per byte of a word, each byte holding 8 cells
+static inline uint64_t byte_counts(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    return (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+}
+
+// Counts the live cells of each 8 by 8 square of the tile, then sums each
+// level of the pyramid from squares of four of the level below
+static void refresh_density(struct plane_tile* const t)
+{
+    const uint64_t* const rows = t->rows[t->current];
+    for (size_t by = 0; by < 8; by++) {
+        // At most 64 per byte
+        uint64_t sums = 0;
+        for (size_t r = 0; r < 8; r++) {
+            sums += byte_counts(rows[(by * 8) + r]);
+        }
+        for (size_t bx = 0; bx < 8; bx++) {
+            t->density[(by * 8) + bx] = (uint16_t)((sums >> (bx * 8)) & 0xFF);
+        }
+    }
+    const uint16_t* in = t->density;
+    uint16_t* out = t->density + 64;
+    for (size_t width = 4; width >= 1; width /= 2) {
+        for (size_t y = 0; y < width; y++) {
+            for (size_t x = 0; x < width; x++) {
+                const uint16_t* const square = in + (y * 2 * width * 2) + (x * 2);
+                out[(y * width) + x] = (uint16_t)(square[0] + square[1] + square[width * 2] + square[(width * 2) + 1]);
+            }
+        }
+        in = out;
+        out += width * width;
+    }
+    t->density_stale = false;
+}
+
+// The live cells in square bx, by of 2^zoom_log2 cells of a tile. Squares of
+// up to 4 by 4 cells are counted from the cells.
+static inline uint32_t live_in_square(struct plane_tile* const t, const unsigned int zoom_log2, const size_t bx, const size_t by)
+{
+    if (zoom_log2 >= PLANE_DENSITY_LEVEL) {
+        if (t->density_stale) {
+            refresh_density(t);
+        }
+        return t->density[density_offset[zoom_log2 - PLANE_DENSITY_LEVEL] + (by * (TILE_SIZE >> zoom_log2)) + bx];
+    }
+    const size_t size = (size_t)1 << zoom_log2;
+    const uint64_t mask = (UINT64_C(1) << size) - 1;
+    const uint64_t* const rows = t->rows[t->current] + (by * size);
+    uint32_t count = 0;
+    for (size_t r = 0; r < size; r++) {
+        count += (uint32_t)__builtin_popcountll((rows[r] >> (bx * size)) & mask);
+    }
+    return count;
+}
+
+// Any live cell in a pixel shows, darker the more of its cells are alive
+static inline uint32_t shade(const uint64_t count, const unsigned int zoom_log2)
+{
+    if (count == 0) {
+        return DEAD_CELL;
+    }
+    const uint32_t level = 255 - (64 + (uint32_t)((191 * count) >> (2 * zoom_log2)));
+    return LIVE_CELL | (level << 16) | (level << 8) | level;
+}
+
+// Draws the view, as close as a tile, from the cells or the density pyramid
+// of each tile in view, and further out by adding up whole tiles into each
+// pixel. The view is moved up and left to line its pixels up with squares
+// of the pyramid. pitch is the distance between rows of pixels in cells.
+void plane_render(
+    struct plane* const plane,
+    uint32_t* const pixels,
+    const size_t view_width,
+    const size_t view_height,
+    const size_t pitch,
+    const struct viewport* const view)
+{
+    const unsigned int zoom_log2 = (view->zoom_log2 < PLANE_MAX_ZOOM_LOG2) ? view->zoom_log2 : PLANE_MAX_ZOOM_LOG2;
+    const int64_t size = INT64_C(1) << zoom_log2;
+    const int64_t x0 = floor_multiple(view->x, size);
+    const int64_t y0 = floor_multiple(view->y, size);
+    const int64_t width = (int64_t)view_width;
+    const int64_t height = (int64_t)view_height;
+
+    if (size > TILE_SIZE) {
+        // Sums the live cells of each pixel in place before shading it
+        for (size_t y = 0; y < view_height; y++) {
+            memset(pixels + (y * pitch), 0, view_width * sizeof(uint32_t));
+        }
+        for (size_t i = 0; i < plane->num_tiles; i++) {
+            const struct plane_tile* const t = plane->tiles[i];
+            // Each tile falls in a single pixel
+            const int64_t px = floor_multiple((t->tx * TILE_SIZE) - x0, size) / size;
+            const int64_t py = floor_multiple((t->ty * TILE_SIZE) - y0, size) / size;
+            if ((t->population > 0) && (px >= 0) && (py >= 0) && (px < width) && (py < height)) {
+                pixels[((size_t)py * pitch) + (size_t)px] += t->population;
+            }
+        }
+        for (size_t y = 0; y < view_height; y++) {
+            uint32_t* const row = pixels + (y * pitch);
+            for (size_t x = 0; x < view_width; x++) {
+                row[x] = shade(row[x], zoom_log2);
+            }
+        }
+        return;
+    }
+
+    for (size_t y = 0; y < view_height; y++) {
+        for (size_t x = 0; x < view_width; x++) {
+            pixels[(y * pitch) + x] = DEAD_CELL;
+        }
+    }
+    const int64_t tile_pixels = TILE_SIZE / size;
+    for (size_t i = 0; i < plane->num_tiles; i++) {
+        struct plane_tile* const t = plane->tiles[i];
+        // Both are multiples of size
+        const int64_t px0 = ((t->tx * TILE_SIZE) - x0) / size;
+        const int64_t py0 = ((t->ty * TILE_SIZE) - y0) / size;
+        if ((t->population == 0) || (px0 + tile_pixels <= 0) || (py0 + tile_pixels <= 0) || (px0 >= width) || (py0 >= height)) {
+            continue;
+        }
+        const int64_t bx_start = (px0 < 0) ? -px0 : 0;
+        const int64_t by_start = (py0 < 0) ? -py0 : 0;
+        const int64_t bx_end = (px0 + tile_pixels > width) ? width - px0 : tile_pixels;
+        const int64_t by_end = (py0 + tile_pixels > height) ? height - py0 : tile_pixels;
+        for (int64_t by = by_start; by < by_end; by++) {
+            uint32_t* const row = pixels + ((size_t)(py0 + by) * pitch);
+            for (int64_t bx = bx_start; bx < bx_end; bx++) {
+                row[px0 + bx] = shade(live_in_square(t, zoom_log2, (size_t)bx, (size_t)by), zoom_log2);
+            }
+        }
+    }
+}
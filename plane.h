@@ -0,0 +1,114 @@
+#ifndef plane_h
+#define plane_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "bitgrid.h"
+#include "pool.h"
+#include "rule.h"
+#include "tiles.h"
+
+#define PLANE_BLOCK_TILES        256
+#define PLANE_INITIAL_BUCKETS    (1 << 10)
+// Generations a tile stays empty, with no live cells next to it, before it
+// is recycled, so that tiles at the edge of an oscillator are not recycled
+// and created again every period
+#define PLANE_IDLE_GENERATIONS   16
+// Zoomed out further, a pixel would count more live cells than fit in it
+#define PLANE_MAX_ZOOM_LOG2      15
+
+// The live cells in each square of 2^level cells of a tile, for levels 3
+// (8 by 8 squares) to 6 (the whole tile), level after level in rows
+#define PLANE_DENSITY_LEVEL      3
+#define PLANE_DENSITY_SIZE       (64 + 16 + 4 + 1)
+
+// The neighbors of a tile, clockwise from the one above
+enum plane_direction {
+    PLANE_N,
+    PLANE_NE,
+    PLANE_E,
+    PLANE_SE,
+    PLANE_S,
+    PLANE_SW,
+    PLANE_W,
+    PLANE_NW,
+    PLANE_NUM_DIRECTIONS
+};
+
+// TILE_SIZE by TILE_SIZE cells from x = tx * TILE_SIZE, y = ty * TILE_SIZE,
+// one word per row as in a bitgrid. rows[current] holds the current
+// generation and a step writes the other one, so that tiles that are not
+// stepped need no copy. Missing neighbors are dead. population, columns
+// (the rows OR-ed together), census and hash describe the current
+// generation; the hash only sums the words with live cells, so that it does
+// not depend on which empty tiles happen to exist, and the census box is
+// offset by CENSUS_ORIGIN. density is only refreshed when it is drawn, after
+// the tile changed.
+struct plane_tile {
+    uint64_t rows[2][TILE_SIZE];
+    struct plane_tile* neighbors[PLANE_NUM_DIRECTIONS];
+    struct plane_tile* next;
+    int64_t tx;
+    int64_t ty;
+    uint64_t hash;
+    uint64_t columns;
+    struct census census;
+    uint32_t population;
+    uint32_t idle;
+    size_t index;
+    uint16_t density[PLANE_DENSITY_SIZE];
+    uint8_t current;
+    bool changed;
+    bool active;
+    bool density_stale;
+};
+
+struct plane_block;
+
+// An unbounded plane of tiles, found by their coordinates in a hash table.
+// Only tiles with live cells or next to them exist: a step first adds the
+// tiles that live cells on an edge could spread into, and recycles the
+// tiles that stayed empty. Like the bitgrid engine, a step only recomputes
+// the tiles that changed and their neighbors. Tiles come from blocks that
+// are only returned to the system when the plane is destroyed, and recycled
+// tiles go on a free list, so once the blocks, the table and the lists of
+// tiles have grown to fit the pattern, stepping allocates nothing. hash
+// and census sum those of the tiles, with the census box in plane
+// coordinates.
+struct plane {
+    struct plane_tile** buckets;
+    size_t num_buckets;
+    struct plane_tile** tiles;
+    struct plane_tile** active;
+    size_t num_tiles;
+    size_t num_active;
+    size_t capacity;
+    struct plane_block* blocks;
+    size_t num_blocks;
+    struct plane_tile* free_list;
+    uint64_t num_created;
+    uint64_t num_recycled;
+    uint64_t hash;
+    struct census census;
+    struct rule rule;
+};
+
+// The cells shown by a view of an unbounded plane: 2^zoom_log2 cells
+// square per pixel, from the cell at x, y at the top left
+struct viewport {
+    int64_t x;
+    int64_t y;
+    unsigned int zoom_log2;
+};
+
+bool plane_create(struct plane* const plane, const struct rule* const rule);
+void plane_destroy(struct plane* const plane);
+void plane_clear(struct plane* const plane);
+void plane_load_bitgrid(struct plane* const plane, const struct bitgrid* const grid);
+void plane_copy(struct plane* const dst, const struct plane* const src);
+void plane_step(struct plane* const plane, struct thread_pool* const pool);
+uint64_t plane_population(const struct plane* const plane);
+void plane_render(struct plane* const plane, uint32_t* const pixels, const size_t view_width, const size_t view_height, const size_t pitch, const struct viewport* const view);
+
+#endif
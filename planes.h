@@ -0,0 +1,134 @@
+#ifndef planes_h
+#define planes_h
+
+#include <stdint.h>
+#include "rule.h"
+
+// Each bit of a plane is one cell, and the same bit of the planes passed
+// together is the same cell: its neighbors above (a_west, a, a_east), beside
+// (b_west, b_east) and below (c_west, c, c_east), and b the cell itself.
+// Whether the cells are 64 neighbors in a row or one cell of 64 universes is
+// up to the caller.
+
+// The cells among those with neighbor counts in the planes that have count
+// neighbors
+#define COUNT_IS(count, ones, twos, fours, eights)     \
+    ((((count) & 1) ? (ones) : ~(ones))                \
+   & (((count) & 2) ? (twos) : ~(twos))                \
+   & (((count) & 4) ? (fours) : ~(fours))              \
+   & (((count) & 8) ? (eights) : ~(eights)))
+
+// Skips the counts the rule never acts on and sorts the rest by what they
+// do: the cells with a count in both masks come alive whatever their state
+// (either), those with a count only in birth only when dead (born), and
+// those with a count only in survival only when alive (survives). The next
+// state is then either, or born for dead cells, or survives for live ones.
+// The SIMD kernels in kernels.c have a MATCH_COUNT of their own per vector
+// type that works the same way.
+#define MATCH_COUNT(count)                                                           \
+    do {                                                                             \
+        if (((birth | survival) >> (count)) & 1) {                                   \
+            const uint64_t match = COUNT_IS(count, ones, twos, fours, eights);       \
+            if (((birth & survival) >> (count)) & 1) {                               \
+                either |= match;                                                     \
+            } else if ((birth >> (count)) & 1) {                                     \
+                born |= match;                                                       \
+            } else {                                                                 \
+                survives |= match;                                                   \
+            }                                                                        \
+        }                                                                            \
+    } while (0)
+
+// Next state of Conway's rule. The eight neighbor planes are summed with a
+// tree of bitwise full and half adders.
+static inline uint64_t step_planes_conway(
+    const uint64_t a_west, const uint64_t a, const uint64_t a_east,
+    const uint64_t b_west, const uint64_t b, const uint64_t b_east,
+    const uint64_t c_west, const uint64_t c, const uint64_t c_east)
+{
+    const uint64_t a_ones = a_west ^ a ^ a_east;
+    const uint64_t a_twos = (a_west & a) | (a_east & (a_west ^ a));
+    const uint64_t b_ones = b_west ^ b_east;
+    const uint64_t b_twos = b_west & b_east;
+    const uint64_t c_ones = c_west ^ c ^ c_east;
+    const uint64_t c_twos = (c_west & c) | (c_east & (c_west ^ c));
+
+    const uint64_t ones = a_ones ^ b_ones ^ c_ones;
+    const uint64_t ones_carry = (a_ones & b_ones) | (c_ones & (a_ones ^ b_ones));
+
+    // 2 or 3 neighbors means exactly one of the four weight-two bits is set
+    const uint64_t x1 = a_twos ^ b_twos;
+    const uint64_t x2 = c_twos ^ ones_carry;
+    const uint64_t overflow = (a_twos & b_twos) | (c_twos & ones_carry);
+    const uint64_t two_or_three = (x1 ^ x2) & ~overflow;
+
+    return two_or_three & (ones | b);
+}
+
+// Like step_planes_conway, for any rule. The neighbor counts are summed into
+// four bit planes and matched against each count the rule names. Inlined
+// with constant masks, only the counts of the rule are matched, and Conway's
+// rule keeps its shortcut.
+static inline __attribute__((always_inline)) uint64_t step_planes(
+    const uint64_t a_west, const uint64_t a, const uint64_t a_east,
+    const uint64_t b_west, const uint64_t b, const uint64_t b_east,
+    const uint64_t c_west, const uint64_t c, const uint64_t c_east,
+    const unsigned int birth, const unsigned int survival)
+{
+    if ((birth == RULE_CONWAY_BIRTH) && (survival == RULE_CONWAY_SURVIVAL)) {
+        return step_planes_conway(a_west, a, a_east, b_west, b, b_east, c_west, c, c_east);
+    }
+    const uint64_t a_ones = a_west ^ a ^ a_east;
+    const uint64_t a_twos = (a_west & a) | (a_east & (a_west ^ a));
+    const uint64_t b_ones = b_west ^ b_east;
+    const uint64_t b_twos = b_west & b_east;
+    const uint64_t c_ones = c_west ^ c ^ c_east;
+    const uint64_t c_twos = (c_west & c) | (c_east & (c_west ^ c));
+
+    const uint64_t ones = a_ones ^ b_ones ^ c_ones;
+    const uint64_t ones_carry = (a_ones & b_ones) | (c_ones & (a_ones ^ b_ones));
+
+    // Four weight-two bits sum to at most 4, so at most two fours carry
+    const uint64_t x1 = a_twos ^ b_twos;
+    const uint64_t x2 = c_twos ^ ones_carry;
+    const uint64_t carry1 = a_twos & b_twos;
+    const uint64_t carry2 = c_twos & ones_carry;
+    const uint64_t carry3 = x1 & x2;
+    const uint64_t twos = x1 ^ x2;
+    const uint64_t fours = carry1 ^ carry2 ^ carry3;
+    const uint64_t eights = carry1 & carry2;
+
+    uint64_t either = 0;
+    uint64_t born = 0;
+    uint64_t survives = 0;
+    MATCH_COUNT(0);
+    MATCH_COUNT(1);
+    MATCH_COUNT(2);
+    MATCH_COUNT(3);
+    MATCH_COUNT(4);
+    MATCH_COUNT(5);
+    MATCH_COUNT(6);
+    MATCH_COUNT(7);
+    MATCH_COUNT(8);
+    return either | (born & ~b) | (survives & b);
+}
+
+// Next state of 64 cells, given the words to the left of, at and to the right
+// of them in the rows above (a), at (b) and below (c). Shifting the words
+// lines each cell up with its neighbors in the eight planes that
+// step_planes sums.
+static inline __attribute__((always_inline)) uint64_t step_word_rule(
+    const uint64_t a_l, const uint64_t a, const uint64_t a_r,
+    const uint64_t b_l, const uint64_t b, const uint64_t b_r,
+    const uint64_t c_l, const uint64_t c, const uint64_t c_r,
+    const unsigned int birth, const unsigned int survival)
+{
+    return step_planes(
+        (a << 1) | (a_l >> 63), a, (a >> 1) | (a_r << 63),
+        (b << 1) | (b_l >> 63), b, (b >> 1) | (b_r << 63),
+        (c << 1) | (c_l >> 63), c, (c >> 1) | (c_r << 63),
+        birth, survival
+    );
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct pool_worker {
+    struct thread_pool* pool;
+    size_t index;
+};
+
+struct rows_job {
+    pool_rows_fn fn;
+    void* ctx;
+    size_t num_rows;
+    size_t rows_per_unit;
+};
+
+static void barrier_init(struct pool_barrier* const barrier, const size_t count)
+{
+    pthread_mutex_init(&barrier->mutex, NULL);
+    pthread_cond_init(&barrier->cond, NULL);
+    barrier->count = count;
+    barrier->waiting = 0;
+    barrier->phase = 0;
+}
+
+static void barrier_destroy(struct pool_barrier* const barrier)
+{
+    pthread_cond_destroy(&barrier->cond);
+    pthread_mutex_destroy(&barrier->mutex);
+}
+
+static void barrier_wait(struct pool_barrier* const barrier)
+{
+    pthread_mutex_lock(&barrier->mutex);
+    const size_t phase = barrier->phase;
+    if (++barrier->waiting == barrier->count) {
+        barrier->waiting = 0;
+        barrier->phase++;
+        pthread_cond_broadcast(&barrier->cond);
+    } else {
+        while (phase == barrier->phase) {
+            pthread_cond_wait(&barrier->cond, &barrier->mutex);
+        }
+    }
+    pthread_mutex_unlock(&barrier->mutex);
+}
+
+static void* worker_main(void* const arg)
+{
+    const struct pool_worker* const worker = arg;
+    struct thread_pool* const pool = worker->pool;
+    for (;;) {
+        barrier_wait(&pool->barrier);
+        if (pool->quit) {
+            break;
+        }
+        pool->job(pool->ctx, worker->index, pool->num_threads);
+        barrier_wait(&pool->barrier);
+    }
+    return NULL;
+}
+
+bool pool_create(struct thread_pool* const pool, const size_t num_threads)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->num_threads = (num_threads == 0) ? 1 : num_threads;
+    barrier_init(&pool->barrier, pool->num_threads);
+    if (pool->num_threads == 1) {
+        return true;
+    }
+
+    pool->threads = malloc((pool->num_threads - 1) * sizeof(pthread_t));
+    pool->workers = malloc((pool->num_threads - 1) * sizeof(struct pool_worker));
+    if ((pool->threads == NULL) || (pool->workers == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the thread pool.\n");
+        goto free_pool;
+    }
+    for (size_t i = 0; i < pool->num_threads - 1; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i + 1;
+        const int err = pthread_create(&pool->threads[i], NULL, worker_main, &pool->workers[i]);
+        if (err != 0) {
+            fprintf(stderr, "Error when creating worker thread: %s\n", strerror(err));
+            // Shrink the barrier to the workers that did start, then stop them
+            pthread_mutex_lock(&pool->barrier.mutex);
+            pool->barrier.count = i + 1;
+            pthread_mutex_unlock(&pool->barrier.mutex);
+            pool->num_threads = i + 1;
+            pool_destroy(pool);
+            return false;
+        }
+    }
+    return true;
+
+free_pool:
+    free(pool->threads);
+    free(pool->workers);
+    barrier_destroy(&pool->barrier);
+    return false;
+}
+
+void pool_destroy(struct thread_pool* const pool)
+{
+    if (pool->num_threads > 1) {
+        pool->quit = true;
+        barrier_wait(&pool->barrier);
+        for (size_t i = 0; i < pool->num_threads - 1; i++) {
+            pthread_join(pool->threads[i], NULL);
+        }
+    }
+    free(pool->threads);
+    free(pool->workers);
+    barrier_destroy(&pool->barrier);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void pool_run(struct thread_pool* const pool, void (*job)(void*, const size_t, const size_t), void* const ctx)
+{
+    if (pool->num_threads == 1) {
+        job(ctx, 0, 1);
+        return;
+    }
+    pool->job = job;
+    pool->ctx = ctx;
+    barrier_wait(&pool->barrier);
+    job(ctx, 0, pool->num_threads);
+    barrier_wait(&pool->barrier);
+}
+
+static void run_band(void* const arg, const size_t index, const size_t num_threads)
+{
+    const struct rows_job* const job = arg;
+    const size_t num_units = (job->num_rows + job->rows_per_unit - 1) / job->rows_per_unit;
+    const size_t first_unit = (index * num_units) / num_threads;
+    const size_t last_unit = ((index + 1) * num_units) / num_threads;
+    size_t y_start = first_unit * job->rows_per_unit;
+    size_t y_end = last_unit * job->rows_per_unit;
+    if (y_end > job->num_rows) {
+        y_end = job->num_rows;
+    }
+    if (y_start < y_end) {
+        job->fn(job->ctx, y_start, y_end);
+    }
+}
+
+static size_t gcd(size_t a, size_t b)
+{
+    while (b != 0) {
+        const size_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// Splits the rows into one band per thread. Bands start on a cache line
+// boundary, so no two threads ever write to the same line.
+void pool_run_rows(
+    struct thread_pool* const pool,
+    const pool_rows_fn fn,
+    void* const ctx,
+    const size_t num_rows,
+    const size_t row_bytes)
+{
+    struct rows_job job = {
+        .fn = fn,
+        .ctx = ctx,
+        .num_rows = num_rows,
+        .rows_per_unit = CACHE_LINE_SIZE / gcd(row_bytes, CACHE_LINE_SIZE)
+    };
+    pool_run(pool, run_band, &job);
+}
+
+size_t pool_default_threads(void)
+{
+    const long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (num_cpus > 0) ? (size_t)num_cpus : 1;
+}
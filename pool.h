@@ -0,0 +1,38 @@
+#ifndef pool_h
+#define pool_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "grid.h"
+
+// pthread_barrier_t is not available on macOS
+struct pool_barrier {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    size_t count;
+    size_t waiting;
+    size_t phase;
+};
+
+// The calling thread is worker 0, so a pool of N threads spawns N-1.
+// Workers stay parked on the barrier between calls to pool_run.
+struct thread_pool {
+    pthread_t* threads;
+    struct pool_worker* workers;
+    size_t num_threads;
+    struct pool_barrier barrier;
+    void (*job)(void* ctx, const size_t index, const size_t num_threads);
+    void* ctx;
+    bool quit;
+};
+
+typedef void (*pool_rows_fn)(void* ctx, const size_t y_start, const size_t y_end);
+
+bool pool_create(struct thread_pool* const pool, const size_t num_threads);
+void pool_destroy(struct thread_pool* const pool);
+void pool_run(struct thread_pool* const pool, void (*job)(void*, const size_t, const size_t), void* const ctx);
+void pool_run_rows(struct thread_pool* const pool, const pool_rows_fn fn, void* const ctx, const size_t num_rows, const size_t row_bytes);
+size_t pool_default_threads(void);
+
+#endif
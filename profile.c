@@ -0,0 +1,204 @@
+#include "profile.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+static const char* const phase_names[NUM_PHASES] = {
+    [PHASE_STEP] = "step",
+    [PHASE_PUBLISH] = "publish",
+    [PHASE_EXPAND] = "expand",
+    [PHASE_UPLOAD] = "upload",
+    [PHASE_PRESENT] = "present",
+    [PHASE_EVENTS] = "events",
+    [PHASE_SLEEP] = "sleep",
+    [PHASE_FRAME] = "frame"
+};
+
+static inline size_t bucket_of(const uint64_t ns)
+{
+    if (ns < (UINT64_C(1) << HISTOGRAM_SUB_BITS)) {
+        return (size_t)ns;
+    }
+    const unsigned int msb = 63 - (unsigned int)__builtin_clzll(ns);
+    const unsigned int shift = msb - HISTOGRAM_SUB_BITS;
+    const size_t sub = (size_t)(ns >> shift) & ((1u << HISTOGRAM_SUB_BITS) - 1);
+    return ((size_t)(shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+// The largest duration that falls in a bucket
+static inline uint64_t bucket_limit(const size_t bucket)
+{
+    if (bucket < (1u << HISTOGRAM_SUB_BITS)) {
+        return bucket;
+    }
+    const unsigned int shift = (unsigned int)(bucket >> HISTOGRAM_SUB_BITS) - 1;
+    const uint64_t sub = (bucket & ((1u << HISTOGRAM_SUB_BITS) - 1)) + (1u << HISTOGRAM_SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+bool profile_create(struct profile* const profile)
+{
+    profile->phases = calloc(NUM_PHASES, sizeof(struct histogram));
+    if (profile->phases == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for the profile.\n");
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &profile->start);
+    return true;
+}
+
+void profile_destroy(struct profile* const profile)
+{
+    free(profile->phases);
+    profile->phases = NULL;
+}
+
+void profile_record(struct profile* const profile, const enum phase phase, const int64_t ns)
+{
+    struct histogram* const h = &profile->phases[phase];
+    const uint64_t value = (ns > 0) ? (uint64_t)ns : 0;
+    atomic_fetch_add_explicit(&h->buckets[bucket_of(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, value, memory_order_relaxed);
+    // Only the owning thread raises the maximum
+    if (value > atomic_load_explicit(&h->max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max_ns, value, memory_order_relaxed);
+    }
+}
+
+// Records the time since last and moves last to now, so that consecutive
+// phases can be timed with one clock read each
+int64_t profile_lap(struct profile* const profile, const enum phase phase, struct timespec* const last)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t ns = get_time_diff_ns(last, &now);
+    profile_record(profile, phase, ns);
+    *last = now;
+    return ns;
+}
+
+// Percentiles are the upper limit of their bucket, but never above the
+// maximum. The counts may move while they are read, which only skews a
+// summary taken mid-run by the few durations recorded meanwhile.
+void profile_summarize(const struct profile* const profile, const enum phase phase, struct phase_summary* const summary)
+{
+    const struct histogram* const h = &profile->phases[phase];
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        counts[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        total += counts[b];
+    }
+    summary->count = total;
+    summary->max_ns = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    summary->mean_ns = (total > 0) ? (double)atomic_load_explicit(&h->sum_ns, memory_order_relaxed) / (double)total : 0.0;
+    summary->p50_ns = 0;
+    summary->p99_ns = 0;
+    const uint64_t p50_rank = (total + 1) / 2;
+    const uint64_t p99_rank = total - (total / 100);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        if (counts[b] == 0) {
+            continue;
+        }
+        seen += counts[b];
+        const uint64_t limit = (bucket_limit(b) < summary->max_ns) ? bucket_limit(b) : summary->max_ns;
+        if ((summary->p50_ns == 0) && (seen >= p50_rank)) {
+            summary->p50_ns = limit;
+        }
+        if (seen >= p99_rank) {
+            summary->p99_ns = limit;
+            break;
+        }
+    }
+}
+
+void profile_print(const struct profile* const profile)
+{
+    printf("%-8s %10s %10s %10s %10s %10s\n", "phase", "count", "mean (us)", "p50 (us)", "p99 (us)", "max (us)");
+    for (int p = 0; p < NUM_PHASES; p++) {
+        struct phase_summary s;
+        profile_summarize(profile, (enum phase)p, &s);
+        if (s.count == 0) {
+            continue;
+        }
+        printf("%-8s %10" PRIu64 " %10.1f %10.1f %10.1f %10.1f\n",
+               phase_names[p],
+               s.count,
+               s.mean_ns / 1e3,
+               (double)s.p50_ns / 1e3,
+               (double)s.p99_ns / 1e3,
+               (double)s.max_ns / 1e3);
+    }
+}
+
+static bool has_suffix(const char* const str, const char* const suffix)
+{
+    const size_t len = strlen(str);
+    const size_t suffix_len = strlen(suffix);
+    return (len >= suffix_len) && (strcmp(str + len - suffix_len, suffix) == 0);
+}
+
+// Writes a summary of every phase as JSON if path ends in .json, and as CSV
+// otherwise. The file is written next to path and renamed over it, so a
+// reader polling it never sees half a dump.
+bool profile_dump(const struct profile* const profile, const char* const path)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const double elapsed_s = (double)get_time_diff_ns(&profile->start, &now) / NS_PER_S;
+    const bool json = has_suffix(path, ".json");
+
+    char* const tmp_path = malloc(strlen(path) + sizeof(".tmp"));
+    if (tmp_path == NULL) {
+        fprintf(stderr, "Error: Failed to allocate memory for the profile path.\n");
+        return false;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE* const file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error when opening %s: %s\n", tmp_path, strerror(errno));
+        free(tmp_path);
+        return false;
+    }
+    if (json) {
+        fprintf(file, "{\"elapsed_s\": %.3f, \"phases\": {", elapsed_s);
+    } else {
+        fprintf(file, "elapsed_s,phase,count,mean_ns,p50_ns,p99_ns,max_ns\n");
+    }
+    for (int p = 0; p < NUM_PHASES; p++) {
+        struct phase_summary s;
+        profile_summarize(profile, (enum phase)p, &s);
+        if (json) {
+            fprintf(file, "%s\n  \"%s\": {\"count\": %" PRIu64 ", \"mean_ns\": %.0f, \"p50_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 "}",
+                    (p == 0) ? "" : ",", phase_names[p], s.count, s.mean_ns, s.p50_ns, s.p99_ns, s.max_ns);
+        } else {
+            fprintf(file, "%.3f,%s,%" PRIu64 ",%.0f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                    elapsed_s, phase_names[p], s.count, s.mean_ns, s.p50_ns, s.p99_ns, s.max_ns);
+        }
+    }
+    if (json) {
+        fprintf(file, "\n}}\n");
+    }
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error when writing %s: %s\n", tmp_path, strerror(errno));
+    } else if (rename(tmp_path, path) == -1) {
+        fprintf(stderr, "Error when renaming %s: %s\n", tmp_path, strerror(errno));
+        ok = false;
+    }
+    free(tmp_path);
+    return ok;
+}
+
+const char* phase_name(const enum phase phase)
+{
+    return phase_names[phase];
+}
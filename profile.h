@@ -0,0 +1,59 @@
+#ifndef profile_h
+#define profile_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Each power of two is split into 1 << HISTOGRAM_SUB_BITS buckets, so a
+// percentile is off by at most 1/16 of its value
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_BUCKETS  ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+enum phase {
+    PHASE_STEP,
+    PHASE_PUBLISH,
+    PHASE_EXPAND,
+    PHASE_UPLOAD,
+    PHASE_PRESENT,
+    PHASE_EVENTS,
+    PHASE_SLEEP,
+    PHASE_FRAME,
+    NUM_PHASES
+};
+
+// Durations in nanoseconds, bucketed on a log-linear scale. Each histogram
+// has a single writer, but may be read by another thread at any time, so
+// every field is updated with relaxed atomics and never locked.
+struct histogram {
+    atomic_uint_fast64_t buckets[HISTOGRAM_BUCKETS];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum_ns;
+    atomic_uint_fast64_t max_ns;
+};
+
+struct profile {
+    struct histogram* phases;
+    struct timespec start;
+};
+
+struct phase_summary {
+    uint64_t count;
+    double mean_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+};
+
+bool profile_create(struct profile* const profile);
+void profile_destroy(struct profile* const profile);
+void profile_record(struct profile* const profile, const enum phase phase, const int64_t ns);
+int64_t profile_lap(struct profile* const profile, const enum phase phase, struct timespec* const last);
+void profile_summarize(const struct profile* const profile, const enum phase phase, struct phase_summary* const summary);
+void profile_print(const struct profile* const profile);
+bool profile_dump(const struct profile* const profile, const char* const path);
+const char* phase_name(const enum phase phase);
+
+#endif
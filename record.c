@@ -0,0 +1,687 @@
+#include "record.h"
+#include "timing.h"
+#include "fileio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+struct bit_writer {
+    uint8_t* bytes;
+    size_t size;
+    uint64_t acc;
+    unsigned int num_bits;
+};
+
+struct bit_reader {
+    const uint8_t* next;
+    const uint8_t* end;
+    uint64_t acc;
+    unsigned int num_bits;
+};
+
+// value must fit in num_bits, which is at most 32. Bytes are written least
+// significant first, 4 at a time.
+static inline void put_bits(struct bit_writer* const w, const uint64_t value, const unsigned int num_bits)
+{
+    w->acc |= value << w->num_bits;
+    w->num_bits += num_bits;
+    if (w->num_bits >= 32) {
+        w->bytes[w->size] = (uint8_t)w->acc;
+        w->bytes[w->size + 1] = (uint8_t)(w->acc >> 8);
+        w->bytes[w->size + 2] = (uint8_t)(w->acc >> 16);
+        w->bytes[w->size + 3] = (uint8_t)(w->acc >> 24);
+        w->size += 4;
+        w->acc >>= 32;
+        w->num_bits -= 32;
+    }
+}
+
+static inline void flush_bits(struct bit_writer* const w)
+{
+    while (w->num_bits > 0) {
+        w->bytes[w->size++] = (uint8_t)w->acc;
+        w->acc >>= 8;
+        w->num_bits = (w->num_bits > 8) ? w->num_bits - 8 : 0;
+    }
+}
+
+// The quotient in unary, as that many ones and a zero, then the low k bits
+static inline void put_rice(struct bit_writer* const w, const uint64_t gap, const unsigned int k)
+{
+    uint64_t q = gap >> k;
+    while (q >= 32) {
+        put_bits(w, UINT32_MAX, 32);
+        q -= 32;
+    }
+    put_bits(w, (UINT64_C(1) << q) - 1, (unsigned int)q + 1);
+    const uint64_t remainder = gap & ((UINT64_C(1) << k) - 1);
+    if (k > 32) {
+        put_bits(w, remainder & UINT32_MAX, 32);
+        put_bits(w, remainder >> 32, k - 32);
+    } else {
+        put_bits(w, remainder, k);
+    }
+}
+
+static inline void refill(struct bit_reader* const r)
+{
+    while ((r->num_bits <= 56) && (r->next < r->end)) {
+        r->acc |= (uint64_t)*r->next++ << r->num_bits;
+        r->num_bits += 8;
+    }
+}
+
+static inline void consume(struct bit_reader* const r, const unsigned int num_bits)
+{
+    r->acc = (num_bits >= 64) ? 0 : (r->acc >> num_bits);
+    r->num_bits -= num_bits;
+}
+
+// Returns false if the payload ends first
+static inline bool get_rice(struct bit_reader* const r, const unsigned int k, uint64_t* const gap)
+{
+    uint64_t q = 0;
+    for (;;) {
+        refill(r);
+        if (r->num_bits == 0) {
+            return false;
+        }
+        const uint64_t available = (r->num_bits == 64) ? UINT64_MAX : ((UINT64_C(1) << r->num_bits) - 1);
+        const uint64_t zeros = ~r->acc & available;
+        if (zeros != 0) {
+            const unsigned int num_ones = (unsigned int)__builtin_ctzll(zeros);
+            q += num_ones;
+            consume(r, num_ones + 1);
+            break;
+        }
+        q += r->num_bits;
+        consume(r, r->num_bits);
+    }
+    uint64_t remainder = 0;
+    for (unsigned int done = 0; done < k;) {
+        const unsigned int n = (k - done > 32) ? 32 : k - done;
+        refill(r);
+        if (r->num_bits < n) {
+            return false;
+        }
+        remainder |= (r->acc & ((UINT64_C(1) << n) - 1)) << done;
+        consume(r, n);
+        done += n;
+    }
+    if (q > (UINT64_MAX >> k)) {
+        return false;
+    }
+    *gap = (q << k) | remainder;
+    return true;
+}
+
+static inline uint64_t flips(const uint64_t* const words, const uint64_t* const previous, const size_t i)
+{
+    return (previous == NULL) ? words[i] : words[i] ^ previous[i];
+}
+
+// Encodes the generation against the one before it, or on its own for a
+// keyframe, and appends it to the file. 2^k is the largest power of two no
+// greater than the mean gap between flips, which keeps the unary quotients
+// under two bits per flip on average.
+static bool write_frame(struct recorder* const rec, const struct bitgrid* const grid, const uint64_t generation)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    const size_t num_words = grid->height * grid->words_per_row;
+    const bool keyframe = (rec->num_frames == 0)
+                       || (generation != rec->previous_generation + 1)
+                       || (generation % rec->keyframe_every == 0);
+    const uint64_t* const previous = keyframe ? NULL : rec->previous.words;
+    uint64_t num_flips = 0;
+    for (size_t i = 0; i < num_words; i++) {
+        num_flips += (uint64_t)__builtin_popcountll(flips(grid->words, previous, i));
+    }
+    const uint64_t mean_gap = ((uint64_t)num_words * 64) / (num_flips + 1);
+    const unsigned int k = (mean_gap == 0) ? 0 : 63 - (unsigned int)__builtin_clzll(mean_gap);
+
+    const size_t max_bytes = sizeof(struct record_frame) + (((num_flips * (k + 3)) + 2 + 7) / 8) + 16;
+    if (max_bytes > rec->buffer_capacity) {
+        uint8_t* const grown = realloc(rec->buffer, max_bytes);
+        if (grown == NULL) {
+            fprintf(stderr, "Error: Failed to allocate memory for the recording.\n");
+            return false;
+        }
+        rec->buffer = grown;
+        rec->buffer_capacity = max_bytes;
+    }
+    struct bit_writer w = {
+        .bytes = rec->buffer + sizeof(struct record_frame)
+    };
+    uint64_t next = 0;
+    for (size_t i = 0; i < num_words; i++) {
+        uint64_t bits = flips(grid->words, previous, i);
+        while (bits != 0) {
+            const uint64_t position = ((uint64_t)i * 64) + (uint64_t)__builtin_ctzll(bits);
+            put_rice(&w, position - next, k);
+            next = position + 1;
+            bits &= bits - 1;
+        }
+    }
+    flush_bits(&w);
+    while (w.size % sizeof(uint64_t) != 0) {
+        w.bytes[w.size++] = 0;
+    }
+    const struct record_frame frame = {
+        .generation = generation,
+        .num_flips = num_flips,
+        .num_bytes = w.size,
+        .keyframe = keyframe,
+        .rice_bits = k
+    };
+    memcpy(rec->buffer, &frame, sizeof(frame));
+
+    if (keyframe) {
+        if (rec->num_keyframes == rec->keyframes_capacity) {
+            const size_t capacity = (rec->keyframes_capacity == 0) ? 256 : rec->keyframes_capacity * 2;
+            struct record_keyframe* const grown = realloc(rec->keyframes, capacity * sizeof(*grown));
+            if (grown == NULL) {
+                fprintf(stderr, "Error: Failed to allocate memory for the recording.\n");
+                return false;
+            }
+            rec->keyframes = grown;
+            rec->keyframes_capacity = capacity;
+        }
+        rec->keyframes[rec->num_keyframes].generation = generation;
+        rec->keyframes[rec->num_keyframes].offset = rec->num_bytes;
+        rec->num_keyframes++;
+    }
+    if (!write_all(rec->fd, rec->buffer, sizeof(frame) + w.size)) {
+        fprintf(stderr, "Error when writing %s: %s\n", rec->path, strerror(errno));
+        return false;
+    }
+    rec->num_bytes += sizeof(frame) + w.size;
+    rec->raw_bytes += num_words * sizeof(uint64_t);
+    rec->num_frames++;
+    rec->previous_generation = generation;
+
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    rec->encode_ns += get_time_diff_ns(&start, &stop);
+    return true;
+}
+
+static void* recorder_main(void* const arg)
+{
+    struct recorder* const rec = arg;
+    pthread_mutex_lock(&rec->mutex);
+    for (;;) {
+        while ((rec->count == 0) && !rec->quit) {
+            pthread_cond_wait(&rec->cond, &rec->mutex);
+        }
+        if (rec->count == 0) {
+            break;
+        }
+        // Submitters leave queued slots alone, and after a failure the rest
+        // are dropped so that they do not wait for ever
+        const size_t slot = rec->head;
+        const bool failed = rec->failed;
+        pthread_mutex_unlock(&rec->mutex);
+        bool ok = true;
+        if (!failed) {
+            ok = write_frame(rec, &rec->slots[slot], rec->slot_generations[slot]);
+            const struct bitgrid previous = rec->previous;
+            rec->previous = rec->slots[slot];
+            rec->slots[slot] = previous;
+        }
+        pthread_mutex_lock(&rec->mutex);
+        rec->failed = rec->failed || !ok;
+        rec->head = (rec->head + 1) % RECORD_SLOTS;
+        rec->count--;
+        pthread_cond_broadcast(&rec->cond);
+    }
+    pthread_mutex_unlock(&rec->mutex);
+    return NULL;
+}
+
+static void free_recorder(struct recorder* const rec)
+{
+    for (size_t i = 0; i < RECORD_SLOTS; i++) {
+        bitgrid_destroy(&rec->slots[i]);
+    }
+    bitgrid_destroy(&rec->previous);
+    free(rec->buffer);
+    free(rec->keyframes);
+    rec->buffer = NULL;
+    rec->keyframes = NULL;
+}
+
+bool recorder_start(
+    struct recorder* const rec,
+    const char* const path,
+    const size_t width,
+    const size_t height,
+    const enum boundary boundary,
+    const struct rule* const rule,
+    const uint64_t keyframe_every)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->path = path;
+    rec->keyframe_every = keyframe_every;
+    bool allocated = true;
+    for (size_t i = 0; i < RECORD_SLOTS; i++) {
+        rec->slots[i] = bitgrid_create(width, height, boundary, rule);
+        allocated = allocated && (rec->slots[i].words != NULL);
+    }
+    rec->previous = bitgrid_create(width, height, boundary, rule);
+    if (!allocated || (rec->previous.words == NULL)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the recording.\n");
+        free_recorder(rec);
+        return false;
+    }
+
+    struct record_header header = {
+        .width = width,
+        .height = height,
+        .keyframe_every = keyframe_every,
+        .boundary = (uint32_t)boundary
+    };
+    memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+    format_rule(rule, header.rule, sizeof(header.rule));
+    rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (rec->fd == -1) {
+        fprintf(stderr, "Error when opening %s: %s\n", path, strerror(errno));
+        free_recorder(rec);
+        return false;
+    }
+    if (!write_all(rec->fd, &header, sizeof(header))) {
+        fprintf(stderr, "Error when writing %s: %s\n", path, strerror(errno));
+        close(rec->fd);
+        free_recorder(rec);
+        return false;
+    }
+    rec->num_bytes = sizeof(header);
+
+    pthread_mutex_init(&rec->mutex, NULL);
+    pthread_cond_init(&rec->cond, NULL);
+    const int err = pthread_create(&rec->thread, NULL, recorder_main, rec);
+    if (err != 0) {
+        fprintf(stderr, "Error when creating the recording thread: %s\n", strerror(err));
+        pthread_cond_destroy(&rec->cond);
+        pthread_mutex_destroy(&rec->mutex);
+        close(rec->fd);
+        free_recorder(rec);
+        return false;
+    }
+    return true;
+}
+
+// Copies the grid into a free slot, waiting for the writer to free one if
+// need be. Returns false once writing has failed.
+bool recorder_submit(struct recorder* const rec, const struct bitgrid* const grid, const uint64_t generation)
+{
+    pthread_mutex_lock(&rec->mutex);
+    if (rec->count == RECORD_SLOTS) {
+        rec->num_waits++;
+        while (rec->count == RECORD_SLOTS) {
+            pthread_cond_wait(&rec->cond, &rec->mutex);
+        }
+    }
+    if (rec->failed) {
+        pthread_mutex_unlock(&rec->mutex);
+        return false;
+    }
+    const size_t slot = (rec->head + rec->count) % RECORD_SLOTS;
+    memcpy(rec->slots[slot].words, grid->words, grid->words_per_row * grid->height * sizeof(uint64_t));
+    rec->slot_generations[slot] = generation;
+    rec->count++;
+    pthread_cond_broadcast(&rec->cond);
+    pthread_mutex_unlock(&rec->mutex);
+    return true;
+}
+
+// Writes the generations still queued, then the index
+bool recorder_stop(struct recorder* const rec)
+{
+    pthread_mutex_lock(&rec->mutex);
+    rec->quit = true;
+    pthread_cond_broadcast(&rec->cond);
+    pthread_mutex_unlock(&rec->mutex);
+    pthread_join(rec->thread, NULL);
+    pthread_cond_destroy(&rec->cond);
+    pthread_mutex_destroy(&rec->mutex);
+
+    bool ok = !rec->failed;
+    if (ok) {
+        struct record_footer footer = {
+            .index_offset = rec->num_bytes,
+            .num_keyframes = rec->num_keyframes,
+            .num_frames = rec->num_frames,
+            .last_generation = rec->previous_generation
+        };
+        memcpy(footer.magic, RECORD_INDEX_MAGIC, sizeof(footer.magic));
+        ok = write_all(rec->fd, rec->keyframes, rec->num_keyframes * sizeof(struct record_keyframe))
+          && write_all(rec->fd, &footer, sizeof(footer))
+          && (fsync(rec->fd) == 0);
+        if (!ok) {
+            fprintf(stderr, "Error when writing %s: %s\n", rec->path, strerror(errno));
+        }
+        rec->num_bytes += (rec->num_keyframes * sizeof(struct record_keyframe)) + sizeof(footer);
+    }
+    close(rec->fd);
+    free_recorder(rec);
+    return ok;
+}
+
+// Returns the frame at offset if it lies whole within the frames
+static const struct record_frame* frame_at(const struct replay* const rp, const size_t offset)
+{
+    if ((offset % sizeof(uint64_t) != 0) || (offset > rp->frames_end) || (rp->frames_end - offset < sizeof(struct record_frame))) {
+        return NULL;
+    }
+    const struct record_frame* const frame = (const struct record_frame*)(rp->data + offset);
+    const uint64_t num_bits = (uint64_t)rp->header->height * ((rp->header->width + 63) / 64) * 64;
+    if ((frame->num_bytes % sizeof(uint64_t) != 0)
+        || (frame->num_bytes > rp->frames_end - offset - sizeof(*frame))
+        || (frame->keyframe > 1)
+        || (frame->rice_bits > 63)
+        || (frame->num_flips > num_bits)) {
+        return NULL;
+    }
+    return frame;
+}
+
+static size_t frame_end(const struct record_frame* const frame, const size_t offset)
+{
+    return offset + sizeof(*frame) + frame->num_bytes;
+}
+
+// Collects the keyframes of a recording that has no index, up to the last
+// whole frame
+static bool scan_frames(struct replay* const rp)
+{
+    size_t capacity = 0;
+    size_t offset = sizeof(struct record_header);
+    rp->frames_end = rp->map_size;
+    const struct record_frame* frame;
+    while ((frame = frame_at(rp, offset)) != NULL) {
+        if ((rp->num_frames == 0) ? !frame->keyframe : (frame->generation <= rp->last_generation)) {
+            break;
+        }
+        if (frame->keyframe) {
+            if (rp->num_keyframes == capacity) {
+                capacity = (capacity == 0) ? 256 : capacity * 2;
+                struct record_keyframe* const grown = realloc(rp->keyframes, capacity * sizeof(*grown));
+                if (grown == NULL) {
+                    return false;
+                }
+                rp->keyframes = grown;
+            }
+            rp->keyframes[rp->num_keyframes].generation = frame->generation;
+            rp->keyframes[rp->num_keyframes].offset = offset;
+            rp->num_keyframes++;
+        }
+        rp->last_generation = frame->generation;
+        rp->num_frames++;
+        offset = frame_end(frame, offset);
+    }
+    rp->frames_end = offset;
+    return true;
+}
+
+static bool read_index(struct replay* const rp, const struct record_footer* const footer)
+{
+    rp->frames_end = footer->index_offset;
+    rp->num_frames = footer->num_frames;
+    rp->last_generation = footer->last_generation;
+    rp->keyframes = malloc(footer->num_keyframes * sizeof(struct record_keyframe));
+    if (rp->keyframes == NULL) {
+        return false;
+    }
+    memcpy(rp->keyframes, rp->data + footer->index_offset, footer->num_keyframes * sizeof(struct record_keyframe));
+    rp->num_keyframes = footer->num_keyframes;
+    return true;
+}
+
+static bool has_index(const struct replay* const rp, const struct record_footer* const footer)
+{
+    if (memcmp(footer->magic, RECORD_INDEX_MAGIC, sizeof(footer->magic)) != 0) {
+        return false;
+    }
+    const size_t index_end = rp->map_size - sizeof(*footer);
+    if ((footer->index_offset < sizeof(struct record_header))
+        || (footer->index_offset > index_end)
+        || (footer->num_keyframes == 0)
+        || (footer->num_keyframes != (index_end - footer->index_offset) / sizeof(struct record_keyframe))
+        || ((index_end - footer->index_offset) % sizeof(struct record_keyframe) != 0)) {
+        return false;
+    }
+    return true;
+}
+
+bool replay_open(struct replay* const rp, const char* const path)
+{
+    memset(rp, 0, sizeof(*rp));
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Error when opening %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "Error when reading %s: %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    const size_t size = (size_t)st.st_size;
+    if (size < sizeof(struct record_header)) {
+        fprintf(stderr, "Error: %s is not a recording\n", path);
+        close(fd);
+        return false;
+    }
+    void* const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error when mapping %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    rp->map = map;
+    rp->map_size = size;
+    rp->data = map;
+    rp->header = map;
+
+    const struct record_header* const header = rp->header;
+    if ((memcmp(header->magic, RECORD_MAGIC, sizeof(header->magic)) != 0)
+        || (header->width == 0) || (header->width > MAX_GRID_SIDE)
+        || (header->height == 0) || (header->height > MAX_GRID_SIDE)
+        || (header->boundary > BOUNDARY_TORUS)
+        || (header->keyframe_every == 0)
+        || (memchr(header->rule, '\0', sizeof(header->rule)) == NULL)) {
+        fprintf(stderr, "Error: %s is not a valid recording\n", path);
+        replay_close(rp);
+        return false;
+    }
+    if (!parse_rule(header->rule, &rp->rule)) {
+        fprintf(stderr, "Error: %s is for the unsupported rule %s\n", path, header->rule);
+        replay_close(rp);
+        return false;
+    }
+
+    // The index is only trusted if every keyframe it lists is one
+    const struct record_footer* const footer = (const struct record_footer*)(rp->data + size - sizeof(struct record_footer));
+    bool indexed = (size >= sizeof(struct record_header) + sizeof(struct record_footer)) && has_index(rp, footer);
+    if (indexed) {
+        if (!read_index(rp, footer)) {
+            fprintf(stderr, "Error: Failed to allocate memory for the recording index.\n");
+            replay_close(rp);
+            return false;
+        }
+        for (size_t i = 0; indexed && (i < rp->num_keyframes); i++) {
+            const struct record_frame* const frame = frame_at(rp, rp->keyframes[i].offset);
+            indexed = (frame != NULL) && frame->keyframe
+                   && (frame->generation == rp->keyframes[i].generation)
+                   && ((i == 0) || (rp->keyframes[i - 1].generation < frame->generation))
+                   && (frame->generation <= rp->last_generation);
+        }
+        if (!indexed) {
+            free(rp->keyframes);
+            rp->keyframes = NULL;
+            rp->num_keyframes = 0;
+            rp->num_frames = 0;
+            rp->last_generation = 0;
+        }
+    }
+    if (!indexed && !scan_frames(rp)) {
+        fprintf(stderr, "Error: Failed to allocate memory for the recording index.\n");
+        replay_close(rp);
+        return false;
+    }
+    if (rp->num_keyframes == 0) {
+        fprintf(stderr, "Error: %s holds no generations\n", path);
+        replay_close(rp);
+        return false;
+    }
+    return true;
+}
+
+void replay_close(struct replay* const rp)
+{
+    if (rp->map != NULL) {
+        munmap(rp->map, rp->map_size);
+    }
+    free(rp->keyframes);
+    memset(rp, 0, sizeof(*rp));
+}
+
+// Applies the flips of the frame to the grid, which is cleared first for a
+// keyframe. Tiles are one word of 64 rows, as in a tile_map, so dirty has
+// words_per_row tiles in each row of them.
+static bool apply_frame(const struct record_frame* const frame, struct bitgrid* const grid, uint8_t* const dirty)
+{
+    const size_t wpr = grid->words_per_row;
+    const size_t num_words = grid->height * wpr;
+    const uint64_t num_bits = (uint64_t)num_words * 64;
+    if (frame->keyframe) {
+        memset(grid->words, 0, num_words * sizeof(uint64_t));
+        if (dirty != NULL) {
+            memset(dirty, 1, wpr * ((grid->height + TILE_SIZE - 1) / TILE_SIZE));
+        }
+    }
+    struct bit_reader r = {
+        .next = (const uint8_t*)(frame + 1),
+        .end = (const uint8_t*)(frame + 1) + frame->num_bytes
+    };
+    uint64_t position = 0;
+    for (uint64_t i = 0; i < frame->num_flips; i++) {
+        uint64_t gap;
+        if (!get_rice(&r, frame->rice_bits, &gap) || (gap >= num_bits - position)) {
+            return false;
+        }
+        position += gap;
+        const size_t word = (size_t)(position / 64);
+        grid->words[word] ^= UINT64_C(1) << (position % 64);
+        if (dirty != NULL) {
+            dirty[((word / wpr / TILE_SIZE) * wpr) + (word % wpr)] = 1;
+        }
+        position++;
+    }
+    return true;
+}
+
+// Decodes the frame at offset and moves past it
+static bool replay_frame(struct replay* const rp, const size_t offset, struct bitgrid* const grid, uint8_t* const dirty)
+{
+    const struct record_frame* const frame = frame_at(rp, offset);
+    if ((frame == NULL) || !apply_frame(frame, grid, dirty)) {
+        fprintf(stderr, "Error: The recording is corrupt\n");
+        rp->positioned = false;
+        return false;
+    }
+    rp->generation = frame->generation;
+    rp->next_offset = frame_end(frame, offset);
+    rp->positioned = true;
+    return true;
+}
+
+// The index of the last keyframe at or before generation
+static size_t find_keyframe(const struct replay* const rp, const uint64_t generation)
+{
+    size_t lo = 0;
+    size_t hi = rp->num_keyframes;
+    while (hi - lo > 1) {
+        const size_t mid = lo + ((hi - lo) / 2);
+        if (rp->keyframes[mid].generation <= generation) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Decodes the last recorded generation at or before generation into the
+// grid, which must have the dimensions in the header. Only the frames from
+// the keyframe before it are decoded, or from the generation the grid
+// already holds if that is closer.
+bool replay_seek(struct replay* const rp, struct bitgrid* const grid, const uint64_t generation, uint8_t* const dirty)
+{
+    if (generation < rp->keyframes[0].generation) {
+        fprintf(stderr, "Error: The recording starts at generation %" PRIu64 "\n", rp->keyframes[0].generation);
+        return false;
+    }
+    const struct record_keyframe* const keyframe = &rp->keyframes[find_keyframe(rp, generation)];
+    if (!rp->positioned || (rp->generation > generation) || (rp->generation < keyframe->generation)) {
+        if (!replay_frame(rp, keyframe->offset, grid, dirty)) {
+            return false;
+        }
+    }
+    const struct record_frame* frame;
+    while (((frame = frame_at(rp, rp->next_offset)) != NULL) && (frame->generation <= generation)) {
+        if (!replay_frame(rp, rp->next_offset, grid, dirty)) {
+            return false;
+        }
+    }
+    bitgrid_clear_padding(grid);
+    return true;
+}
+
+// Decodes the generation after the one the grid holds. Returns false at the
+// end of the recording.
+bool replay_next(struct replay* const rp, struct bitgrid* const grid, uint8_t* const dirty)
+{
+    if (!rp->positioned) {
+        return replay_seek(rp, grid, rp->keyframes[0].generation, dirty);
+    }
+    if ((rp->generation >= rp->last_generation) || (frame_at(rp, rp->next_offset) == NULL)) {
+        return false;
+    }
+    if (!replay_frame(rp, rp->next_offset, grid, dirty)) {
+        return false;
+    }
+    bitgrid_clear_padding(grid);
+    return true;
+}
+
+// The generation of the last keyframe before generation, or the first one
+uint64_t replay_keyframe_before(const struct replay* const rp, const uint64_t generation)
+{
+    const size_t i = find_keyframe(rp, generation);
+    if ((rp->keyframes[i].generation == generation) && (i > 0)) {
+        return rp->keyframes[i - 1].generation;
+    }
+    return rp->keyframes[i].generation;
+}
+
+// The generation of the first keyframe after generation, or the last
+// generation
+uint64_t replay_keyframe_after(const struct replay* const rp, const uint64_t generation)
+{
+    if (generation < rp->keyframes[0].generation) {
+        return rp->keyframes[0].generation;
+    }
+    const size_t i = find_keyframe(rp, generation);
+    return (i + 1 < rp->num_keyframes) ? rp->keyframes[i + 1].generation : rp->last_generation;
+}
@@ -0,0 +1,117 @@
+#ifndef record_h
+#define record_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "bitgrid.h"
+
+#define RECORD_MAGIC        "GOLREC01"
+#define RECORD_INDEX_MAGIC  "GOLRECIX"
+#define RECORD_RULE_SIZE    32
+#define RECORD_SLOTS        4
+
+// A recording is this header, then one frame per generation, then an index
+// of the keyframes and a footer. Each frame is a record_frame and num_bytes
+// of payload, padded to a multiple of 8 bytes. The payload lists the cells
+// that flipped since the frame before, or for a keyframe the live cells, as
+// their bit positions in the words of a bitgrid: (word index * 64) + bit.
+// Positions are stored in increasing order as the gaps between them, Rice
+// coded with rice_bits low bits each, read least significant bit first.
+// All fields are in native byte order.
+struct record_header {
+    char magic[8];
+    uint64_t width;
+    uint64_t height;
+    uint64_t keyframe_every;
+    uint32_t boundary;
+    uint32_t reserved;
+    char rule[RECORD_RULE_SIZE];
+};
+
+struct record_frame {
+    uint64_t generation;
+    uint64_t num_flips;
+    uint64_t num_bytes;
+    uint32_t keyframe;
+    uint32_t rice_bits;
+};
+
+struct record_keyframe {
+    uint64_t generation;
+    uint64_t offset;
+};
+
+// The index of a recording that was stopped cleanly. Recordings cut short
+// have none and their keyframes are found by walking the frames.
+struct record_footer {
+    uint64_t index_offset;
+    uint64_t num_keyframes;
+    uint64_t num_frames;
+    uint64_t last_generation;
+    char magic[8];
+};
+
+// Writes every generation on a background thread. The stepping thread
+// copies each generation into a free slot, waiting for one if the writer
+// has fallen RECORD_SLOTS generations behind, and the writer encodes it
+// against the generation before. A keyframe is written every
+// keyframe_every generations and wherever generations were skipped.
+struct recorder {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    const char* path;
+    int fd;
+    struct bitgrid slots[RECORD_SLOTS];
+    uint64_t slot_generations[RECORD_SLOTS];
+    size_t head;
+    size_t count;
+    bool quit;
+    bool failed;
+    struct bitgrid previous;
+    uint64_t previous_generation;
+    uint64_t keyframe_every;
+    uint8_t* buffer;
+    size_t buffer_capacity;
+    struct record_keyframe* keyframes;
+    size_t keyframes_capacity;
+    size_t num_keyframes;
+    size_t num_frames;
+    size_t num_waits;
+    uint64_t num_bytes;
+    uint64_t raw_bytes;
+    int64_t encode_ns;
+};
+
+// A recording mapped into memory, and the generation of it that was last
+// decoded into the grid passed to replay_seek and replay_next
+struct replay {
+    const struct record_header* header;
+    struct rule rule;
+    const uint8_t* data;
+    size_t frames_end;
+    void* map;
+    size_t map_size;
+    struct record_keyframe* keyframes;
+    size_t num_keyframes;
+    size_t num_frames;
+    uint64_t last_generation;
+    uint64_t generation;
+    size_t next_offset;
+    bool positioned;
+};
+
+bool recorder_start(struct recorder* const rec, const char* const path, const size_t width, const size_t height, const enum boundary boundary, const struct rule* const rule, const uint64_t keyframe_every);
+bool recorder_submit(struct recorder* const rec, const struct bitgrid* const grid, const uint64_t generation);
+bool recorder_stop(struct recorder* const rec);
+
+bool replay_open(struct replay* const rp, const char* const path);
+void replay_close(struct replay* const rp);
+bool replay_seek(struct replay* const rp, struct bitgrid* const grid, const uint64_t generation, uint8_t* const dirty);
+bool replay_next(struct replay* const rp, struct bitgrid* const grid, uint8_t* const dirty);
+uint64_t replay_keyframe_before(const struct replay* const rp, const uint64_t generation);
+uint64_t replay_keyframe_after(const struct replay* const rp, const uint64_t generation);
+
+#endif
@@ -0,0 +1,94 @@
+#include "rule.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+const struct rule conway_rule = {
+    .birth = RULE_CONWAY_BIRTH,
+    .survival = RULE_CONWAY_SURVIVAL,
+    .kind = RULE_CONWAY
+};
+
+static const struct {
+    const char* name;
+    struct rule rule;
+} named_rules[] = {
+    {"conway", {RULE_CONWAY_BIRTH, RULE_CONWAY_SURVIVAL, RULE_CONWAY}},
+    {"highlife", {RULE_HIGHLIFE_BIRTH, RULE_HIGHLIFE_SURVIVAL, RULE_HIGHLIFE}},
+    {"daynight", {RULE_DAY_NIGHT_BIRTH, RULE_DAY_NIGHT_SURVIVAL, RULE_DAY_NIGHT}},
+    {"seeds", {RULE_SEEDS_BIRTH, RULE_SEEDS_SURVIVAL, RULE_SEEDS}}
+};
+static const size_t num_named_rules = sizeof(named_rules) / sizeof(named_rules[0]);
+
+// Reads the neighbor counts after a B or S, up to the next slash
+static const char* parse_counts(const char* str, uint16_t* const counts)
+{
+    *counts = 0;
+    while ((*str >= '0') && (*str <= '8')) {
+        *counts |= (uint16_t)(1u << (*str - '0'));
+        str++;
+    }
+    return str;
+}
+
+// Accepts B/S notation such as B36/S23, in either order and either case,
+// or the name of one of the common rules
+bool parse_rule(const char* const str, struct rule* const rule)
+{
+    for (size_t i = 0; i < num_named_rules; i++) {
+        if (strcmp(str, named_rules[i].name) == 0) {
+            *rule = named_rules[i].rule;
+            return true;
+        }
+    }
+    bool has_birth = false;
+    bool has_survival = false;
+    const char* s = str;
+    for (int part = 0; part < 2; part++) {
+        const char letter = (char)toupper((unsigned char)*s);
+        if ((letter == 'B') && !has_birth) {
+            s = parse_counts(s + 1, &rule->birth);
+            has_birth = true;
+        } else if ((letter == 'S') && !has_survival) {
+            s = parse_counts(s + 1, &rule->survival);
+            has_survival = true;
+        } else {
+            return false;
+        }
+        if ((part == 0) && (*s++ != '/')) {
+            return false;
+        }
+    }
+    if ((*s != '\0') || (rule->birth & 1)) {
+        return false;
+    }
+    rule->kind = RULE_OTHER;
+    for (size_t i = 0; i < num_named_rules; i++) {
+        if ((rule->birth == named_rules[i].rule.birth) && (rule->survival == named_rules[i].rule.survival)) {
+            rule->kind = named_rules[i].rule.kind;
+        }
+    }
+    return true;
+}
+
+// Writes the rule in B/S notation, such as B3/S23
+void format_rule(const struct rule* const rule, char* const str, const size_t size)
+{
+    char buf[RULE_STRING_SIZE];
+    size_t len = 0;
+    buf[len++] = 'B';
+    for (unsigned int n = 0; n <= 8; n++) {
+        if ((rule->birth >> n) & 1) {
+            buf[len++] = (char)('0' + n);
+        }
+    }
+    buf[len++] = '/';
+    buf[len++] = 'S';
+    for (unsigned int n = 0; n <= 8; n++) {
+        if ((rule->survival >> n) & 1) {
+            buf[len++] = (char)('0' + n);
+        }
+    }
+    buf[len] = '\0';
+    snprintf(str, size, "%s", buf);
+}
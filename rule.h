@@ -0,0 +1,80 @@
+#ifndef rule_h
+#define rule_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define RULE_STRING_SIZE 32
+
+#define RULE_CONWAY_BIRTH         (1u << 3)
+#define RULE_CONWAY_SURVIVAL      ((1u << 2) | (1u << 3))
+#define RULE_HIGHLIFE_BIRTH       ((1u << 3) | (1u << 6))
+#define RULE_HIGHLIFE_SURVIVAL    ((1u << 2) | (1u << 3))
+#define RULE_DAY_NIGHT_BIRTH      ((1u << 3) | (1u << 6) | (1u << 7) | (1u << 8))
+#define RULE_DAY_NIGHT_SURVIVAL   ((1u << 3) | (1u << 4) | (1u << 6) | (1u << 7) | (1u << 8))
+#define RULE_SEEDS_BIRTH          (1u << 2)
+#define RULE_SEEDS_SURVIVAL       0u
+
+// The rules with kernels of their own
+enum rule_kind {
+    RULE_CONWAY,
+    RULE_HIGHLIFE,
+    RULE_DAY_NIGHT,
+    RULE_SEEDS,
+    RULE_OTHER
+};
+
+// An outer totalistic rule. Bit n of birth is set when a dead cell with n
+// live neighbors comes alive, and bit n of survival when a live cell with n
+// live neighbors stays alive. Rules with B0 are not supported, as they would
+// bring the dead plane outside the grid to life.
+struct rule {
+    uint16_t birth;
+    uint16_t survival;
+    enum rule_kind kind;
+};
+
+extern const struct rule conway_rule;
+
+bool parse_rule(const char* const str, struct rule* const rule);
+void format_rule(const struct rule* const rule, char* const str, const size_t size);
+
+static inline bool rule_next(const struct rule* const rule, const bool alive, const unsigned int num_neighbors)
+{
+    return (((alive ? rule->survival : rule->birth) >> num_neighbors) & 1) != 0;
+}
+
+// Calls impl with the extra arguments birth, survival and lookup. The common
+// rules pass their masks as constants and lookup as false, so that an impl
+// that is always inlined is specialized for each of them. Any other rule
+// passes its masks at run time and lookup as true, for impls that have a
+// table lookup that beats testing every neighbor count. Impls without one
+// use RULE_DISPATCH_MASKS, which only passes birth and survival.
+#define RULE_DISPATCH(rule, impl, ...) RULE_SWITCH(rule, impl, RULE_LOOKUP_ARG, __VA_ARGS__)
+#define RULE_DISPATCH_MASKS(rule, impl, ...) RULE_SWITCH(rule, impl, RULE_NO_ARG, __VA_ARGS__)
+
+#define RULE_LOOKUP_ARG(lookup) , lookup
+#define RULE_NO_ARG(lookup)
+#define RULE_SWITCH(rule, impl, extra, ...)                                                        \
+    do {                                                                                           \
+        switch ((rule)->kind) {                                                                    \
+        case RULE_CONWAY:                                                                          \
+            impl(__VA_ARGS__, RULE_CONWAY_BIRTH, RULE_CONWAY_SURVIVAL extra(false));               \
+            break;                                                                                 \
+        case RULE_HIGHLIFE:                                                                        \
+            impl(__VA_ARGS__, RULE_HIGHLIFE_BIRTH, RULE_HIGHLIFE_SURVIVAL extra(false));           \
+            break;                                                                                 \
+        case RULE_DAY_NIGHT:                                                                       \
+            impl(__VA_ARGS__, RULE_DAY_NIGHT_BIRTH, RULE_DAY_NIGHT_SURVIVAL extra(false));         \
+            break;                                                                                 \
+        case RULE_SEEDS:                                                                           \
+            impl(__VA_ARGS__, RULE_SEEDS_BIRTH, RULE_SEEDS_SURVIVAL extra(false));                 \
+            break;                                                                                 \
+        case RULE_OTHER:                                                                           \
+            impl(__VA_ARGS__, (rule)->birth, (rule)->survival extra(true));                        \
+            break;                                                                                 \
+        }                                                                                          \
+    } while (0)
+
+#endif
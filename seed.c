@@ -0,0 +1,193 @@
+#include "seed.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Density is kept as a 16-bit binary fraction
+#define DENSITY_BITS 16
+#define FULL_DENSITY (1u << DENSITY_BITS)
+
+// Rows of ARGB cells are unpacked from this many words at a time
+#define CHUNK_WORDS 64
+
+struct seed_stream {
+    uint64_t key;
+    uint32_t density;
+};
+
+// The splitmix64 finalizer, applied to a counter
+static inline uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+static struct seed_stream seed_stream(const struct board_seed* const seed)
+{
+    double fraction = seed->density * FULL_DENSITY + 0.5;
+    fraction = (fraction < 0.0) ? 0.0 : ((fraction > FULL_DENSITY) ? FULL_DENSITY : fraction);
+    const struct seed_stream stream = {
+        .key = mix(seed->seed + UINT64_C(0x9E3779B97F4A7C15)),
+        .density = (uint32_t)fraction
+    };
+    return stream;
+}
+
+// 64 cells, each alive with probability density / 2^16. The binary digits
+// of density are walked from the lowest set one up: OR-ing in a random word
+// takes each bit's probability p to (1 + p) / 2 and AND-ing to p / 2, which
+// adds up to the fraction the digits spell. Densities with fewer digits
+// need fewer random words, down to one for 0.5.
+static inline uint64_t seed_word(const struct seed_stream* const stream, const uint64_t index)
+{
+    if (stream->density == 0) {
+        return 0;
+    }
+    if (stream->density >= FULL_DENSITY) {
+        return UINT64_MAX;
+    }
+    const uint64_t counter = index * DENSITY_BITS;
+    uint64_t word = 0;
+    for (unsigned int k = (unsigned int)__builtin_ctz(stream->density); k < DENSITY_BITS; k++) {
+        const uint64_t random = mix(stream->key ^ ((counter + k) * UINT64_C(0x9E3779B97F4A7C15)));
+        word = ((stream->density >> k) & 1) ? (word | random) : (word & random);
+    }
+    return word;
+}
+
+static inline uint64_t last_word_mask(const size_t width)
+{
+    const size_t remainder = width % 64;
+    return (remainder == 0) ? UINT64_MAX : ((UINT64_C(1) << remainder) - 1);
+}
+
+// Picks a seed for runs that were not given one
+bool random_seed(uint64_t* const seed)
+{
+    static const char dev_urand_path[] = "/dev/urandom";
+    const int devurand_fd = open(dev_urand_path, O_RDONLY);
+    if (devurand_fd == -1) {
+        fprintf(stderr, "Error when opening %s: %s\n", dev_urand_path, strerror(errno));
+        return false;
+    }
+    const ssize_t num_read = read(devurand_fd, seed, sizeof(*seed));
+    close(devurand_fd);
+    if (num_read != (ssize_t)sizeof(*seed)) {
+        fprintf(stderr, "Error when reading from %s: %s\n", dev_urand_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool parse_density(const char* const str, double* const density)
+{
+    char* end;
+    errno = 0;
+    const double parsed = strtod(str, &end);
+    if ((errno != 0) || (end == str) || (*end != '\0') || !(parsed >= 0.0) || !(parsed <= 1.0)) {
+        return false;
+    }
+    *density = parsed;
+    return true;
+}
+
+struct seed_bitgrid_args {
+    struct seed_stream stream;
+    struct bitgrid* grid;
+};
+
+static void seed_bitgrid_rows(void* const ctx, const size_t y_start, const size_t y_end)
+{
+    const struct seed_bitgrid_args* const args = ctx;
+    const size_t n = args->grid->words_per_row;
+    const uint64_t mask = last_word_mask(args->grid->width);
+    for (size_t y = y_start; y < y_end; y++) {
+        uint64_t* const row = args->grid->words + (y * n);
+        for (size_t i = 0; i < n; i++) {
+            row[i] = seed_word(&args->stream, (y * n) + i);
+        }
+        row[n - 1] &= mask;
+    }
+}
+
+// Fills the grid with random cells. The halo rows are left to
+// bitgrid_refresh_halo.
+void seed_bitgrid(struct thread_pool* const pool, const struct board_seed* const seed, struct bitgrid* const grid)
+{
+    struct seed_bitgrid_args args = {
+        .stream = seed_stream(seed),
+        .grid = grid
+    };
+    pool_run_rows(pool, seed_bitgrid_rows, &args, grid->height, grid->words_per_row * sizeof(uint64_t));
+}
+
+// The words of row y of a board width cells wide, as seed_bitgrid would
+// fill them, for engines that lay cells out their own way
+void seed_row_words(const struct board_seed* const seed, const size_t width, const size_t y, uint64_t* const words)
+{
+    const struct seed_stream stream = seed_stream(seed);
+    const size_t n = (width + 63) / 64;
+    for (size_t i = 0; i < n; i++) {
+        words[i] = seed_word(&stream, (y * n) + i);
+    }
+    words[n - 1] &= last_word_mask(width);
+}
+
+struct seed_cells_args {
+    struct seed_stream stream;
+    const struct cell_kernel* kernel;
+    const struct grid* g;
+    uint32_t* cells;
+};
+
+// Each row is generated as the words a bitgrid would hold, a chunk at a
+// time, and unpacked by the kernel's SIMD loop straight into the row, out
+// to the end of its padding
+static void seed_cells_rows(void* const ctx, const size_t y_start, const size_t y_end)
+{
+    const struct seed_cells_args* const args = ctx;
+    const struct grid* const g = args->g;
+    const size_t n = (g->width + 63) / 64;
+    const uint64_t mask = last_word_mask(g->width);
+    uint64_t words[CHUNK_WORDS];
+    for (size_t y = y_start; y < y_end; y++) {
+        uint32_t* const row = args->cells + (y * g->stride);
+        for (size_t x = 0; x < g->stride; x += CHUNK_WORDS * 64) {
+            const size_t num_cells = (g->stride - x < CHUNK_WORDS * 64) ? g->stride - x : CHUNK_WORDS * 64;
+            const size_t first_word = x / 64;
+            for (size_t i = 0; i < (num_cells + 63) / 64; i++) {
+                const size_t word = first_word + i;
+                if (word + 1 < n) {
+                    words[i] = seed_word(&args->stream, (y * n) + word);
+                } else if (word + 1 == n) {
+                    words[i] = seed_word(&args->stream, (y * n) + word) & mask;
+                } else {
+                    words[i] = 0;
+                }
+            }
+            args->kernel->expand(words, row + x, num_cells);
+        }
+    }
+}
+
+// Fills the grid with the same cells as seed_bitgrid would. The ghost cells
+// are left to grid_refresh_halo.
+void seed_cells(
+    struct thread_pool* const pool,
+    const struct board_seed* const seed,
+    const struct cell_kernel* const kernel,
+    const struct grid* const g,
+    uint32_t* const cells)
+{
+    struct seed_cells_args args = {
+        .stream = seed_stream(seed),
+        .kernel = kernel,
+        .g = g,
+        .cells = cells
+    };
+    pool_run_rows(pool, seed_cells_rows, &args, g->height, g->stride * sizeof(uint32_t));
+}
@@ -0,0 +1,31 @@
+#ifndef seed_h
+#define seed_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "grid.h"
+#include "bitgrid.h"
+#include "kernels.h"
+#include "pool.h"
+
+// Random boards are a pure function of the seed, the density and the grid
+// width: each word of 64 cells is generated from a counter made of its
+// index in the grid, with no state carried from one word to the next. Rows
+// can be filled in any order, on any number of threads, into a bitgrid or
+// ARGB cells, and always give the same board. Each cell is alive with
+// probability density, rounded to a multiple of 2^-16.
+struct board_seed {
+    uint64_t seed;
+    double density;
+};
+
+#define DEFAULT_SEED_DENSITY 0.5
+
+bool random_seed(uint64_t* const seed);
+bool parse_density(const char* const str, double* const density);
+void seed_bitgrid(struct thread_pool* const pool, const struct board_seed* const seed, struct bitgrid* const grid);
+void seed_row_words(const struct board_seed* const seed, const size_t width, const size_t y, uint64_t* const words);
+void seed_cells(struct thread_pool* const pool, const struct board_seed* const seed, const struct cell_kernel* const kernel, const struct grid* const g, uint32_t* const cells);
+
+#endif
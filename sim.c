@@ -0,0 +1,447 @@
+#include "sim.h"
+#include "cells.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool sim_create(struct simulation* const sim, const struct grid* const g, const struct sim_config* const config)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->g = *g;
+    sim->config = *config;
+    sim->engine = config->engine;
+    census_clear(&sim->census);
+    switch (config->engine) {
+    case ENGINE_BITGRID:
+        sim->bits[0] = bitgrid_create(g->width, g->height, g->boundary, &g->rule);
+        sim->bits[1] = bitgrid_create(g->width, g->height, g->boundary, &g->rule);
+        if ((sim->bits[0].words != NULL)
+            && (sim->bits[1].words != NULL)
+            && tile_map_create(&sim->tiles, g->width, g->height, g->boundary == BOUNDARY_TORUS)) {
+            tile_map_mark_all(&sim->tiles);
+            return true;
+        }
+        break;
+    case ENGINE_CELLS:
+        sim->kernel = (config->kernel != NULL) ? config->kernel : select_cell_kernel();
+        if (!cell_kernel_prepare(sim->kernel, &sim->g)) {
+            return false;
+        }
+        sim->cells[0] = grid_alloc_cells(g);
+        sim->cells[1] = grid_alloc_cells(g);
+        sim->row_hashes = calloc(g->height, sizeof(uint64_t));
+        sim->row_census = malloc(g->height * sizeof(struct census));
+        sim->bits[0] = bitgrid_create(g->width, g->height, g->boundary, &g->rule);
+        if ((sim->cells[0] == NULL) || (sim->cells[1] == NULL) || (sim->row_hashes == NULL) || (sim->row_census == NULL) || (sim->bits[0].words == NULL)) {
+            break;
+        }
+        if ((config->block_generations > 0)
+            && !cell_blocker_create(&sim->blocker, sim->kernel, &sim->g, config->block_size, config->block_generations, config->num_threads)) {
+            sim_destroy(sim);
+            return false;
+        }
+        return true;
+    case ENGINE_HASHLIFE:
+        if (g->boundary != BOUNDARY_DEAD) {
+            fprintf(stderr, "Error: The hashlife engine has no boundary, only an unbounded plane.\n");
+            return false;
+        }
+        sim->bits[0] = bitgrid_create(g->width, g->height, g->boundary, &g->rule);
+        if (sim->bits[0].words == NULL) {
+            break;
+        }
+        if (!hashlife_create(&sim->hl, config->hashlife_max_bytes, &g->rule)) {
+            bitgrid_destroy(&sim->bits[0]);
+            return false;
+        }
+        return true;
+    case ENGINE_PLANE:
+        if (g->boundary != BOUNDARY_DEAD) {
+            fprintf(stderr, "Error: The plane engine has no boundary, only an unbounded plane.\n");
+            return false;
+        }
+        sim->bits[0] = bitgrid_create(g->width, g->height, g->boundary, &g->rule);
+        if (sim->bits[0].words == NULL) {
+            break;
+        }
+        if (!plane_create(&sim->plane, &g->rule)) {
+            bitgrid_destroy(&sim->bits[0]);
+            return false;
+        }
+        return true;
+    }
+    fprintf(stderr, "Error: Failed to allocate memory for the cell buffers.\n");
+    sim_destroy(sim);
+    return false;
+}
+
+void sim_destroy(struct simulation* const sim)
+{
+    if (sim->engine == ENGINE_HASHLIFE) {
+        hashlife_destroy(&sim->hl);
+    }
+    if (sim->engine == ENGINE_PLANE) {
+        plane_destroy(&sim->plane);
+    }
+    bitgrid_destroy(&sim->bits[0]);
+    bitgrid_destroy(&sim->bits[1]);
+    tile_map_destroy(&sim->tiles);
+    cell_blocker_destroy(&sim->blocker);
+    grid_free_cells(&sim->g, sim->cells[0]);
+    grid_free_cells(&sim->g, sim->cells[1]);
+    cell_kernel_release(&sim->g);
+    sim->cells[0] = NULL;
+    sim->cells[1] = NULL;
+    free(sim->row_hashes);
+    free(sim->row_census);
+    sim->row_hashes = NULL;
+    sim->row_census = NULL;
+}
+
+// Fills the current generation with the random board of seed. The hashlife
+// and plane engines load it from the bitgrid they are seeded from.
+bool sim_randomize(struct simulation* const sim, struct thread_pool* const pool, const struct board_seed* const seed)
+{
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+        seed_bitgrid(pool, seed, &sim->bits[sim->current]);
+        bitgrid_refresh_halo(&sim->bits[sim->current]);
+        tile_map_mark_all(&sim->tiles);
+        return true;
+    case ENGINE_CELLS:
+        seed_cells(pool, seed, sim->kernel, &sim->g, sim->cells[sim->current]);
+        grid_refresh_halo(&sim->g, sim->cells[sim->current]);
+        return true;
+    case ENGINE_HASHLIFE:
+        seed_bitgrid(pool, seed, &sim->bits[0]);
+        if (!hashlife_load_bitgrid(&sim->hl, &sim->bits[0])) {
+            fprintf(stderr, "Error: The grid is too large for the hashlife engine.\n");
+            return false;
+        }
+        return true;
+    case ENGINE_PLANE:
+        seed_bitgrid(pool, seed, &sim->bits[0]);
+        plane_load_bitgrid(&sim->plane, &sim->bits[0]);
+        return true;
+    }
+    return false;
+}
+
+static void set_bitgrid_run(void* const ctx, const size_t x, const size_t y, const size_t length)
+{
+    bitgrid_set_run(ctx, x, y, length);
+}
+
+struct cells_sink {
+    const struct grid* g;
+    uint32_t* cells;
+};
+
+static void set_cells_run(void* const ctx, const size_t x, const size_t y, const size_t length)
+{
+    const struct cells_sink* const sink = ctx;
+    uint32_t* const row = sink->cells + (y * sink->g->stride);
+    for (size_t i = x; i < x + length; i++) {
+        row[i] = LIVE_CELL;
+    }
+}
+
+// Replaces the current generation with the pattern in a file, clipped to
+// the grid. The hashlife and plane engines load it into the bitgrid they
+// are seeded from.
+bool sim_load_pattern(
+    struct simulation* const sim,
+    const char* const path,
+    const int64_t offset_x,
+    const int64_t offset_y,
+    struct pattern_stats* const stats)
+{
+    struct cells_sink cells_sink = {
+        .g = &sim->g,
+        .cells = sim->cells[sim->current]
+    };
+    struct pattern_sink sink = {
+        .width = sim->g.width,
+        .height = sim->g.height
+    };
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+    case ENGINE_HASHLIFE:
+    case ENGINE_PLANE: {
+        struct bitgrid* const grid = &sim->bits[sim->current];
+        memset(grid->words, 0, grid->words_per_row * grid->height * sizeof(uint64_t));
+        sink.set_run = set_bitgrid_run;
+        sink.ctx = grid;
+        break;
+    }
+    case ENGINE_CELLS: {
+        const size_t num_cells = sim->g.stride * sim->g.height;
+        for (size_t i = 0; i < num_cells; i++) {
+            cells_sink.cells[i] = DEAD_CELL;
+        }
+        sink.set_run = set_cells_run;
+        sink.ctx = &cells_sink;
+        break;
+    }
+    }
+    if (!pattern_load(path, &sink, offset_x, offset_y, stats)) {
+        return false;
+    }
+
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+        bitgrid_refresh_halo(&sim->bits[sim->current]);
+        tile_map_mark_all(&sim->tiles);
+        break;
+    case ENGINE_CELLS:
+        grid_refresh_halo(&sim->g, sim->cells[sim->current]);
+        break;
+    case ENGINE_HASHLIFE:
+        if (!hashlife_load_bitgrid(&sim->hl, &sim->bits[0])) {
+            fprintf(stderr, "Error: The grid is too large for the hashlife engine.\n");
+            return false;
+        }
+        break;
+    case ENGINE_PLANE:
+        plane_load_bitgrid(&sim->plane, &sim->bits[0]);
+        break;
+    }
+    return true;
+}
+
+// Hands the current generation to the checkpoint writer. Returns false if
+// the writer is still busy with the last one and wait is not set.
+bool sim_checkpoint(struct simulation* const sim, struct checkpoint_writer* const writer, const bool wait)
+{
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+        return checkpoint_writer_submit(writer, &sim->bits[sim->current], sim->generation, wait);
+    case ENGINE_CELLS:
+        bitgrid_from_argb(&sim->bits[0], sim->cells[sim->current], sim->g.stride);
+        return checkpoint_writer_submit(writer, &sim->bits[0], sim->generation, wait);
+    case ENGINE_HASHLIFE:
+    case ENGINE_PLANE:
+        break;
+    }
+    return false;
+}
+
+// Queues the current generation for the recording
+bool sim_record(struct simulation* const sim, struct recorder* const rec)
+{
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+        return recorder_submit(rec, &sim->bits[sim->current], sim->generation);
+    case ENGINE_CELLS:
+        bitgrid_from_argb(&sim->bits[0], sim->cells[sim->current], sim->g.stride);
+        return recorder_submit(rec, &sim->bits[0], sim->generation);
+    case ENGINE_HASHLIFE:
+    case ENGINE_PLANE:
+        break;
+    }
+    return false;
+}
+
+// The grid must have the dimensions and boundary of the checkpoint
+bool sim_restore(struct simulation* const sim, struct thread_pool* const pool, const struct checkpoint* const cp)
+{
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+        if (!checkpoint_unpack(pool, cp, &sim->bits[sim->current])) {
+            return false;
+        }
+        bitgrid_refresh_halo(&sim->bits[sim->current]);
+        tile_map_mark_all(&sim->tiles);
+        break;
+    case ENGINE_CELLS:
+        if (!checkpoint_unpack(pool, cp, &sim->bits[0])) {
+            return false;
+        }
+        bitgrid_to_argb(&sim->bits[0], sim->cells[sim->current], sim->g.width, sim->g.height, sim->g.stride);
+        grid_refresh_halo(&sim->g, sim->cells[sim->current]);
+        break;
+    case ENGINE_HASHLIFE:
+        if (!checkpoint_unpack(pool, cp, &sim->bits[0])) {
+            return false;
+        }
+        if (!hashlife_load_bitgrid(&sim->hl, &sim->bits[0])) {
+            fprintf(stderr, "Error: The grid is too large for the hashlife engine.\n");
+            return false;
+        }
+        sim->hl.generation = cp->header->generation;
+        break;
+    case ENGINE_PLANE:
+        if (!checkpoint_unpack(pool, cp, &sim->bits[0])) {
+            return false;
+        }
+        plane_load_bitgrid(&sim->plane, &sim->bits[0]);
+        break;
+    }
+    sim->generation = cp->header->generation;
+    return true;
+}
+
+// Both simulations must have the same grid and engine, which must not be
+// the hashlife engine
+void sim_copy(struct simulation* const dst, const struct simulation* const src)
+{
+    switch (src->engine) {
+    case ENGINE_BITGRID: {
+        const struct bitgrid* const grid = &src->bits[src->current];
+        memcpy(dst->bits[dst->current].words, grid->words, grid->words_per_row * grid->height * sizeof(uint64_t));
+        bitgrid_refresh_halo(&dst->bits[dst->current]);
+        // The other buffer of dst does not match src's, so every tile has
+        // to be recomputed once
+        tile_map_mark_all(&dst->tiles);
+        break;
+    }
+    case ENGINE_CELLS:
+        memcpy(dst->cells[dst->current], src->cells[src->current], grid_num_bytes(&src->g));
+        grid_refresh_halo(&dst->g, dst->cells[dst->current]);
+        break;
+    case ENGINE_PLANE:
+        plane_copy(&dst->plane, &src->plane);
+        break;
+    case ENGINE_HASHLIFE:
+        return;
+    }
+    dst->generation = src->generation;
+    dst->hash = src->hash;
+    dst->census = src->census;
+}
+
+// Only fails when the hashlife engine cannot advance its universe any
+// further
+bool sim_step(struct simulation* const sim, struct thread_pool* const pool)
+{
+    const size_t next = 1 - sim->current;
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+        bitgrid_step_tiles_parallel(pool, &sim->bits[sim->current], &sim->bits[next], &sim->tiles);
+        sim->current = next;
+        bitgrid_refresh_halo(&sim->bits[sim->current]);
+        sim->hash = tile_map_hash(&sim->tiles);
+        tile_map_census(&sim->tiles, &sim->census);
+        break;
+    case ENGINE_CELLS:
+        if (sim->config.block_generations > 0) {
+            cell_blocker_step(&sim->blocker, pool, sim->cells[sim->current], sim->cells[next], sim->row_hashes, sim->row_census, sim->config.block_generations);
+            sim->current = next;
+            // The last of them is counted below
+            sim->generation += sim->config.block_generations - 1;
+        } else {
+            update_cells_parallel(pool, sim->kernel, &sim->g, sim->cells[sim->current], sim->cells[next], sim->row_hashes, sim->row_census);
+            if (!sim->kernel->in_place) {
+                sim->current = next;
+            }
+        }
+        grid_refresh_halo(&sim->g, sim->cells[sim->current]);
+        sim->hash = 0;
+        census_clear(&sim->census);
+        for (size_t y = 0; y < sim->g.height; y++) {
+            sim->hash += sim->row_hashes[y];
+            census_merge(&sim->census, &sim->row_census[y]);
+        }
+        break;
+    case ENGINE_HASHLIFE:
+        // Single threaded; the memoized results make up for it
+        if (!hashlife_jump(&sim->hl, sim->config.hashlife_step_log2)) {
+            fprintf(stderr, "Error: The pattern has grown too large for the hashlife engine to advance it by 2^%u generations.\n",
+                    sim->config.hashlife_step_log2);
+            return false;
+        }
+        sim->generation = sim->hl.generation;
+        return true;
+    case ENGINE_PLANE:
+        plane_step(&sim->plane, pool);
+        sim->hash = sim->plane.hash;
+        sim->census = sim->plane.census;
+        break;
+    }
+    sim->generation++;
+    return true;
+}
+
+// Returns the ARGB pixels of the top left of the current generation, or for
+// the unbounded engines, of view. Only the plane engine zooms out. The
+// cells engine returns its own buffer, the other engines expand their cells
+// into pixels. The bitgrid engine only expands its dirty tiles, so pixels
+// must be kept between calls. pitch is set to the distance between rows in
+// bytes.
+const uint32_t* sim_view(
+    struct simulation* const sim,
+    uint32_t* const pixels,
+    const size_t view_width,
+    const size_t view_height,
+    const struct viewport* const view,
+    size_t* const pitch)
+{
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+        bitgrid_to_argb_tiles(&sim->bits[sim->current], pixels, view_width, view_height, view_width, &sim->tiles);
+        *pitch = view_width * sizeof(uint32_t);
+        return pixels;
+    case ENGINE_CELLS:
+        *pitch = sim->g.stride * sizeof(uint32_t);
+        return sim->cells[sim->current];
+    case ENGINE_HASHLIFE:
+        hashlife_render(&sim->hl, pixels, view_width, view_height, view_width, view->x, view->y);
+        *pitch = view_width * sizeof(uint32_t);
+        return pixels;
+    case ENGINE_PLANE:
+        plane_render(&sim->plane, pixels, view_width, view_height, view_width, view);
+        *pitch = view_width * sizeof(uint32_t);
+        return pixels;
+    }
+    return NULL;
+}
+
+// Returns the current generation of the bitgrid engine, or NULL for other
+// engines
+const struct bitgrid* sim_bitgrid(const struct simulation* const sim)
+{
+    return (sim->engine == ENGINE_BITGRID) ? &sim->bits[sim->current] : NULL;
+}
+
+// Returns NULL for engines that don't track tiles
+struct tile_map* sim_tiles(struct simulation* const sim)
+{
+    return (sim->engine == ENGINE_BITGRID) ? &sim->tiles : NULL;
+}
+
+// Whether the engine steps a plane with no edges, rather than the grid
+bool engine_is_unbounded(const enum engine engine)
+{
+    return (engine == ENGINE_HASHLIFE) || (engine == ENGINE_PLANE);
+}
+
+const char* sim_engine_name(const struct simulation* const sim)
+{
+    switch (sim->engine) {
+    case ENGINE_BITGRID:
+        return "bitgrid";
+    case ENGINE_CELLS:
+        return sim->kernel->name;
+    case ENGINE_HASHLIFE:
+        return "hashlife";
+    case ENGINE_PLANE:
+        return "plane";
+    }
+    return "unknown";
+}
+
+bool parse_engine(const char* const str, enum engine* const engine)
+{
+    if (strcmp(str, "bitgrid") == 0) {
+        *engine = ENGINE_BITGRID;
+    } else if (strcmp(str, "cells") == 0) {
+        *engine = ENGINE_CELLS;
+    } else if (strcmp(str, "hashlife") == 0) {
+        *engine = ENGINE_HASHLIFE;
+    } else if (strcmp(str, "plane") == 0) {
+        *engine = ENGINE_PLANE;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef sim_h
+#define sim_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "grid.h"
+#include "bitgrid.h"
+#include "kernels.h"
+#include "blocking.h"
+#include "pool.h"
+#include "hashlife.h"
+#include "plane.h"
+#include "tiles.h"
+#include "pattern.h"
+#include "checkpoint.h"
+#include "record.h"
+#include "seed.h"
+#include "census.h"
+
+enum engine {
+    ENGINE_BITGRID,
+    ENGINE_CELLS,
+    ENGINE_HASHLIFE,
+    ENGINE_PLANE
+};
+
+struct sim_config {
+    enum engine engine;
+    // The kernel of the cells engine, or NULL for the best one for the CPU
+    const struct cell_kernel* kernel;
+    // Each step of the hashlife engine advances 2^hashlife_step_log2
+    // generations
+    unsigned int hashlife_step_log2;
+    size_t hashlife_max_bytes;
+    // With block_generations above 0, each step of the cells engine
+    // advances that many generations a tile of block_size cells at a time,
+    // on up to num_threads threads
+    size_t block_generations;
+    size_t block_size;
+    size_t num_threads;
+};
+
+// One generation is current and the other buffer receives the next one,
+// or is scratch space for in-place kernels. The hashlife and plane engines
+// only use bits[0] to seed their universe, which is not bounded by the
+// grid, and the cells engine uses it to pack checkpoints and recorded
+// generations and to unpack checkpoints. The bitgrid engine only recomputes
+// the tiles around those that changed. hash is the hash of the current
+// generation, summed from the hashes of its tiles or rows that the last
+// step left behind; it is 0 until the first step and with the hashlife
+// engine. census is summed the same way, and is empty until then and with
+// the hashlife engine.
+struct simulation {
+    struct grid g;
+    struct sim_config config;
+    enum engine engine;
+    const struct cell_kernel* kernel;
+    struct bitgrid bits[2];
+    uint32_t* cells[2];
+    uint64_t* row_hashes;
+    struct census* row_census;
+    struct hashlife hl;
+    struct plane plane;
+    struct tile_map tiles;
+    struct cell_blocker blocker;
+    size_t current;
+    uint64_t generation;
+    uint64_t hash;
+    struct census census;
+};
+
+bool sim_create(struct simulation* const sim, const struct grid* const g, const struct sim_config* const config);
+void sim_destroy(struct simulation* const sim);
+bool sim_randomize(struct simulation* const sim, struct thread_pool* const pool, const struct board_seed* const seed);
+bool sim_load_pattern(struct simulation* const sim, const char* const path, const int64_t offset_x, const int64_t offset_y, struct pattern_stats* const stats);
+bool sim_checkpoint(struct simulation* const sim, struct checkpoint_writer* const writer, const bool wait);
+bool sim_record(struct simulation* const sim, struct recorder* const rec);
+bool sim_restore(struct simulation* const sim, struct thread_pool* const pool, const struct checkpoint* const cp);
+void sim_copy(struct simulation* const dst, const struct simulation* const src);
+bool sim_step(struct simulation* const sim, struct thread_pool* const pool);
+const uint32_t* sim_view(struct simulation* const sim, uint32_t* const pixels, const size_t view_width, const size_t view_height, const struct viewport* const view, size_t* const pitch);
+bool engine_is_unbounded(const enum engine engine);
+const struct bitgrid* sim_bitgrid(const struct simulation* const sim);
+struct tile_map* sim_tiles(struct simulation* const sim);
+const char* sim_engine_name(const struct simulation* const sim);
+bool parse_engine(const char* const str, enum engine* const engine);
+
+#endif
@@ -0,0 +1,125 @@
+#include "tiles.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool tile_map_create(struct tile_map* const map, const size_t width, const size_t height, const bool wrap)
+{
+    map->tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    map->tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    map->wrap = wrap;
+    const size_t num_tiles = tile_map_num_tiles(map);
+    map->changed = calloc(num_tiles, 1);
+    map->active = calloc(num_tiles, 1);
+    map->dirty = calloc(num_tiles, 1);
+    map->hashes = calloc(num_tiles, sizeof(uint64_t));
+    map->census = malloc(num_tiles * sizeof(struct census));
+    map->num_active = 0;
+    if ((map->changed == NULL) || (map->active == NULL) || (map->dirty == NULL) || (map->hashes == NULL) || (map->census == NULL)) {
+        tile_map_destroy(map);
+        return false;
+    }
+    for (size_t i = 0; i < num_tiles; i++) {
+        census_clear(&map->census[i]);
+    }
+    return true;
+}
+
+void tile_map_destroy(struct tile_map* const map)
+{
+    free(map->changed);
+    free(map->active);
+    free(map->dirty);
+    free(map->hashes);
+    free(map->census);
+    map->changed = NULL;
+    map->active = NULL;
+    map->dirty = NULL;
+    map->hashes = NULL;
+    map->census = NULL;
+}
+
+// For when every cell may have changed, such as after loading a new board
+void tile_map_mark_all(struct tile_map* const map)
+{
+    const size_t num_tiles = tile_map_num_tiles(map);
+    memset(map->changed, 1, num_tiles);
+    memset(map->dirty, 1, num_tiles);
+}
+
+// Both maps must be for the same grid size
+void tile_map_copy(struct tile_map* const dst, const struct tile_map* const src)
+{
+    const size_t num_tiles = tile_map_num_tiles(src);
+    memcpy(dst->changed, src->changed, num_tiles);
+    memcpy(dst->active, src->active, num_tiles);
+    memcpy(dst->dirty, src->dirty, num_tiles);
+    memcpy(dst->hashes, src->hashes, num_tiles * sizeof(uint64_t));
+    memcpy(dst->census, src->census, num_tiles * sizeof(struct census));
+    dst->num_active = src->num_active;
+}
+
+// The range of tiles from i - 1 to i + 1 as a start and a count, which
+// wraps around past either end of the row or column of tiles when wrap is set
+static inline void neighbor_range(const size_t i, const size_t num, const bool wrap, size_t* const start, size_t* const count)
+{
+    if (wrap) {
+        *start = (i + num - 1) % num;
+        *count = (num < 3) ? num : 3;
+    } else {
+        *start = (i > 0) ? i - 1 : 0;
+        *count = ((i + 1 < num) ? i + 2 : num) - *start;
+    }
+}
+
+// A tile can only change if it or one of its eight neighbors changed in the
+// last generation. Returns the number of active tiles.
+size_t tile_map_update_active(struct tile_map* const map)
+{
+    const size_t tiles_x = map->tiles_x;
+    const size_t tiles_y = map->tiles_y;
+    memset(map->active, 0, tile_map_num_tiles(map));
+    for (size_t ty = 0; ty < tiles_y; ty++) {
+        for (size_t tx = 0; tx < tiles_x; tx++) {
+            if (!map->changed[(ty * tiles_x) + tx]) {
+                continue;
+            }
+            size_t y_start, num_y, x_start, num_x;
+            neighbor_range(ty, tiles_y, map->wrap, &y_start, &num_y);
+            neighbor_range(tx, tiles_x, map->wrap, &x_start, &num_x);
+            for (size_t j = 0; j < num_y; j++) {
+                const size_t y = (y_start + j) % tiles_y;
+                for (size_t i = 0; i < num_x; i++) {
+                    map->active[(y * tiles_x) + ((x_start + i) % tiles_x)] = 1;
+                }
+            }
+        }
+    }
+    size_t num_active = 0;
+    for (size_t i = 0; i < tile_map_num_tiles(map); i++) {
+        num_active += map->active[i];
+    }
+    map->num_active = num_active;
+    return num_active;
+}
+
+void tile_map_clear_dirty(struct tile_map* const map)
+{
+    memset(map->dirty, 0, tile_map_num_tiles(map));
+}
+
+uint64_t tile_map_hash(const struct tile_map* const map)
+{
+    uint64_t hash = 0;
+    for (size_t i = 0; i < tile_map_num_tiles(map); i++) {
+        hash += map->hashes[i];
+    }
+    return hash;
+}
+
+void tile_map_census(const struct tile_map* const map, struct census* const census)
+{
+    census_clear(census);
+    for (size_t i = 0; i < tile_map_num_tiles(map); i++) {
+        census_merge(census, &map->census[i]);
+    }
+}
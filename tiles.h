@@ -0,0 +1,48 @@
+#ifndef tiles_h
+#define tiles_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "census.h"
+
+// A tile is one 64-bit word of a bitgrid row, 64 rows tall
+#define TILE_SIZE 64
+
+// changed is set for tiles that differed between the last two generations,
+// and active for tiles that are recomputed in the next step: the changed
+// tiles and their neighbors. dirty accumulates changed tiles until whoever
+// displays the grid has redrawn them and clears it. On a torus the tiles on
+// opposite edges are neighbors. hashes holds the hash of the cells of each
+// tile as of the last time it was stepped, which sum up to the hash of the
+// generation once every tile has been stepped, and census likewise holds
+// the census of each tile. A tile that is not stepped did not change in
+// the last generation, so the births and deaths it was last stepped with
+// are still right: none.
+struct tile_map {
+    size_t tiles_x;
+    size_t tiles_y;
+    bool wrap;
+    uint8_t* changed;
+    uint8_t* active;
+    uint8_t* dirty;
+    uint64_t* hashes;
+    struct census* census;
+    size_t num_active;
+};
+
+bool tile_map_create(struct tile_map* const map, const size_t width, const size_t height, const bool wrap);
+void tile_map_destroy(struct tile_map* const map);
+void tile_map_mark_all(struct tile_map* const map);
+void tile_map_copy(struct tile_map* const dst, const struct tile_map* const src);
+size_t tile_map_update_active(struct tile_map* const map);
+void tile_map_clear_dirty(struct tile_map* const map);
+uint64_t tile_map_hash(const struct tile_map* const map);
+void tile_map_census(const struct tile_map* const map, struct census* const census);
+
+static inline size_t tile_map_num_tiles(const struct tile_map* const map)
+{
+    return map->tiles_x * map->tiles_y;
+}
+
+#endif